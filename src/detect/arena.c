@@ -0,0 +1,149 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+// --- Configuration ---
+#define ARENA_BLOCK_SIZE (1 << 20)  // 1 MB is enough for a full page in most cases
+#define ARENA_ALIGN 16
+
+#define ALIGN_UP(n) (((n) + (ARENA_ALIGN - 1)) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t size;
+    size_t used;
+    size_t reserved;        // Keeps data[] 16-byte aligned
+    unsigned char data[];
+};
+
+// --- Per-thread arena ---
+
+static void free_thread_arena(gpointer data) {
+    arena_destroy((Arena*)data);
+    free(data);
+}
+
+static GPrivate thread_arena = G_PRIVATE_INIT(free_thread_arena);
+
+Arena* page_arena(void) {
+    Arena *arena = (Arena*)g_private_get(&thread_arena);
+    if (!arena) {
+        arena = (Arena*)calloc(1, sizeof(Arena));
+        g_private_set(&thread_arena, arena);
+    }
+    return arena;
+}
+
+// --- Allocation ---
+
+static ArenaBlock* new_block(size_t size) {
+    ArenaBlock *block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + size);
+    if (!block) return NULL;
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void* arena_alloc(Arena *arena, size_t size) {
+    size = ALIGN_UP(size ? size : 1);
+
+    // Blocks after the current one are empty (see arena_rewind): reuse them
+    ArenaBlock *block = arena->current;
+    while (block && block->used + size > block->size) {
+        block = block->next;
+    }
+
+    if (!block) {
+        block = new_block(size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE);
+        if (!block) return NULL;
+
+        // Append at the end of the chain
+        if (!arena->first) {
+            arena->first = block;
+        } else {
+            ArenaBlock *last = arena->current ? arena->current : arena->first;
+            while (last->next) last = last->next;
+            last->next = block;
+        }
+    }
+
+    arena->current = block;
+    void *ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+void* arena_calloc(Arena *arena, size_t count, size_t size) {
+    void *ptr = arena_alloc(arena, count * size);
+    if (ptr) memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void* arena_grow(Arena *arena, void *ptr, size_t old_size, size_t new_size) {
+    if (!ptr) return arena_alloc(arena, new_size);
+    if (new_size <= old_size) return ptr;
+
+    // Last allocation of the current block: extend it in place
+    ArenaBlock *block = arena->current;
+    size_t old_aligned = ALIGN_UP(old_size ? old_size : 1);
+    if (block && (unsigned char*)ptr + old_aligned == block->data + block->used) {
+        size_t extra = ALIGN_UP(new_size) - old_aligned;
+        if (block->used + extra <= block->size) {
+            block->used += extra;
+            return ptr;
+        }
+    }
+
+    void *moved = arena_alloc(arena, new_size);
+    if (moved) memcpy(moved, ptr, old_size);
+    return moved;
+}
+
+// --- Scopes ---
+
+ArenaMark arena_mark(Arena *arena) {
+    ArenaMark mark = { arena->current, arena->current ? arena->current->used : 0 };
+    return mark;
+}
+
+void arena_rewind(Arena *arena, ArenaMark mark) {
+    // Back to the beginning: this is the end of a page
+    if (!mark.block || (mark.block == arena->first && mark.used == 0)) {
+        arena_reset(arena);
+        return;
+    }
+
+    arena->current = mark.block;
+    mark.block->used = mark.used;
+    for (ArenaBlock *block = mark.block->next; block; block = block->next) {
+        block->used = 0;
+    }
+}
+
+void arena_reset(Arena *arena) {
+    if (!arena->first) return;
+
+    // The page did not fit in one block: merge them so the next one does
+    if (arena->first->next) {
+        size_t total = 0;
+        for (ArenaBlock *block = arena->first; block; block = block->next) total += block->size;
+        arena_destroy(arena);
+        arena->first = new_block(total);
+    } else {
+        arena->first->used = 0;
+    }
+    arena->current = arena->first;
+}
+
+void arena_destroy(Arena *arena) {
+    ArenaBlock *block = arena->first;
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->first = NULL;
+    arena->current = NULL;
+}
@@ -0,0 +1,52 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+
+/**
+ * Page-scoped bump allocator for the short-lived buffers of detection and
+ * export (histograms, bar lists, visited maps, blob arrays...).
+ * Nothing is freed individually: take a mark, allocate, then rewind to it.
+ * Rewinding to an empty arena keeps the memory (merged into one block), so
+ * once the first page is done, the next ones do not call malloc at all.
+ */
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock *first;
+    ArenaBlock *current;
+} Arena;
+
+typedef struct {
+    ArenaBlock *block;
+    size_t used;
+} ArenaMark;
+
+/**
+ * Returns the arena of the calling thread (created on first use,
+ * released when the thread exits).
+ */
+Arena* page_arena(void);
+
+void* arena_alloc(Arena *arena, size_t size);
+void* arena_calloc(Arena *arena, size_t count, size_t size);
+
+/**
+ * Grows the last allocation in place when possible, copies otherwise.
+ */
+void* arena_grow(Arena *arena, void *ptr, size_t old_size, size_t new_size);
+
+ArenaMark arena_mark(Arena *arena);
+void arena_rewind(Arena *arena, ArenaMark mark);
+
+/**
+ * Empties the arena (end of page). Memory is kept for the next page.
+ */
+void arena_reset(Arena *arena);
+
+/**
+ * Releases all the memory of the arena.
+ */
+void arena_destroy(Arena *arena);
+
+#endif
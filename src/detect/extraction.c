@@ -1,4 +1,5 @@
 #include "extraction.h"
+#include "arena.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -14,18 +15,28 @@
 // Horizontal gap to split two words on the same line (e.g., "DESK   THE")
 #define WORD_SPLIT_GAP 15 
 
+// --- XY-Cut Thresholds (multi-puzzle pages) ---
+#define XYCUT_MIN_GAP 40                // Whitespace run needed to cut a region in two
+#define XYCUT_MAX_DEPTH 12              // Recursion safety limit
+#define XYCUT_MIN_REGION 20             // Narrower leaves are considered noise
+#define GRID_MIN_LINES 3                // Ruled lines needed in each direction for a grid
+
 // --- Internal Structures for Histogram Analysis ---
+// All of them (and every histogram) live in the page arena of the thread.
 typedef struct { int start; int end; int thickness; } Bar;
 typedef struct { Bar *bars; int count; } BarList;
 
-// --- Helper Functions ---
+// --- Region Tree (recursive XY-Cut) ---
+typedef enum { REGION_SPLIT, REGION_GRID, REGION_WORDLIST, REGION_NOISE } RegionKind;
+typedef struct RegionNode {
+    Box box;
+    RegionKind kind;
+    struct RegionNode *parent;
+    struct RegionNode *children;
+    int child_count;
+} RegionNode;
 
-/**
- * Frees a BarList structure.
- */
-static void free_bar_list(BarList *list) {
-    if (list) { free(list->bars); free(list); }
-}
+// --- Helper Functions ---
 
 /**
  * Comparator for sorting bars by thickness (descending).
@@ -49,11 +60,12 @@ static BarList* analyze_bars(int *histogram, int length, int threshold) {
         }
     }
     
-    if (count == 0) return (BarList*)calloc(1, sizeof(BarList));
+    Arena *arena = page_arena();
+    if (count == 0) return (BarList*)arena_calloc(arena, 1, sizeof(BarList));
 
     // 2. Populate segments
-    BarList *list = (BarList*)malloc(sizeof(BarList));
-    list->bars = (Bar*)malloc(count * sizeof(Bar));
+    BarList *list = (BarList*)arena_alloc(arena, sizeof(BarList));
+    list->bars = (Bar*)arena_alloc(arena, count * sizeof(Bar));
     list->count = count;
     
     in_bar = 0; 
@@ -82,15 +94,13 @@ static BarList* analyze_bars(int *histogram, int length, int threshold) {
 
 /**
  * Merges bars that are close to each other (closer than merge_gap).
+ * Works in place: the merged list never has more bars than the original.
  */
 static BarList* merge_bar_list(BarList *original, int merge_gap) {
     if (!original || original->count == 0) return original;
     
-    BarList *merged = (BarList*)malloc(sizeof(BarList));
-    merged->bars = (Bar*)malloc(original->count * sizeof(Bar));
-    
+    BarList *merged = original;
     int m_idx = 0;
-    merged->bars[0] = original->bars[0];
 
     for (int i = 1; i < original->count; i++) {
         Bar *curr = &merged->bars[m_idx];
@@ -107,8 +117,6 @@ static BarList* merge_bar_list(BarList *original, int merge_gap) {
         }
     }
     merged->count = m_idx + 1;
-    free(original->bars); 
-    free(original);
     return merged;
 }
 
@@ -124,12 +132,18 @@ static void detect_words_in_list(GdkPixbuf *pixbuf, PageLayout *layout) {
     guchar *pixels = gdk_pixbuf_get_pixels(pixbuf);
     int nc = gdk_pixbuf_get_n_channels(pixbuf);
 
+    Arena *arena = page_arena();
+    ArenaMark page_mark = arena_mark(arena);
+
     // 1. Vertical Analysis: Find lines of text
-    int *histo_y = (int *)calloc(h, sizeof(int));
+    int *histo_y = (int *)arena_calloc(arena, h, sizeof(int));
     int end_x_list = layout->list_x + layout->list_width;
     if (end_x_list >= gdk_pixbuf_get_width(pixbuf)) end_x_list = gdk_pixbuf_get_width(pixbuf) - 1;
+    int start_y_list = layout->list_y;
+    int end_y_list = layout->list_y + layout->list_height;
+    if (end_y_list > h) end_y_list = h;
 
-    for (int y = 0; y < h; y++) {
+    for (int y = start_y_list; y < end_y_list; y++) {
         guchar *row = pixels + y * rs;
         int blacks = 0;
         for (int x = layout->list_x; x <= end_x_list; x++) {
@@ -139,10 +153,9 @@ static void detect_words_in_list(GdkPixbuf *pixbuf, PageLayout *layout) {
     }
 
     BarList *lines = merge_bar_list(analyze_bars(histo_y, h, 0), MERGE_THRESHOLD_Y);
-    free(histo_y);
 
     if (lines->count == 0) {
-        free_bar_list(lines);
+        arena_rewind(arena, page_mark);
         return;
     }
 
@@ -156,8 +169,10 @@ static void detect_words_in_list(GdkPixbuf *pixbuf, PageLayout *layout) {
         if (line.thickness < TEXT_LINE_MIN_HEIGHT) continue;
 
         // Build horizontal histogram for this specific text line
+        // (its buffers are recycled for the next line)
+        ArenaMark line_mark = arena_mark(arena);
         int list_w = layout->list_width;
-        int *histo_x = (int*)calloc(list_w, sizeof(int));
+        int *histo_x = (int*)arena_calloc(arena, list_w, sizeof(int));
         
         for (int y = line.start; y <= line.end; y++) {
             guchar *row = pixels + y * rs;
@@ -191,11 +206,10 @@ static void detect_words_in_list(GdkPixbuf *pixbuf, PageLayout *layout) {
             layout->word_count++;
         }
 
-        free(histo_x);
-        free_bar_list(words_in_line);
+        arena_rewind(arena, line_mark);
     }
 
-    free_bar_list(lines);
+    arena_rewind(arena, page_mark);
 }
 
 void free_page_layout(PageLayout *layout) {
@@ -206,64 +220,81 @@ void free_page_layout(PageLayout *layout) {
     }
 }
 
-PageLayout* detect_layout_from_pixbuf(GdkPixbuf *pixbuf) {
+void free_page_layouts(PageLayout **layouts, int count) {
+    if (!layouts) return;
+    for (int i = 0; i < count; i++) free_page_layout(layouts[i]);
+    free(layouts);
+}
+
+/**
+ * Runs the grid/word-list detection restricted to one region of the page.
+ * The widest X block of the region is the grid, the second widest (if any)
+ * is the word list. Words are NOT detected here (see detect_words_in_list).
+ */
+static PageLayout* detect_layout_in_region(GdkPixbuf *pixbuf, Box region) {
     PageLayout *layout = (PageLayout*)calloc(1, sizeof(PageLayout));
-    int w = gdk_pixbuf_get_width(pixbuf);
-    int h = gdk_pixbuf_get_height(pixbuf);
     guchar *pixels = gdk_pixbuf_get_pixels(pixbuf);
     int rs = gdk_pixbuf_get_rowstride(pixbuf);
     int nc = gdk_pixbuf_get_n_channels(pixbuf);
+    int rx = region.x, ry = region.y, rw = region.width, rh = region.height;
+    Arena *arena = page_arena();
 
-    // --- PASS 1: Global X Projection (Find Grid vs WordList) ---
-    int *gx = (int*)calloc(w, sizeof(int));
-    for(int y=0; y<h; y++) {
+    // --- PASS 1: X Projection of the region (Find Grid vs WordList) ---
+    int *gx = (int*)arena_calloc(arena, rw, sizeof(int));
+    for(int y=ry; y<ry+rh; y++) {
         guchar *row = pixels + y*rs;
-        for(int x=0; x<w; x++) if((row[x*nc]+row[x*nc+1]+row[x*nc+2]) < BLACK_THRESHOLD) gx[x]++;
+        for(int x=0; x<rw; x++) {
+            guchar *p = row + (rx+x)*nc;
+            if((p[0]+p[1]+p[2]) < BLACK_THRESHOLD) gx[x]++;
+        }
     }
     
-    BarList *xb = merge_bar_list(analyze_bars(gx, w, BLOB_MIN_PIXELS), MERGE_THRESHOLD_X);
-    free(gx);
+    BarList *xb = merge_bar_list(analyze_bars(gx, rw, BLOB_MIN_PIXELS), MERGE_THRESHOLD_X);
     
-    if (xb->count == 0) { free_bar_list(xb); return layout; }
+    if (xb->count == 0) return layout;
     
     // Sort bars to find the biggest ones (assuming biggest is grid)
     qsort(xb->bars, xb->count, sizeof(Bar), compare_bars);
     
     // 1st biggest block is the GRID
-    layout->grid_x = xb->bars[0].start;
+    layout->grid_x = rx + xb->bars[0].start;
     layout->grid_width = xb->bars[0].thickness;
     
     // 2nd biggest block (if significant) is the WORD LIST
     if (xb->count > 1 && xb->bars[1].thickness > layout->grid_width * MIN_LIST_WIDTH_RATIO) {
         layout->has_wordlist = 1;
-        layout->list_x = xb->bars[1].start;
+        layout->list_x = rx + xb->bars[1].start;
         layout->list_width = xb->bars[1].thickness;
+        layout->list_y = ry;
+        layout->list_height = rh;
     }
-    free_bar_list(xb);
 
     // --- PASS 2: Grid Rows Detection (Y Projection) ---
-    int *gy = (int*)calloc(h, sizeof(int));
-    for(int y=0; y<h; y++) {
-        guchar *row = pixels + y*rs;
+    int *gy = (int*)arena_calloc(arena, rh, sizeof(int));
+    for(int y=0; y<rh; y++) {
+        guchar *row = pixels + (ry+y)*rs;
         for(int x=layout->grid_x; x<layout->grid_x+layout->grid_width; x++)
             if((row[x*nc]+row[x*nc+1]+row[x*nc+2]) < BLACK_THRESHOLD) gy[y]++;
     }
-    BarList *yb = analyze_bars(gy, h, (int)(layout->grid_width * GRID_LINE_THRESHOLD_PERCENT));
-    free(gy);
+    BarList *yb = analyze_bars(gy, rh, (int)(layout->grid_width * GRID_LINE_THRESHOLD_PERCENT));
 
-    layout->grid_y = yb->bars[0].start;
-    layout->grid_height = (yb->bars[yb->count-1].end - layout->grid_y) + 1;
+    // No ruled lines at all: nothing to reconstruct
+    if (yb->count == 0) return layout;
+
+    layout->grid_y = ry + yb->bars[0].start;
+    layout->grid_height = (yb->bars[yb->count-1].end - yb->bars[0].start) + 1;
     layout->rows = yb->count - 1;
 
     // --- PASS 3: Grid Columns Detection (X Projection inside grid) ---
-    int *gix = (int*)calloc(w, sizeof(int));
+    int *gix = (int*)arena_calloc(arena, layout->grid_width, sizeof(int));
     for(int y=layout->grid_y; y<layout->grid_y+layout->grid_height; y++) {
         guchar *row = pixels + y*rs;
-        for(int x=layout->grid_x; x<layout->grid_x+layout->grid_width; x++)
-            if((row[x*nc]+row[x*nc+1]+row[x*nc+2]) < BLACK_THRESHOLD) gix[x]++;
+        for(int x=0; x<layout->grid_width; x++) {
+            guchar *p = row + (layout->grid_x+x)*nc;
+            if((p[0]+p[1]+p[2]) < BLACK_THRESHOLD) gix[x]++;
+        }
     }
-    BarList *xib = analyze_bars(gix, w, (int)(layout->grid_height * GRID_LINE_THRESHOLD_PERCENT));
-    free(gix);
+    BarList *xib = analyze_bars(gix, layout->grid_width, (int)(layout->grid_height * GRID_LINE_THRESHOLD_PERCENT));
 
     layout->cols = xib->count - 1;
 
@@ -273,13 +304,13 @@ PageLayout* detect_layout_from_pixbuf(GdkPixbuf *pixbuf) {
         layout->grid_cells = (Box*)malloc(layout->rows * layout->cols * sizeof(Box));
         
         for (int r = 0; r < layout->rows; r++) {
-            int y0 = yb->bars[r].end + 1;
-            int y1 = yb->bars[r+1].start - 1;
+            int y0 = ry + yb->bars[r].end + 1;
+            int y1 = ry + yb->bars[r+1].start - 1;
             int h_cell = y1 - y0 + 1;
 
             for (int c = 0; c < layout->cols; c++) {
-                int x0 = xib->bars[c].end + 1;
-                int x1 = xib->bars[c+1].start - 1;
+                int x0 = layout->grid_x + xib->bars[c].end + 1;
+                int x1 = layout->grid_x + xib->bars[c+1].start - 1;
                 int w_cell = x1 - x0 + 1;
 
                 int index = r * layout->cols + c;
@@ -291,11 +322,317 @@ PageLayout* detect_layout_from_pixbuf(GdkPixbuf *pixbuf) {
         }
     }
 
-    free_bar_list(yb);
-    free_bar_list(xib);
+    return layout;
+}
+
+PageLayout* detect_layout_from_pixbuf(GdkPixbuf *pixbuf) {
+    Arena *arena = page_arena();
+    ArenaMark mark = arena_mark(arena);
+
+    Box page = { 0, 0, gdk_pixbuf_get_width(pixbuf), gdk_pixbuf_get_height(pixbuf) };
+    PageLayout *layout = detect_layout_in_region(pixbuf, page);
 
     // --- WORD LIST ANALYSIS ---
     detect_words_in_list(pixbuf, layout);
     
+    arena_rewind(arena, mark);
     return layout;
 }
+
+// -------------------------------------------------------------
+// RECURSIVE XY-CUT (MULTI-PUZZLE PAGES)
+// -------------------------------------------------------------
+
+/**
+ * Computes the X and Y ink projections of a box.
+ * histo_x has box.width entries, histo_y has box.height entries.
+ */
+static void project_box(GdkPixbuf *pixbuf, Box box, int *histo_x, int *histo_y) {
+    guchar *pixels = gdk_pixbuf_get_pixels(pixbuf);
+    int rs = gdk_pixbuf_get_rowstride(pixbuf);
+    int nc = gdk_pixbuf_get_n_channels(pixbuf);
+
+    for (int y = 0; y < box.height; y++) {
+        guchar *row = pixels + (box.y + y) * rs;
+        for (int x = 0; x < box.width; x++) {
+            guchar *p = row + (box.x + x) * nc;
+            if ((p[0] + p[1] + p[2]) < BLACK_THRESHOLD) {
+                histo_x[x]++;
+                histo_y[y]++;
+            }
+        }
+    }
+}
+
+/**
+ * Finds the whitespace gaps of a projection that are wide enough to cut.
+ * Only gaps strictly between two inked runs are reported.
+ * Returns the number of gaps and the widest one in *widest.
+ */
+static BarList* find_cut_gaps(int *histo, int length, int *widest) {
+    // Invert the projection so that whitespace becomes "activity"
+    int *blank = (int*)arena_alloc(page_arena(), length * sizeof(int));
+    for (int i = 0; i < length; i++) blank[i] = (histo[i] == 0);
+
+    BarList *gaps = analyze_bars(blank, length, 0);
+
+    // Keep inner gaps that are wide enough
+    int kept = 0;
+    *widest = 0;
+    for (int i = 0; i < gaps->count; i++) {
+        Bar g = gaps->bars[i];
+        if (g.start == 0 || g.end == length - 1) continue;
+        if (g.thickness < XYCUT_MIN_GAP) continue;
+        if (g.thickness > *widest) *widest = g.thickness;
+        gaps->bars[kept++] = g;
+    }
+    gaps->count = kept;
+    return gaps;
+}
+
+/**
+ * Classifies a leaf: a grid has ruled lines spanning it in both directions.
+ */
+static RegionKind classify_leaf(int *histo_x, int *histo_y, Box box) {
+    if (box.width < XYCUT_MIN_REGION || box.height < TEXT_LINE_MIN_HEIGHT) return REGION_NOISE;
+
+    BarList *h_lines = analyze_bars(histo_y, box.height, (int)(box.width * GRID_LINE_THRESHOLD_PERCENT));
+    BarList *v_lines = analyze_bars(histo_x, box.width, (int)(box.height * GRID_LINE_THRESHOLD_PERCENT));
+    int is_grid = h_lines->count >= GRID_MIN_LINES && v_lines->count >= GRID_MIN_LINES;
+
+    return is_grid ? REGION_GRID : REGION_WORDLIST;
+}
+
+/**
+ * Recursively cuts a region along its widest whitespace gaps (X or Y),
+ * then classifies the leaves. The whole tree lives in the page arena.
+ */
+static void build_region_tree(GdkPixbuf *pixbuf, RegionNode *node, int depth) {
+    Box box = node->box;
+    node->kind = REGION_NOISE;
+    node->children = NULL;
+    node->child_count = 0;
+    if (box.width <= 0 || box.height <= 0) return;
+
+    Arena *arena = page_arena();
+    int *hx = (int*)arena_calloc(arena, box.width, sizeof(int));
+    int *hy = (int*)arena_calloc(arena, box.height, sizeof(int));
+    project_box(pixbuf, box, hx, hy);
+
+    // Shrink the box to its ink extent
+    int x0 = 0, x1 = box.width - 1, y0 = 0, y1 = box.height - 1;
+    while (x0 <= x1 && hx[x0] == 0) x0++;
+    while (x1 >= x0 && hx[x1] == 0) x1--;
+    while (y0 <= y1 && hy[y0] == 0) y0++;
+    while (y1 >= y0 && hy[y1] == 0) y1--;
+
+    if (x0 > x1 || y0 > y1) return;
+
+    node->box.x = box.x + x0;
+    node->box.y = box.y + y0;
+    node->box.width = x1 - x0 + 1;
+    node->box.height = y1 - y0 + 1;
+    box = node->box;
+
+    int widest_x = 0, widest_y = 0;
+    BarList *gaps_x = find_cut_gaps(hx + x0, box.width, &widest_x);
+    BarList *gaps_y = find_cut_gaps(hy + y0, box.height, &widest_y);
+
+    // Cut along the direction with the widest gap
+    int cut_along_x = widest_x >= widest_y;
+    BarList *gaps = cut_along_x ? gaps_x : gaps_y;
+
+    if (gaps->count == 0 || depth >= XYCUT_MAX_DEPTH) {
+        node->kind = classify_leaf(hx + x0, hy + y0, box);
+    } else {
+        node->kind = REGION_SPLIT;
+        node->child_count = gaps->count + 1;
+        node->children = (RegionNode*)arena_calloc(arena, node->child_count, sizeof(RegionNode));
+
+        int start = 0;
+        for (int i = 0; i < node->child_count; i++) {
+            int end = (i < gaps->count) ? gaps->bars[i].start : (cut_along_x ? box.width : box.height);
+            RegionNode *child = &node->children[i];
+            child->parent = node;
+            if (cut_along_x) {
+                child->box = (Box){ box.x + start, box.y, end - start, box.height };
+            } else {
+                child->box = (Box){ box.x, box.y + start, box.width, end - start };
+            }
+            if (i < gaps->count) start = gaps->bars[i].end + 1;
+        }
+    }
+
+    for (int i = 0; i < node->child_count; i++) {
+        build_region_tree(pixbuf, &node->children[i], depth + 1);
+    }
+}
+
+/**
+ * Collects the leaves of a given kind, in reading order.
+ */
+static void collect_leaves(RegionNode *node, RegionKind kind, RegionNode ***out, int *count, int *capacity) {
+    if (node->kind == REGION_SPLIT) {
+        for (int i = 0; i < node->child_count; i++) collect_leaves(&node->children[i], kind, out, count, capacity);
+        return;
+    }
+    if (node->kind != kind) return;
+    if (*count >= *capacity) {
+        int old_capacity = *capacity;
+        *capacity = *capacity ? *capacity * 2 : 8;
+        *out = arena_grow(page_arena(), *out, old_capacity * sizeof(RegionNode*), *capacity * sizeof(RegionNode*));
+    }
+    (*out)[(*count)++] = node;
+}
+
+static int box_contains(Box outer, Box inner) {
+    return inner.x >= outer.x && inner.y >= outer.y &&
+           inner.x + inner.width <= outer.x + outer.width &&
+           inner.y + inner.height <= outer.y + outer.height;
+}
+
+static int boxes_overlap(Box a, Box b) {
+    return a.x < b.x + b.width && b.x < a.x + a.width &&
+           a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+static Box box_union(Box a, Box b) {
+    int x1 = (a.x + a.width > b.x + b.width) ? a.x + a.width : b.x + b.width;
+    int y1 = (a.y + a.height > b.y + b.height) ? a.y + a.height : b.y + b.height;
+    Box u;
+    u.x = (a.x < b.x) ? a.x : b.x;
+    u.y = (a.y < b.y) ? a.y : b.y;
+    u.width = x1 - u.x;
+    u.height = y1 - u.y;
+    return u;
+}
+
+/**
+ * Distance between the edges of two boxes (0 if they touch or overlap).
+ */
+static int box_gap(Box a, Box b) {
+    int dx = 0, dy = 0;
+    if (a.x + a.width < b.x) dx = b.x - (a.x + a.width);
+    else if (b.x + b.width < a.x) dx = a.x - (b.x + b.width);
+    if (a.y + a.height < b.y) dy = b.y - (a.y + a.height);
+    else if (b.y + b.height < a.y) dy = a.y - (b.y + b.height);
+    return dx > dy ? dx : dy;
+}
+
+// Detection work of one grid leaf, run on a worker of the page's pool
+typedef struct {
+    GdkPixbuf *pixbuf;
+    Box region;
+    PageLayout *layout;
+} DetectJob;
+
+static void run_region_job(gpointer job_data, gpointer user_data) {
+    (void)user_data;
+    DetectJob *job = (DetectJob*)job_data;
+    Arena *arena = page_arena();
+    ArenaMark mark = arena_mark(arena);
+    job->layout = detect_layout_in_region(job->pixbuf, job->region);
+    arena_rewind(arena, mark);
+}
+
+static void run_words_job(gpointer job_data, gpointer user_data) {
+    (void)user_data;
+    DetectJob *job = (DetectJob*)job_data;
+    detect_words_in_list(job->pixbuf, job->layout);
+}
+
+/**
+ * Runs func on every job, one region per worker, and waits for all of them.
+ * Jobs only read the shared pixbuf and use the arena of their thread.
+ */
+static void run_detect_jobs(GFunc func, DetectJob *jobs, int count) {
+    int workers = (int)g_get_num_processors();
+    if (workers > count) workers = count;
+
+    if (workers <= 1) {
+        for (int i = 0; i < count; i++) func(&jobs[i], NULL);
+        return;
+    }
+    GThreadPool *pool = g_thread_pool_new(func, NULL, workers, FALSE, NULL);
+    for (int i = 0; i < count; i++) g_thread_pool_push(pool, &jobs[i], NULL);
+    g_thread_pool_free(pool, FALSE, TRUE);
+}
+
+PageLayout** detect_page_layouts(GdkPixbuf *pixbuf, int *count) {
+    *count = 0;
+    Arena *arena = page_arena();
+    ArenaMark mark = arena_mark(arena);
+
+    RegionNode root = { { 0, 0, gdk_pixbuf_get_width(pixbuf), gdk_pixbuf_get_height(pixbuf) }, REGION_NOISE, NULL, NULL, 0 };
+    build_region_tree(pixbuf, &root, 0);
+
+    RegionNode **grids = NULL, **lists = NULL;
+    int grid_count = 0, grid_cap = 0, list_count = 0, list_cap = 0;
+    collect_leaves(&root, REGION_GRID, &grids, &grid_count, &grid_cap);
+    collect_leaves(&root, REGION_WORDLIST, &lists, &list_count, &list_cap);
+
+    PageLayout **layouts = NULL;
+    if (grid_count > 0) {
+        layouts = (PageLayout**)malloc(grid_count * sizeof(PageLayout*));
+        // 1 if the layout's word list was assembled from separate leaves
+        int *list_from_leaf = (int*)arena_calloc(arena, grid_count, sizeof(int));
+
+        // The page pixels were read by the XY-Cut: the regions are
+        // detected in parallel, then their word lists once attached
+        DetectJob *jobs = (DetectJob*)arena_calloc(arena, grid_count, sizeof(DetectJob));
+        for (int i = 0; i < grid_count; i++) {
+            jobs[i].pixbuf = pixbuf;
+            jobs[i].region = grids[i]->box;
+        }
+        run_detect_jobs(run_region_job, jobs, grid_count);
+        for (int i = 0; i < grid_count; i++) layouts[i] = jobs[i].layout;
+
+        // Attach each word list leaf to the nearest grid of its closest ancestor
+        for (int l = 0; l < list_count; l++) {
+            int best = -1;
+            for (RegionNode *anc = lists[l]->parent; anc && best < 0; anc = anc->parent) {
+                int best_gap = 0;
+                for (int g = 0; g < grid_count; g++) {
+                    if (!box_contains(anc->box, grids[g]->box)) continue;
+                    if (layouts[g]->has_wordlist && !list_from_leaf[g]) continue;
+                    int gap = box_gap(grids[g]->box, lists[l]->box);
+                    if (best < 0 || gap < best_gap) { best = g; best_gap = gap; }
+                }
+            }
+            if (best < 0) continue;
+
+            PageLayout *layout = layouts[best];
+            Box b = lists[l]->box;
+            if (layout->has_wordlist) {
+                // Several leaves (e.g. list columns): keep their union,
+                // unless it would swallow the grid (e.g. a title above it)
+                Box cur = { layout->list_x, layout->list_y, layout->list_width, layout->list_height };
+                Box grid = { layout->grid_x, layout->grid_y, layout->grid_width, layout->grid_height };
+                Box u = box_union(cur, b);
+                if (boxes_overlap(u, grid)) u = (b.width * b.height > cur.width * cur.height) ? b : cur;
+                layout->list_x = u.x; layout->list_y = u.y;
+                layout->list_width = u.width; layout->list_height = u.height;
+            } else {
+                layout->has_wordlist = 1;
+                layout->list_x = b.x; layout->list_y = b.y;
+                layout->list_width = b.width; layout->list_height = b.height;
+                list_from_leaf[best] = 1;
+            }
+        }
+
+        run_detect_jobs(run_words_job, jobs, grid_count);
+        *count = grid_count;
+    }
+
+    // End of page: the region tree and all histograms go away at once
+    arena_rewind(arena, mark);
+
+    // Nothing looked like a ruled grid: fall back to the single puzzle heuristic
+    if (*count == 0) {
+        layouts = (PageLayout**)malloc(sizeof(PageLayout*));
+        layouts[0] = detect_layout_from_pixbuf(pixbuf);
+        *count = 1;
+    }
+
+    return layouts;
+}
@@ -38,9 +38,24 @@ typedef struct PageLayout {
  */
 PageLayout* detect_layout_from_pixbuf(GdkPixbuf *pixbuf);
 
+/**
+ * Multi-puzzle detection.
+ * Splits the page with a recursive XY-Cut into a region tree, classifies
+ * each leaf as a grid or a word list, and returns one PageLayout per grid
+ * (each word list is attached to its nearest grid).
+ * Falls back to detect_layout_from_pixbuf when no ruled grid is found,
+ * so *count is always >= 1.
+ */
+PageLayout** detect_page_layouts(GdkPixbuf *pixbuf, int *count);
+
 /**
  * Frees all memory associated with a PageLayout.
  */
 void free_page_layout(PageLayout *layout);
 
+/**
+ * Frees an array returned by detect_page_layouts.
+ */
+void free_page_layouts(PageLayout **layouts, int count);
+
 #endif
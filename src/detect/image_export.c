@@ -1,4 +1,6 @@
 #include "image_export.h"
+#include "arena.h"
+#include "glyph.h"
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <stdio.h>
@@ -17,8 +19,7 @@
 #define MIN_BLOB_AREA 50 
 
 #define EXPECTED_LETTER_RATIO 0.70
-#define OUTPUT_SIZE 30
-#define UNIVERSAL_PADDING 7 
+#define UNIVERSAL_PADDING GLYPH_PADDING
 #define GRID_SAFETY_MARGIN 4
 
 #ifndef PATH_MAX
@@ -46,49 +47,16 @@ static int compare_blobs(const void *a, const void *b) {
 // -------------------------------------------------------------
 // CORE SAVING FUNCTION
 // -------------------------------------------------------------
+// Same normalization as the synthetic training glyphs (normalize_glyph)
 static void save_subimage(GdkPixbuf *source, int x, int y, int w, int h, const char *filepath, int padding) {
-    int img_w = gdk_pixbuf_get_width(source);
-    int img_h = gdk_pixbuf_get_height(source);
-    
-    // Bounds check
-    if (x < 0) x = 0; 
-    if (y < 0) y = 0;
-    if (x + w > img_w) w = img_w - x;
-    if (y + h > img_h) h = img_h - y;
-    if (w <= 0 || h <= 0) return;
-
-    // Extract
-    GdkPixbuf *extracted = gdk_pixbuf_new_subpixbuf(source, x, y, w, h);
-    
-    // Create canvas (30x30 white background)
-    GdkPixbuf *canvas = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, OUTPUT_SIZE, OUTPUT_SIZE);
-    gdk_pixbuf_fill(canvas, 0xFFFFFFFF);
-
-    // Calculate scale to fit with padding
-    int target_size = OUTPUT_SIZE - (padding * 2);
-    if (target_size < 1) target_size = 1;
-
-    double scale_w = (double)target_size / w;
-    double scale_h = (double)target_size / h;
-    double scale = (scale_w < scale_h) ? scale_w : scale_h;
-    
-    int new_w = (int)(w * scale);
-    int new_h = (int)(h * scale);
-    if (new_w < 1) new_w = 1; 
-    if (new_h < 1) new_h = 1;
-
-    int offset_x = (OUTPUT_SIZE - new_w) / 2;
-    int offset_y = (OUTPUT_SIZE - new_h) / 2;
-
-    // Paste resized image onto canvas
-    gdk_pixbuf_scale(extracted, canvas, offset_x, offset_y, new_w, new_h, offset_x, offset_y, scale, scale, GDK_INTERP_BILINEAR);
+    GdkPixbuf *canvas = normalize_glyph(source, x, y, w, h, padding);
+    if (!canvas) return;
 
     if (!gdk_pixbuf_save(canvas, filepath, "bmp", NULL, NULL)) {
         fprintf(stderr, "Error saving image: %s\n", filepath);
     }
     
     g_object_unref(canvas);
-    g_object_unref(extracted);
 }
 
 // -------------------------------------------------------------
@@ -154,7 +122,9 @@ static void detect_and_save_grid_cell(GdkPixbuf *source, Box cell, const char *f
     int rs = gdk_pixbuf_get_rowstride(sub);
     int nc = gdk_pixbuf_get_n_channels(sub);
 
-    bool *visited = (bool*)calloc(safe_w * safe_h, sizeof(bool));
+    Arena *arena = page_arena();
+    ArenaMark mark = arena_mark(arena);
+    bool *visited = (bool*)arena_calloc(arena, safe_w * safe_h, sizeof(bool));
     
     int best_area = 0;
     int best_min_x = 0, best_max_x = 0;
@@ -183,7 +153,7 @@ static void detect_and_save_grid_cell(GdkPixbuf *source, Box cell, const char *f
         }
     }
     
-    free(visited);
+    arena_rewind(arena, mark);
     g_object_unref(sub);
 
     if (found_something) {
@@ -210,9 +180,11 @@ static void segment_and_save_word(GdkPixbuf *source, Box word, const char *word_
     int rs = gdk_pixbuf_get_rowstride(sub);
     int nc = gdk_pixbuf_get_n_channels(sub);
 
-    bool *visited = (bool*)calloc(w * h, sizeof(bool));
+    Arena *arena = page_arena();
+    ArenaMark mark = arena_mark(arena);
+    bool *visited = (bool*)arena_calloc(arena, w * h, sizeof(bool));
     int capacity = 20;
-    Blob *blobs = (Blob*)malloc(capacity * sizeof(Blob));
+    Blob *blobs = (Blob*)arena_alloc(arena, capacity * sizeof(Blob));
     int count = 0;
 
     // Detect all blobs in the word box
@@ -227,8 +199,8 @@ static void segment_and_save_word(GdkPixbuf *source, Box word, const char *word_
                     
                     if (area >= MIN_BLOB_AREA) {
                         if (count >= capacity) { 
+                            blobs = (Blob*)arena_grow(arena, blobs, capacity * sizeof(Blob), capacity * 2 * sizeof(Blob)); 
                             capacity *= 2; 
-                            blobs = (Blob*)realloc(blobs, capacity * sizeof(Blob)); 
                         }
                         blobs[count].x = min_x; blobs[count].y = min_y;
                         blobs[count].width = (max_x - min_x) + 1; blobs[count].height = (max_y - min_y) + 1;
@@ -257,7 +229,8 @@ static void segment_and_save_word(GdkPixbuf *source, Box word, const char *word_
             }
 
             // ... (Histogram calculation for merged letter splitting if needed) ...
-            int *blob_histo = (int*)calloc(b.width, sizeof(int));
+            ArenaMark blob_mark = arena_mark(arena);
+            int *blob_histo = (int*)arena_calloc(arena, b.width, sizeof(int));
             for (int by = 0; by < b.height; by++) {
                 for (int bx = 0; bx < b.width; bx++) {
                     int gx = b.x + bx; int gy = b.y + by;
@@ -292,17 +265,20 @@ static void segment_and_save_word(GdkPixbuf *source, Box word, const char *word_
             snprintf(path, sizeof(path), "%s/letter_%d.bmp", word_folder, letter_idx++);
             save_subimage(source, word.x + b.x + current_x, word.y + b.y, b.width - current_x, b.height, path, UNIVERSAL_PADDING);
 
-            free(blob_histo);
+            arena_rewind(arena, blob_mark);
         }
     }
 
-    free(blobs);
-    free(visited);
+    arena_rewind(arena, mark);
     g_object_unref(sub);
 }
 
 void export_layout_to_files(GdkPixbuf *pixbuf, PageLayout *layout, const char *output_folder) {
     if (!layout) return;
+
+    // Every temporary of this page comes from the thread's arena
+    Arena *arena = page_arena();
+    ArenaMark page_mark = arena_mark(arena);
     
     char path[PATH_MAX];
     create_directory(output_folder);
@@ -330,4 +306,53 @@ void export_layout_to_files(GdkPixbuf *pixbuf, PageLayout *layout, const char *o
             segment_and_save_word(pixbuf, layout->words[i], path);
         }
     }
+
+    arena_rewind(arena, page_mark);
+}
+
+// -------------------------------------------------------------
+// MULTI-PUZZLE EXPORT (one region per worker)
+// -------------------------------------------------------------
+typedef struct {
+    GdkPixbuf *pixbuf;
+    PageLayout *layout;
+    char folder[PATH_MAX];
+} ExportJob;
+
+static void run_export_job(gpointer job_data, gpointer user_data) {
+    (void)user_data;
+    ExportJob *job = (ExportJob*)job_data;
+    export_layout_to_files(job->pixbuf, job->layout, job->folder);
+}
+
+void page_layout_folder(const char *output_folder, int index, int count, char *buffer, size_t size) {
+    if (count <= 1) snprintf(buffer, size, "%s", output_folder);
+    else snprintf(buffer, size, "%s/puzzle_%d", output_folder, index);
+}
+
+void export_page_layouts(GdkPixbuf *pixbuf, PageLayout **layouts, int count, const char *output_folder) {
+    if (!layouts || count <= 0) return;
+    create_directory(output_folder);
+
+    ExportJob *jobs = (ExportJob*)malloc(count * sizeof(ExportJob));
+    for (int i = 0; i < count; i++) {
+        jobs[i].pixbuf = pixbuf;
+        jobs[i].layout = layouts[i];
+        page_layout_folder(output_folder, i, count, jobs[i].folder, sizeof(jobs[i].folder));
+    }
+
+    // Regions only read the shared pixbuf and write to their own folder
+    int workers = (int)g_get_num_processors();
+    if (workers > count) workers = count;
+
+    if (workers <= 1) {
+        for (int i = 0; i < count; i++) run_export_job(&jobs[i], NULL);
+    } else {
+        GThreadPool *pool = g_thread_pool_new(run_export_job, NULL, workers, FALSE, NULL);
+        for (int i = 0; i < count; i++) g_thread_pool_push(pool, &jobs[i], NULL);
+        // Wait for every queued region before returning
+        g_thread_pool_free(pool, FALSE, TRUE);
+    }
+
+    free(jobs);
 }
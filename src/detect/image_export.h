@@ -10,4 +10,16 @@
  */
 void export_layout_to_files(GdkPixbuf *pixbuf, PageLayout *layout, const char *output_folder);
 
+/**
+ * Exports every layout of a multi-puzzle page, one region per worker thread.
+ * A single layout is exported directly into output_folder, otherwise each one
+ * goes to the folder given by page_layout_folder().
+ */
+void export_page_layouts(GdkPixbuf *pixbuf, PageLayout **layouts, int count, const char *output_folder);
+
+/**
+ * Builds the export folder of layout `index` out of `count`.
+ */
+void page_layout_folder(const char *output_folder, int index, int count, char *buffer, size_t size);
+
 #endif
@@ -18,6 +18,13 @@
 #define OUTPUT_DIR "output"
 #define MODEL_PATH "neuralnetwork/model3.bin"
 
+// Model given with --model, otherwise the embedded one (make EMBED_MODEL=1),
+// otherwise MODEL_PATH
+static const char *model_file = NULL;
+
+// Larger model for the glyphs model_file is unsure of (--cascade)
+static NNCascadeConfig cascade = { NULL, NN_CASCADE_DEFAULT_THRESHOLD };
+
 // --- FONCTION DE NETTOYAGE (RM -RF) ---
 void recursive_rmdir(const char *path) {
     DIR *d = opendir(path);
@@ -87,19 +94,21 @@ G_MODULE_EXPORT gboolean on_draw_event(GtkWidget *widget, cairo_t *cr, gpointer
         cairo_paint(cr);
 
         // Dessiner les solutions (traits verts)
-        if (data->layout && data->lines && data->line_count > 0) {
+        if (data->layouts && data->lines && data->line_count > 0) {
             cairo_set_source_rgba(cr, 0.0, 0.8, 0.0, 0.7);
             cairo_set_line_width(cr, 5.0);
             cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
 
             for (int i = 0; i < data->line_count; i++) {
-                FoundLine line = ((FoundLine*)data->lines)[i];
-                int idx_start = line.start_row * data->layout->cols + line.start_col;
-                int idx_end   = line.end_row * data->layout->cols + line.end_col;
-
-                if (idx_start < data->layout->rows * data->layout->cols && idx_end < data->layout->rows * data->layout->cols) {
-                    Box b1 = data->layout->grid_cells[idx_start];
-                    Box b2 = data->layout->grid_cells[idx_end];
+                FoundLine line = data->lines[i];
+                if (line.region < 0 || line.region >= data->layout_count) continue;
+                PageLayout *layout = data->layouts[line.region];
+                int idx_start = line.start_row * layout->cols + line.start_col;
+                int idx_end   = line.end_row * layout->cols + line.end_col;
+
+                if (idx_start < layout->rows * layout->cols && idx_end < layout->rows * layout->cols) {
+                    Box b1 = layout->grid_cells[idx_start];
+                    Box b2 = layout->grid_cells[idx_end];
                     cairo_move_to(cr, b1.x + b1.width / 2.0, b1.y + b1.height / 2.0);
                     cairo_line_to(cr, b2.x + b2.width / 2.0, b2.y + b2.height / 2.0);
                     cairo_stroke(cr);
@@ -123,7 +132,8 @@ G_MODULE_EXPORT gboolean on_draw_event(GtkWidget *widget, cairo_t *cr, gpointer
 void clear_solution_data(struct PreProcessData *data) {
     if (data->lines) { free(data->lines); data->lines = NULL; }
     data->line_count = 0;
-    if (data->layout) { free_page_layout(data->layout); data->layout = NULL; }
+    if (data->layouts) { free_page_layouts(data->layouts, data->layout_count); data->layouts = NULL; }
+    data->layout_count = 0;
 }
 
 // ============================================================
@@ -170,37 +180,39 @@ gboolean run_step3_extract(struct PreProcessData *data) {
 
     GdkPixbuf *final_pixbuf = ensure_rgb_no_alpha(data->processed_pixbuf);
     
-    // Détection
-    data->layout = detect_layout_from_pixbuf(final_pixbuf);
-
-    if (data->layout) {
-        // --- BLOC DE REPORTING AJOUTÉ ICI ---
-        g_print("\n  === LAYOUT REPORT ===\n");
-        g_print("  [GRID]\n");
-        g_print("    Dimensions : %d cols x %d rows\n", data->layout->cols, data->layout->rows);
-        g_print("    Position   : x=%d, y=%d (size: %dx%d)\n", 
-                data->layout->grid_x, data->layout->grid_y, 
-                data->layout->grid_width, data->layout->grid_height);
-
-        g_print("  [WORD LIST]\n");
-        if (data->layout->has_wordlist) {
-            g_print("    Detected   : %d words blocks\n", data->layout->word_count);
-            g_print("    Position   : x=%d (width: %d)\n", data->layout->list_x, data->layout->list_width);
-            
-            // Affichage détaillé de chaque bloc de mot trouvé
-            for (int i = 0; i < data->layout->word_count; i++) {
-                Box w = data->layout->words[i];
-                g_print("    -> Word %02d : y=%-4d | h=%-3d | w=%-3d px\n", 
-                        i, w.y, w.height, w.width);
+    // Détection (XY-Cut : une ou plusieurs grilles par page)
+    data->layouts = detect_page_layouts(final_pixbuf, &data->layout_count);
+
+    if (data->layouts) {
+        g_print("\n  === LAYOUT REPORT (%d puzzle%s) ===\n", data->layout_count, data->layout_count > 1 ? "s" : "");
+        for (int p = 0; p < data->layout_count; p++) {
+            PageLayout *layout = data->layouts[p];
+            if (data->layout_count > 1) g_print("  --- Puzzle %d ---\n", p);
+            g_print("  [GRID]\n");
+            g_print("    Dimensions : %d cols x %d rows\n", layout->cols, layout->rows);
+            g_print("    Position   : x=%d, y=%d (size: %dx%d)\n", 
+                    layout->grid_x, layout->grid_y, 
+                    layout->grid_width, layout->grid_height);
+
+            g_print("  [WORD LIST]\n");
+            if (layout->has_wordlist) {
+                g_print("    Detected   : %d words blocks\n", layout->word_count);
+                g_print("    Position   : x=%d (width: %d)\n", layout->list_x, layout->list_width);
+                
+                // Affichage détaillé de chaque bloc de mot trouvé
+                for (int i = 0; i < layout->word_count; i++) {
+                    Box w = layout->words[i];
+                    g_print("    -> Word %02d : y=%-4d | h=%-3d | w=%-3d px\n", 
+                            i, w.y, w.height, w.width);
+                }
+            } else {
+                g_print("    Status     : Not detected (or merged with grid).\n");
             }
-        } else {
-            g_print("    Status     : Not detected (or merged with grid).\n");
         }
         g_print("  =====================\n\n");
-        // ------------------------------------
 
         g_print("  > Exporting images to '%s'...\n", OUTPUT_DIR);
-        export_layout_to_files(final_pixbuf, data->layout, OUTPUT_DIR);
+        export_page_layouts(final_pixbuf, data->layouts, data->layout_count, OUTPUT_DIR);
         
         g_print("| [3] DONE.\n");
         g_object_unref(final_pixbuf);
@@ -212,23 +224,50 @@ gboolean run_step3_extract(struct PreProcessData *data) {
     }
 }
 
-gboolean run_step4_neural(void) {
+gboolean run_step4_neural(struct PreProcessData *data) {
     g_print("\n--- [4] NEURAL NET ---\n");
     struct stat st = {0};
-    if (stat(OUTPUT_DIR, &st) == -1) return FALSE;
-    int res = nn_run_recognition(OUTPUT_DIR, MODEL_PATH);
+    if (stat(OUTPUT_DIR, &st) == -1 || data->layout_count <= 0) return FALSE;
+
+    // Toutes les grilles de la page en une seule passe (modèle chargé une fois)
+    char **folders = malloc(data->layout_count * sizeof(char*));
+    for (int i = 0; i < data->layout_count; i++) {
+        folders[i] = malloc(1024);
+        page_layout_folder(OUTPUT_DIR, i, data->layout_count, folders[i], 1024);
+    }
+    int res = nn_run_recognition_cascade((const char *const *)folders, data->layout_count, model_file, &cascade, NULL);
+    for (int i = 0; i < data->layout_count; i++) free(folders[i]);
+    free(folders);
     return (res == 0);
 }
 
 gboolean run_step5_solve(struct PreProcessData *data) {
     g_print("\n--- [5] SOLVER ---\n");
-    char grid_path[1024], words_path[1024];
-    snprintf(grid_path, 1024, "%s/grid.txt", OUTPUT_DIR);
-    snprintf(words_path, 1024, "%s/words.txt", OUTPUT_DIR);
+    if (data->lines) { free(data->lines); data->lines = NULL; }
+    data->line_count = 0;
 
-    int res = solve_puzzle(grid_path, words_path, (FoundLine**)&data->lines, &data->line_count);
+    int solved = 0;
+    for (int p = 0; p < data->layout_count; p++) {
+        char folder[1024], grid_path[1100], words_path[1100];
+        page_layout_folder(OUTPUT_DIR, p, data->layout_count, folder, sizeof(folder));
+        snprintf(grid_path, sizeof(grid_path), "%s/grid.txt", folder);
+        snprintf(words_path, sizeof(words_path), "%s/words.txt", folder);
+
+        FoundLine *lines = NULL;
+        int count = 0;
+        if (solve_puzzle(grid_path, words_path, &lines, &count) != 0) continue;
+        solved++;
+
+        // Ajout des traits de cette grille à la liste globale
+        data->lines = realloc(data->lines, (data->line_count + count + 1) * sizeof(FoundLine));
+        for (int i = 0; i < count; i++) {
+            lines[i].region = p;
+            data->lines[data->line_count++] = lines[i];
+        }
+        free(lines);
+    }
     
-    if (res == 0) {
+    if (solved > 0) {
         g_print("| [5] DONE. Found %d words.\n", data->line_count);
         gtk_widget_queue_draw(data->drawing_area);
         return TRUE;
@@ -300,8 +339,8 @@ G_MODULE_EXPORT void on_btn_export_clicked(GtkButton *b, gpointer d) {
 }
 
 G_MODULE_EXPORT void on_btn_neural_clicked(GtkButton *b, gpointer d) {
-    (void)b; (void)d;
-    if(run_step4_neural()) {
+    (void)b;
+    if(run_step4_neural((struct PreProcessData*)d)) {
         GtkWidget *m = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_INFO, GTK_BUTTONS_OK, "Step 4 Complete!");
         gtk_dialog_run(GTK_DIALOG(m)); gtk_widget_destroy(m);
     }
@@ -327,7 +366,7 @@ G_MODULE_EXPORT void on_btn_run_all_clicked(GtkButton *b, gpointer user_data) {
     if(!run_step3_extract(data)) return;
     while (gtk_events_pending()) gtk_main_iteration();
     
-    if(!run_step4_neural()) return;
+    if(!run_step4_neural(data)) return;
     while (gtk_events_pending()) gtk_main_iteration();
     
     if(!run_step5_solve(data)) return;
@@ -355,6 +394,25 @@ int main(int argc, char *argv[]) {
     GError *error = NULL;
     gtk_init(&argc, &argv);
 
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+            model_file = argv[++i];
+        } else if (strcmp(argv[i], "--cascade") == 0 && i + 1 < argc) {
+            cascade.model_file = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            cascade.threshold = atof(argv[++i]);
+            if (cascade.threshold <= 0.0 || cascade.threshold > 1.0) {
+                fprintf(stderr, "Error: --threshold must be in (0, 1]\n");
+                fprintf(stderr, "Usage: %s [--model <model_file.bin>] [--cascade <large_model.bin> [--threshold P]]\n", argv[0]);
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "Usage: %s [--model <model_file.bin>] [--cascade <large_model.bin> [--threshold P]]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (!model_file && !nn_has_embedded_model()) model_file = MODEL_PATH;
+
     struct PreProcessData *data = g_slice_new0(struct PreProcessData);
     
     builder = gtk_builder_new();
@@ -0,0 +1,313 @@
+#include "glyph_generator.h"
+#include <pango/pangocairo.h>
+#include <glib.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Glyphs rendered by one job, on one cairo surface and pango layout
+#define GENERATE_CHUNK 256
+
+// r + g + b below it is ink, as for the blobs of the letter detection
+#define INK_THRESHOLD 400
+
+// Label of a glyph that came out blank, dropped at the end
+#define NO_GLYPH 255
+
+static const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+// Families that cover A-Z with pictures instead of letters
+static const char *const SKIPPED_FAMILIES[] = { "Symbol", "Dingbat", "Emoji", "Wingding", "Webding", NULL };
+
+void glyph_gen_config_default(GlyphGenConfig *config) {
+    config->count = 0;
+    config->min_size = 16.0;
+    config->max_size = 64.0;
+    config->min_weight = 300;
+    config->max_weight = 900;
+    config->offset = 0.15;
+    config->fonts = NULL;
+    config->threads = 0;
+    config->seed = 0;
+}
+
+// splitmix64: every glyph draws from its own key, no shared generator state
+static uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Uniform in [0, 1)
+static double random_unit(uint64_t *state) {
+    return (double)(next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static gboolean wanted_family(const char *name, gchar **wanted) {
+    if (!wanted) {
+        for (int i = 0; SKIPPED_FAMILIES[i]; i++) {
+            if (strstr(name, SKIPPED_FAMILIES[i])) return FALSE;
+        }
+        return TRUE;
+    }
+    for (int i = 0; wanted[i]; i++) {
+        if (g_ascii_strcasecmp(g_strstrip(wanted[i]), name) == 0) return TRUE;
+    }
+    return FALSE;
+}
+
+static gint compare_names(gconstpointer a, gconstpointer b) {
+    return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+// Installed families (the wanted ones if `fonts` names some) that draw all
+// of A-Z themselves, sorted by name so a seed gives the same glyphs
+// whatever order fontconfig lists them in. NULL-terminated.
+static gchar **usable_families(const char *fonts, int *count) {
+    PangoFontFamily **families;
+    int family_count;
+    pango_font_map_list_families(pango_cairo_font_map_get_default(), &families, &family_count);
+    gchar **wanted = fonts ? g_strsplit(fonts, ",", -1) : NULL;
+
+    // Without fallback, a letter the family lacks shows as an unknown glyph
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, 1, 1);
+    cairo_t *cr = cairo_create(surface);
+    PangoLayout *layout = pango_cairo_create_layout(cr);
+    PangoAttrList *attrs = pango_attr_list_new();
+    pango_attr_list_insert(attrs, pango_attr_fallback_new(FALSE));
+    pango_layout_set_attributes(layout, attrs);
+    pango_layout_set_text(layout, ALPHABET, -1);
+    PangoFontDescription *desc = pango_font_description_new();
+    pango_font_description_set_absolute_size(desc, 32 * PANGO_SCALE);
+
+    GPtrArray *names = g_ptr_array_new();
+    for (int i = 0; i < family_count; i++) {
+        const char *name = pango_font_family_get_name(families[i]);
+        if (!wanted_family(name, wanted)) continue;
+
+        pango_font_description_set_family(desc, name);
+        pango_layout_set_font_description(layout, desc);
+        if (pango_layout_get_unknown_glyphs_count(layout) == 0) {
+            g_ptr_array_add(names, g_strdup(name));
+        } else if (wanted) {
+            fprintf(stderr, "Warning: Font '%s' lacks some of A-Z, skipped\n", name);
+        }
+    }
+    g_ptr_array_sort(names, compare_names);
+    *count = (int)names->len;
+    g_ptr_array_add(names, NULL);
+
+    pango_font_description_free(desc);
+    pango_attr_list_unref(attrs);
+    g_object_unref(layout);
+    cairo_destroy(cr);
+    cairo_surface_destroy(surface);
+    g_strfreev(wanted);
+    g_free(families);
+    return (gchar**)g_ptr_array_free(names, FALSE);
+}
+
+typedef struct Generation Generation;
+
+typedef struct {
+    Generation *gen;
+    int start;
+    int end;
+} GenerateJob;
+
+struct Generation {
+    const GlyphGenConfig *config;
+    gchar **families;
+    int family_count;
+    uint64_t *glyphs;           // Slot i: glyph i, GLYPH_WORDS words
+    uint8_t *labels;            // NO_GLYPH where nothing was drawn
+    GMutex lock;
+    GCond done;
+    int pending;
+};
+
+// Renders glyphs [start, end) into their slots. The surface leaves half
+// the largest size of white around the letter: the crop margins and the
+// ink of wide letters stay inside it.
+static void generate_chunk(Generation *gen, int start, int end) {
+    const GlyphGenConfig *config = gen->config;
+    const int side = (int)ceil(config->max_size * 2.0) + 4;
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, side, side);
+    cairo_t *cr = cairo_create(surface);
+    PangoLayout *layout = pango_cairo_create_layout(cr);
+    PangoFontDescription *desc = pango_font_description_new();
+    GdkPixbuf *pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, side, side);
+    const int stride = cairo_image_surface_get_stride(surface);
+    const int rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    guchar *rgb = gdk_pixbuf_get_pixels(pixbuf);
+    double pixels[PIXEL_COUNT];
+
+    for (int i = start; i < end; i++) {
+        uint64_t state = ((uint64_t)config->seed << 32) ^ (uint64_t)i;
+        next_random(&state);
+        const int label = i % 26;
+        const char letter[2] = { ALPHABET[label], '\0' };
+        const char *family = gen->families[next_random(&state) % (uint64_t)gen->family_count];
+        const double size = config->min_size + random_unit(&state) * (config->max_size - config->min_size);
+        const int weight = config->min_weight + (int)(next_random(&state) % (uint64_t)(config->max_weight - config->min_weight + 1));
+        const double dx = random_unit(&state), dy = random_unit(&state);
+
+        pango_font_description_set_family(desc, family);
+        pango_font_description_set_weight(desc, (PangoWeight)weight);
+        pango_font_description_set_absolute_size(desc, size * PANGO_SCALE);
+        pango_layout_set_font_description(layout, desc);
+        pango_layout_set_text(layout, letter, 1);
+
+        // Black letter centred on white, at a sub-pixel offset
+        PangoRectangle ink, logical;
+        pango_layout_get_pixel_extents(layout, &ink, &logical);
+        const int ox = (side - logical.width) / 2, oy = (side - logical.height) / 2;
+        cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+        cairo_paint(cr);
+        cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
+        cairo_move_to(cr, ox + dx, oy + dy);
+        pango_cairo_show_layout(cr, layout);
+        cairo_surface_flush(surface);
+
+        // Bounding box of the ink as the detection sees it, searched around
+        // pango's (hinting can move the ink by a pixel)
+        const guchar *data = cairo_image_surface_get_data(surface);
+        int x0 = MAX(ox + ink.x - 2, 0), x1 = MIN(ox + ink.x + ink.width + 3, side);
+        int y0 = MAX(oy + ink.y - 2, 0), y1 = MIN(oy + ink.y + ink.height + 3, side);
+        int min_x = side, max_x = -1, min_y = side, max_y = -1;
+        for (int y = y0; y < y1; y++) {
+            const uint32_t *row = (const uint32_t*)(data + (size_t)y * stride);
+            for (int x = x0; x < x1; x++) {
+                uint32_t p = row[x];
+                if (((p >> 16) & 0xFF) + ((p >> 8) & 0xFF) + (p & 0xFF) >= INK_THRESHOLD) continue;
+                if (x < min_x) min_x = x;
+                if (x > max_x) max_x = x;
+                if (y < min_y) min_y = y;
+                if (y > max_y) max_y = y;
+            }
+        }
+
+        if (max_x < 0) {
+            gen->labels[i] = NO_GLYPH;
+            continue;
+        }
+
+        // The detection's boxes never cut into a letter but can be loose:
+        // each side gets its own extra margin, which also moves the letter
+        // off the centre of the normalized glyph
+        const double margin = config->offset * MAX(max_x - min_x + 1, max_y - min_y + 1);
+        int left = min_x - (int)lround(random_unit(&state) * margin);
+        int top = min_y - (int)lround(random_unit(&state) * margin);
+        int right = max_x + 1 + (int)lround(random_unit(&state) * margin);
+        int bottom = max_y + 1 + (int)lround(random_unit(&state) * margin);
+        left = MAX(left, 0);
+        top = MAX(top, 0);
+        right = MIN(right, side);
+        bottom = MIN(bottom, side);
+
+        // Only the crop goes to the pixbuf, normalize_glyph reads nothing else
+        for (int y = top; y < bottom; y++) {
+            const uint32_t *row = (const uint32_t*)(data + (size_t)y * stride);
+            guchar *out = rgb + (size_t)y * rowstride;
+            for (int x = left; x < right; x++) {
+                out[3 * x] = (guchar)(row[x] >> 16);
+                out[3 * x + 1] = (guchar)(row[x] >> 8);
+                out[3 * x + 2] = (guchar)row[x];
+            }
+        }
+
+        GdkPixbuf *canvas = normalize_glyph(pixbuf, left, top, right - left, bottom - top, GLYPH_PADDING);
+        pixbuf_to_pixels(canvas, pixels);
+        g_object_unref(canvas);
+        pack_input(pixels, PIXEL_COUNT, gen->glyphs + (size_t)i * GLYPH_WORDS);
+        gen->labels[i] = (uint8_t)label;
+    }
+
+    g_object_unref(pixbuf);
+    pango_font_description_free(desc);
+    g_object_unref(layout);
+    cairo_destroy(cr);
+    cairo_surface_destroy(surface);
+}
+
+// Every thread renders with its own pango font map (pango_cairo_font_map_get_default
+// is per thread), so the jobs share nothing but their slots
+static void generate_job(gpointer data, gpointer user_data) {
+    (void)user_data;
+    GenerateJob *job = data;
+    Generation *gen = job->gen;
+    generate_chunk(gen, job->start, job->end);
+
+    g_mutex_lock(&gen->lock);
+    if (--gen->pending == 0) g_cond_signal(&gen->done);
+    g_mutex_unlock(&gen->lock);
+}
+
+int generate_glyphs(const GlyphGenConfig *config, GlyphSet *set) {
+    if (config->count <= 0) return 0;
+
+    Generation gen = { .config = config };
+    gen.families = usable_families(config->fonts, &gen.family_count);
+    if (gen.family_count == 0) {
+        fprintf(stderr, "Error: No installed font draws the letters A to Z%s\n", config->fonts ? " (see --fonts)" : "");
+        g_strfreev(gen.families);
+        return -1;
+    }
+
+    printf("Rendering %d glyphs from %d font families...\n", config->count, gen.family_count);
+    gint64 started = g_get_monotonic_time();
+
+    // Rendered straight into the set, blank glyphs are squeezed out after
+    const int first = set->count;
+    glyph_set_reserve(set, first + config->count);
+    gen.glyphs = set->glyphs + (size_t)first * GLYPH_WORDS;
+    gen.labels = set->labels + first;
+
+    int jobs = (config->count + GENERATE_CHUNK - 1) / GENERATE_CHUNK;
+    int threads = config->threads > 0 ? config->threads : (int)g_get_num_processors();
+    if (threads > jobs) threads = jobs;
+    if (threads > 1) {
+        GenerateJob *queue = malloc((size_t)jobs * sizeof(GenerateJob));
+        g_mutex_init(&gen.lock);
+        g_cond_init(&gen.done);
+        gen.pending = jobs;
+        GThreadPool *pool = g_thread_pool_new(generate_job, NULL, threads, FALSE, NULL);
+        for (int j = 0; j < jobs; j++) {
+            queue[j].gen = &gen;
+            queue[j].start = j * GENERATE_CHUNK;
+            queue[j].end = MIN((j + 1) * GENERATE_CHUNK, config->count);
+            g_thread_pool_push(pool, &queue[j], NULL);
+        }
+
+        g_mutex_lock(&gen.lock);
+        while (gen.pending > 0) g_cond_wait(&gen.done, &gen.lock);
+        g_mutex_unlock(&gen.lock);
+        g_thread_pool_free(pool, FALSE, TRUE);
+        g_mutex_clear(&gen.lock);
+        g_cond_clear(&gen.done);
+        free(queue);
+    } else {
+        generate_chunk(&gen, 0, config->count);
+    }
+
+    int added = 0;
+    for (int i = 0; i < config->count; i++) {
+        if (gen.labels[i] == NO_GLYPH) continue;
+        if (added != i) {
+            memcpy(gen.glyphs + (size_t)added * GLYPH_WORDS, gen.glyphs + (size_t)i * GLYPH_WORDS, GLYPH_WORDS * sizeof(uint64_t));
+            gen.labels[added] = gen.labels[i];
+        }
+        added++;
+    }
+    set->count = first + added;
+
+    double seconds = (g_get_monotonic_time() - started) / 1e6;
+    printf("Rendered %d glyphs in %.2fs (%.0f per second)", added, seconds, seconds > 0 ? added / seconds : 0.0);
+    if (added < config->count) printf(", %d blank ones dropped", config->count - added);
+    printf("\n");
+
+    g_strfreev(gen.families);
+    return added;
+}
@@ -0,0 +1,30 @@
+#ifndef GLYPH_GENERATOR_H
+#define GLYPH_GENERATOR_H
+
+#include "image_loader.h"
+
+// Synthetic training glyphs: uppercase letters rendered with pango from
+// the installed fonts, then cropped and normalized like the letters the
+// detection exports (normalize_glyph)
+typedef struct {
+    int count;
+    double min_size;        // Font size range, pixels
+    double max_size;
+    int min_weight;         // Pango weight range, 100 (thin) to 1000 (ultra heavy)
+    int max_weight;
+    double offset;          // Max extra margin on each side of the crop, share of the letter's larger side
+    const char *fonts;      // Comma-separated families to draw from, NULL = every installed one with A-Z
+    int threads;            // Rendering threads, 0 = one per core
+    unsigned int seed;
+} GlyphGenConfig;
+
+// 16 to 64 pixels, light to heavy, up to 15% of extra margin
+void glyph_gen_config_default(GlyphGenConfig *config);
+
+// Renders config->count glyphs (letters A to Z in turn) and appends them
+// to set. Glyph i only depends on the seed, i and the fonts installed.
+// Returns the number added (a font drawing no ink for a letter loses that
+// glyph), -1 if no font can draw A to Z.
+int generate_glyphs(const GlyphGenConfig *config, GlyphSet *set);
+
+#endif
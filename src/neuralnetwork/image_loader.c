@@ -2,7 +2,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <glib.h>
+#include <glib/gstdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 double* load_and_convert_image(const char *filepath) {
     GError *error = NULL;
@@ -24,30 +30,9 @@ double* load_and_convert_image(const char *filepath) {
         return NULL;
     }
 
-    // Get image data
-    int n_channels = gdk_pixbuf_get_n_channels(scaled);
-    int rowstride = gdk_pixbuf_get_rowstride(scaled);
-    guchar *pixels_data = gdk_pixbuf_get_pixels(scaled);
-
     // Convert to an array of doubles
     double *pixels = malloc(PIXEL_COUNT * sizeof(double));
-    
-    for (int y = 0; y < IMAGE_SIZE; y++) {
-        for (int x = 0; x < IMAGE_SIZE; x++) {
-            guchar *pixel = pixels_data + y * rowstride + x * n_channels;
-            
-            // Compute luminosity
-            int luminance;
-            if (n_channels >= 3) {
-                luminance = (pixel[0] + pixel[1] + pixel[2]) / 3;
-            } else {
-                luminance = pixel[0];
-            }
-            
-            // 128 threshold: darker pixels = 1, lighter pixels = 0
-            pixels[y * IMAGE_SIZE + x] = luminance < 128 ? 1.0 : 0.0;
-        }
-    }
+    pixbuf_to_pixels(scaled, pixels);
 
     g_object_unref(scaled);
     return pixels;
@@ -64,7 +49,423 @@ static gboolean is_valid_image(const char *filename) {
             strcmp(ext, ".jpg") == 0);
 }
 
-int load_images_from_folder(const char *folder_path, int label, ImageData **images, int *current_count, int max_images) {
+// Parallel decoding: load_and_convert_image() of a list of files runs on a
+// shared pool of worker threads. Every file has its own result slot, so
+// callers see the files in the order they gave them whatever order the
+// workers finish in, and can queue the next folder before waiting.
+typedef struct DecodeBatch DecodeBatch;
+
+typedef struct {
+    DecodeBatch *batch;
+    int index;
+} DecodeJob;
+
+struct DecodeBatch {
+    GMutex lock;
+    GCond done;
+    int pending;
+    int count;
+    gchar **paths;          // NULL-terminated, owned by the batch
+    double **pixels;        // Slot i: decoded paths[i], NULL if it failed to load
+    DecodeJob *jobs;
+};
+
+static void decode_job(gpointer data, gpointer user_data) {
+    (void)user_data;
+    DecodeJob *job = (DecodeJob*)data;
+    DecodeBatch *batch = job->batch;
+    double *pixels = load_and_convert_image(batch->paths[job->index]);
+
+    g_mutex_lock(&batch->lock);
+    batch->pixels[job->index] = pixels;
+    if (--batch->pending == 0) g_cond_signal(&batch->done);
+    g_mutex_unlock(&batch->lock);
+}
+
+// One worker per core, started on first use and kept for the whole process.
+// NULL on a single core: batches are then decoded by the caller.
+static GThreadPool *decode_pool(void) {
+    static gsize initialized = 0;
+    static GThreadPool *pool = NULL;
+
+    if (g_once_init_enter(&initialized)) {
+        int threads = (int)g_get_num_processors();
+        if (threads > 1) pool = g_thread_pool_new(decode_job, NULL, threads, FALSE, NULL);
+        g_once_init_leave(&initialized, 1);
+    }
+    return pool;
+}
+
+// Queues the decoding of every file of `paths` (a NULL-terminated array the
+// batch takes over) and returns at once
+static DecodeBatch *decode_batch_start(gchar **paths) {
+    DecodeBatch *batch = g_new0(DecodeBatch, 1);
+    g_mutex_init(&batch->lock);
+    g_cond_init(&batch->done);
+    batch->count = (int)g_strv_length(paths);
+    batch->paths = paths;
+    batch->pixels = calloc(batch->count ? batch->count : 1, sizeof(double*));
+    batch->jobs = malloc((batch->count ? batch->count : 1) * sizeof(DecodeJob));
+
+    GThreadPool *pool = decode_pool();
+    batch->pending = pool ? batch->count : 0;
+    for (int i = 0; i < batch->count; i++) {
+        if (pool) {
+            batch->jobs[i].batch = batch;
+            batch->jobs[i].index = i;
+            g_thread_pool_push(pool, &batch->jobs[i], NULL);
+        } else {
+            batch->pixels[i] = load_and_convert_image(paths[i]);
+        }
+    }
+    return batch;
+}
+
+// Waits for the whole batch and frees it. Returns its slots: count decoded
+// images (or NULL) the caller frees, along with the array itself.
+static double **decode_batch_finish(DecodeBatch *batch, int *count) {
+    g_mutex_lock(&batch->lock);
+    while (batch->pending > 0) g_cond_wait(&batch->done, &batch->lock);
+    g_mutex_unlock(&batch->lock);
+
+    double **pixels = batch->pixels;
+    *count = batch->count;
+    g_strfreev(batch->paths);
+    free(batch->jobs);
+    g_mutex_clear(&batch->lock);
+    g_cond_clear(&batch->done);
+    g_free(batch);
+    return pixels;
+}
+
+// NULL-terminated copy of paths that decode_batch_start() can take over
+static gchar **steal_paths(GPtrArray *paths) {
+    g_ptr_array_add(paths, NULL);
+    return (gchar**)g_ptr_array_free(paths, FALSE);
+}
+
+void glyph_set_reserve(GlyphSet *set, int capacity) {
+    if (capacity <= set->capacity) return;
+    int grown = set->capacity ? set->capacity * 2 : 1024;
+    if (grown < capacity) grown = capacity;
+
+    set->glyphs = realloc(set->glyphs, (size_t)grown * GLYPH_WORDS * sizeof(uint64_t));
+    set->labels = realloc(set->labels, (size_t)grown);
+    set->capacity = grown;
+}
+
+void glyph_set_add(GlyphSet *set, const double *pixels, int label) {
+    glyph_set_reserve(set, set->count + 1);
+    pack_input(pixels, PIXEL_COUNT, set->glyphs + (size_t)set->count * GLYPH_WORDS);
+    set->labels[set->count++] = (uint8_t)label;
+}
+
+const uint64_t *glyph_set_glyph(const GlyphSet *set, int index) {
+    return set->glyphs + (size_t)index * GLYPH_WORDS;
+}
+
+// Packed dataset file (`ocr_trainer pack`): header, one label byte per
+// glyph, then the glyphs bit-packed like pack_input(), each section on a
+// 64-byte boundary so the file can be mapped and read in place
+static const char DATASET_PACK_MAGIC[4] = { 'O', 'C', 'R', 'D' };
+#define DATASET_PACK_VERSION 2     // 1: source_hash over the image bytes
+
+// Glyphs of `ocr_trainer generate`: loaded whole, max_per_letter only
+// samples image folders
+#define DATASET_PACK_GENERATED 0x1
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t image_size;
+    uint32_t words;             // 64-bit words per glyph
+    uint32_t flags;
+    uint64_t source_hash;       // hash_dataset_manifest() of the folder it was built from
+    uint64_t labels_offset;
+    uint64_t glyphs_offset;
+    uint8_t reserved[16];
+} DatasetPackHeader;
+
+typedef struct {
+    gchar *path;
+    gchar *relative;            // "<letter folder>/<file>", part of the manifest
+    int label;
+} DatasetFile;
+
+static void free_dataset_file(gpointer data) {
+    DatasetFile *file = data;
+    g_free(file->path);
+    g_free(file->relative);
+    g_free(file);
+}
+
+static gint compare_dataset_files(gconstpointer a, gconstpointer b) {
+    const DatasetFile *fa = *(DatasetFile * const *)a;
+    const DatasetFile *fb = *(DatasetFile * const *)b;
+    return strcmp(fa->relative, fb->relative);
+}
+
+// Label of a letter folder from its first character, -1 if none
+static int folder_label(const char *name) {
+    if (name[0] >= 'A' && name[0] <= 'Z') return name[0] - 'A';
+    if (name[0] >= 'a' && name[0] <= 'z') return name[0] - 'a';
+    return -1;
+}
+
+// Every image of the dataset, sorted by relative path so the hash doesn't
+// depend on the directory order
+static GPtrArray* list_dataset_files(const char *root_path) {
+    GDir *dir = g_dir_open(root_path, 0, NULL);
+    if (!dir) return NULL;
+
+    GPtrArray *files = g_ptr_array_new_with_free_func(free_dataset_file);
+    const gchar *entry_name;
+    while ((entry_name = g_dir_read_name(dir)) != NULL) {
+        int label = folder_label(entry_name);
+        if (entry_name[0] == '.' || label < 0) continue;
+
+        gchar *letter_path = g_build_filename(root_path, entry_name, NULL);
+        GDir *letter_dir = g_dir_open(letter_path, 0, NULL);
+        if (letter_dir) {
+            const gchar *filename;
+            while ((filename = g_dir_read_name(letter_dir)) != NULL) {
+                if (!is_valid_image(filename)) continue;
+                DatasetFile *file = g_new(DatasetFile, 1);
+                file->path = g_build_filename(letter_path, filename, NULL);
+                file->relative = g_strconcat(entry_name, "/", filename, NULL);
+                file->label = label;
+                g_ptr_array_add(files, file);
+            }
+            g_dir_close(letter_dir);
+        }
+        g_free(letter_path);
+    }
+    g_dir_close(dir);
+
+    g_ptr_array_sort(files, compare_dataset_files);
+    return files;
+}
+
+static guint64 fnv1a64(guint64 hash, const void *data, gsize size) {
+    const guchar *bytes = data;
+    for (gsize i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// FNV-1a over the manifest of the images, the relative path, size and
+// modification time (ns) of each: any added, removed, renamed or rewritten
+// image makes the pack stale. One stat() per file, the images aren't read.
+static guint64 hash_dataset_manifest(GPtrArray *files) {
+    guint64 hash = 0xcbf29ce484222325ULL;
+    for (guint i = 0; i < files->len; i++) {
+        const DatasetFile *file = g_ptr_array_index(files, i);
+        struct stat st;
+        int64_t entry[3] = { -1, -1, -1 };
+        if (stat(file->path, &st) == 0) {
+            entry[0] = (int64_t)st.st_size;
+            entry[1] = (int64_t)st.st_mtim.tv_sec;
+            entry[2] = (int64_t)st.st_mtim.tv_nsec;
+        }
+        hash = fnv1a64(hash, file->relative, strlen(file->relative) + 1);
+        hash = fnv1a64(hash, entry, sizeof(entry));
+    }
+    return hash;
+}
+
+// Writes the glyphs of `set` to root_path/DATASET_PACK_NAME, stamped with
+// source_hash. Returns the number of glyphs written, 0 on error.
+static int write_dataset_pack(const char *root_path, const GlyphSet *set, guint64 source_hash, uint32_t flags) {
+    const size_t words = GLYPH_WORDS;
+    const uint32_t count = (uint32_t)set->count;
+    DatasetPackHeader header = { 0 };
+    memcpy(header.magic, DATASET_PACK_MAGIC, sizeof(header.magic));
+    header.version = DATASET_PACK_VERSION;
+    header.count = count;
+    header.image_size = IMAGE_SIZE;
+    header.words = (uint32_t)words;
+    header.flags = flags;
+    header.source_hash = source_hash;
+    header.labels_offset = sizeof(DatasetPackHeader);
+    header.glyphs_offset = (header.labels_offset + count + 63) / 64 * 64;
+    static const char padding[64] = { 0 };
+
+    // Written next to the final name and renamed, a reader never sees half a pack
+    gchar *pack_path = g_build_filename(root_path, DATASET_PACK_NAME, NULL);
+    gchar *tmp_path = g_strconcat(pack_path, ".tmp", NULL);
+    FILE *out = fopen(tmp_path, "wb");
+    int ok = out != NULL;
+    if (ok) {
+        fwrite(&header, sizeof(header), 1, out);
+        fwrite(set->labels, 1, count, out);
+        fwrite(padding, 1, header.glyphs_offset - header.labels_offset - count, out);
+        fwrite(set->glyphs, sizeof(uint64_t), (size_t)count * words, out);
+        ok = !ferror(out);
+        ok = (fclose(out) == 0) && ok;
+    }
+    if (ok) ok = g_rename(tmp_path, pack_path) == 0;
+    if (ok) {
+        printf("Packed %u glyphs into '%s' (%zu KB)\n", count, pack_path,
+               (size_t)(header.glyphs_offset + (size_t)count * words * sizeof(uint64_t)) / 1024);
+    } else {
+        fprintf(stderr, "Error: Cannot write '%s'\n", pack_path);
+        g_remove(tmp_path);
+    }
+
+    g_free(tmp_path);
+    g_free(pack_path);
+    return ok ? (int)count : 0;
+}
+
+#define PACK_CHUNK 2048
+
+static DecodeBatch *start_pack_chunk(GPtrArray *files, guint start) {
+    GPtrArray *paths = g_ptr_array_new();
+    for (guint i = start; i < files->len && i < start + PACK_CHUNK; i++) {
+        const DatasetFile *file = g_ptr_array_index(files, i);
+        g_ptr_array_add(paths, g_strdup(file->path));
+    }
+    return decode_batch_start(steal_paths(paths));
+}
+
+int pack_dataset(const char *root_path) {
+    GPtrArray *files = list_dataset_files(root_path);
+    if (!files || files->len == 0) {
+        fprintf(stderr, "Error: No images found in '%s'\n", root_path);
+        if (files) g_ptr_array_free(files, TRUE);
+        return 0;
+    }
+
+    printf("Packing %u images from '%s'...\n", files->len, root_path);
+    GlyphSet set = { 0 };
+    glyph_set_reserve(&set, (int)files->len);
+    guint64 source_hash = hash_dataset_manifest(files);
+
+    // Same decoding as load_dataset, glyphs that fail to load are left out
+    // PACK_CHUNK files at a time, the next chunk queued before waiting for this one
+    DecodeBatch *next = start_pack_chunk(files, 0);
+    for (guint start = 0; start < files->len; start += PACK_CHUNK) {
+        DecodeBatch *batch = next;
+        next = (start + PACK_CHUNK < files->len) ? start_pack_chunk(files, start + PACK_CHUNK) : NULL;
+
+        int decoded;
+        double **pixels = decode_batch_finish(batch, &decoded);
+        for (int i = 0; i < decoded; i++) {
+            const DatasetFile *file = g_ptr_array_index(files, start + i);
+            if (!pixels[i]) continue;
+            glyph_set_add(&set, pixels[i], file->label);
+            free(pixels[i]);
+        }
+        free(pixels);
+        printf("  %u/%u\n", start + decoded, files->len);
+        fflush(stdout);
+    }
+    g_ptr_array_free(files, TRUE);
+
+    int count = write_dataset_pack(root_path, &set, source_hash, 0);
+    free_glyph_set(&set);
+    return count;
+}
+
+int save_dataset_pack(const char *root_path, const GlyphSet *set) {
+    // Stamped with the hash of an empty folder: load_dataset takes the pack
+    // for as long as no letter images are added next to it
+    GPtrArray *files = list_dataset_files(root_path);
+    if (!files) {
+        fprintf(stderr, "Error: Cannot open folder '%s'\n", root_path);
+        return 0;
+    }
+    int has_images = files->len > 0;
+    guint64 source_hash = hash_dataset_manifest(files);
+    g_ptr_array_free(files, TRUE);
+    if (has_images) {
+        fprintf(stderr, "Error: '%s' holds letter images, give the glyphs a folder of their own\n", root_path);
+        return 0;
+    }
+    return write_dataset_pack(root_path, set, source_hash, DATASET_PACK_GENERATED);
+}
+
+// load_dataset from root_path/DATASET_PACK_NAME when it matches the
+// images in the folder. Returns -1 when there is no usable pack.
+static int load_packed_dataset(const char *root_path, GlyphSet *set, int max_per_letter) {
+    gchar *pack_path = g_build_filename(root_path, DATASET_PACK_NAME, NULL);
+    int fd = open(pack_path, O_RDONLY);
+    g_free(pack_path);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(DatasetPackHeader)) {
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    const size_t size = (size_t)st.st_size;
+    const size_t words = NN_PACKED_WORDS(PIXEL_COUNT);
+    const DatasetPackHeader *header = map;
+    if (memcmp(header->magic, DATASET_PACK_MAGIC, sizeof(header->magic)) == 0 && header->version != DATASET_PACK_VERSION) {
+        printf("Dataset pack in '%s' has an older format, decoding the images (refresh it with `pack`)\n", root_path);
+        munmap(map, size);
+        return -1;
+    }
+    if (memcmp(header->magic, DATASET_PACK_MAGIC, sizeof(header->magic)) != 0 || header->image_size != IMAGE_SIZE ||
+        header->words != words || header->labels_offset + header->count > size ||
+        header->glyphs_offset % 64 != 0 ||
+        header->glyphs_offset + (size_t)header->count * words * sizeof(uint64_t) > size) {
+        fprintf(stderr, "Warning: Ignoring invalid dataset pack in '%s'\n", root_path);
+        munmap(map, size);
+        return -1;
+    }
+
+    GPtrArray *files = list_dataset_files(root_path);
+    int fresh = files && hash_dataset_manifest(files) == header->source_hash;
+    if (files) g_ptr_array_free(files, TRUE);
+    if (!fresh) {
+        printf("Dataset pack in '%s' is out of date, decoding the images (refresh it with `pack`)\n", root_path);
+        munmap(map, size);
+        return -1;
+    }
+
+    const uint8_t *labels = (const uint8_t*)map + header->labels_offset;
+    const uint64_t *glyphs = (const uint64_t*)((const uint8_t*)map + header->glyphs_offset);
+    const size_t count = header->count;
+    if (header->flags & DATASET_PACK_GENERATED) max_per_letter = INT_MAX;
+
+    // Same sampling as load_images_from_folder: a random max_per_letter of each letter
+    size_t *order = malloc((count ? count : 1) * sizeof(size_t));
+    for (size_t i = 0; i < count; i++) order[i] = i;
+    for (size_t i = count; i-- > 1;) {
+        size_t j = (size_t)rand() % (i + 1);
+        size_t temp = order[i];
+        order[i] = order[j];
+        order[j] = temp;
+    }
+
+    // The pack already holds glyphs in the GlyphSet layout, they are copied as is
+    int taken[26] = { 0 };
+    glyph_set_reserve(set, set->count + (int)count);
+    for (size_t k = 0; k < count; k++) {
+        size_t i = order[k];
+        if (labels[i] >= 26 || taken[labels[i]] >= max_per_letter) continue;
+        taken[labels[i]]++;
+
+        memcpy(set->glyphs + (size_t)set->count * GLYPH_WORDS, glyphs + i * words, GLYPH_WORDS * sizeof(uint64_t));
+        set->labels[set->count++] = labels[i];
+    }
+
+    printf("Loaded %d of %zu packed glyphs from '%s/%s'\n", set->count, count, root_path, DATASET_PACK_NAME);
+    free(order);
+    munmap(map, size);
+    return set->count;
+}
+
+// Picks the images of a letter folder (a random max_images of them) and
+// queues their decoding. NULL if the folder can't be read.
+static DecodeBatch *start_folder_load(const char *folder_path, int max_images) {
     GError *error = NULL;
     GDir *dir = g_dir_open(folder_path, 0, &error);
     
@@ -72,7 +473,7 @@ int load_images_from_folder(const char *folder_path, int label, ImageData **imag
     if (!dir) {
         fprintf(stderr, "Warning: Cannot open folder '%s': %s\n", folder_path, error->message);
         g_error_free(error);
-        return 0;
+        return NULL;
     }
 
     // Get all valid files
@@ -89,13 +490,9 @@ int load_images_from_folder(const char *folder_path, int label, ImageData **imag
     
     // Count amount of files loaded
     guint total_files = valid_files->len;
-    if (total_files == 0) {
-        g_ptr_array_free(valid_files, TRUE);
-        return 0;
-    }
     
     // Shuffle files
-    int *indices = malloc(total_files * sizeof(int));
+    int *indices = malloc((total_files ? total_files : 1) * sizeof(int));
     for (guint i = 0; i < total_files; i++) {
         indices[i] = i;
     }
@@ -108,31 +505,44 @@ int load_images_from_folder(const char *folder_path, int label, ImageData **imag
     }
     
     // Load images
-    int loaded = 0;
     int max_to_load = ((int)total_files < max_images) ? (int)total_files : max_images;
+    GPtrArray *paths = g_ptr_array_new();
     
     for (int i = 0; i < max_to_load; i++) {
         filename = g_ptr_array_index(valid_files, indices[i]);
-        gchar *filepath = g_build_filename(folder_path, filename, NULL);
-
-        double *pixels = load_and_convert_image(filepath);
-        g_free(filepath);
-        
-        if (!pixels) continue;
-
-        (*images)[*current_count].pixels = pixels;
-        (*images)[*current_count].label = label;
-        (*current_count)++;
-        loaded++;
+        g_ptr_array_add(paths, g_build_filename(folder_path, filename, NULL));
     }
     
     free(indices);
     g_ptr_array_free(valid_files, TRUE);
+    return decode_batch_start(steal_paths(paths));
+}
+
+// Adds the images of a start_folder_load() batch to the set, in the shuffled
+// order (images that failed to load are skipped)
+static int finish_folder_load(DecodeBatch *batch, int label, GlyphSet *set) {
+    if (!batch) return 0;
+
+    int count;
+    int loaded = 0;
+    double **pixels = decode_batch_finish(batch, &count);
+    for (int i = 0; i < count; i++) {
+        if (!pixels[i]) continue;
+        glyph_set_add(set, pixels[i], label);
+        free(pixels[i]);
+        loaded++;
+    }
+    free(pixels);
     return loaded;
 }
 
-int load_dataset(const char *root_path, ImageData **images, int max_per_letter) {
+int load_images_from_folder(const char *folder_path, int label, GlyphSet *set, int max_images) {
+    return finish_folder_load(start_folder_load(folder_path, max_images), label, set);
+}
+
+int load_dataset(const char *root_path, GlyphSet *set, int max_per_letter) {
     GError *error = NULL;
+    memset(set, 0, sizeof(*set));
     GDir *dir = g_dir_open(root_path, 0, &error);
     
     // Check error cases
@@ -142,16 +552,16 @@ int load_dataset(const char *root_path, ImageData **images, int max_per_letter)
         return 0;
     }
 
-    // Allocate memory (26 letters max)
-    *images = malloc(26 * max_per_letter * sizeof(ImageData));
-    if (!*images) {
-        fprintf(stderr, "Error: Memory allocation failed\n");
+    // A fresh `pack` of this folder spares decoding every image
+    int packed = load_packed_dataset(root_path, set, max_per_letter);
+    if (packed >= 0) {
         g_dir_close(dir);
-        return 0;
+        return packed;
     }
 
-    int total_count = 0;
     const gchar *entry_name;
+    DecodeBatch *pending = NULL;
+    int pending_label = -1;
     
     printf("Loading dataset from '%s'...\n", root_path);
 
@@ -166,43 +576,41 @@ int load_dataset(const char *root_path, ImageData **images, int max_per_letter)
         }
 
         // Set the label according to file name
-        int label = -1;
-        if (entry_name[0] >= 'A' && entry_name[0] <= 'Z') {
-            label = entry_name[0] - 'A';
-        } else if (entry_name[0] >= 'a' && entry_name[0] <= 'z') {
-            label = entry_name[0] - 'a';
-        }
+        int label = folder_label(entry_name);
 
         if (label < 0 || label >= 26) {
             g_free(letter_path);
             continue;
         }
 
-        // Load the letters
-        printf("  Loading letter '%c' (label %d)...", 'A' + label, label);
-        fflush(stdout);
-
-        int loaded = load_images_from_folder(letter_path, label, images, &total_count, max_per_letter);
-        printf(" %d images loaded\n", loaded);
+        // Load the letters: this folder is queued before waiting for the
+        // previous one, so the workers never run dry between two letters
+        DecodeBatch *batch = start_folder_load(letter_path, max_per_letter);
+        if (pending_label >= 0) {
+            int loaded = finish_folder_load(pending, pending_label, set);
+            printf("  Loading letter '%c' (label %d)... %d images loaded\n", 'A' + pending_label, pending_label, loaded);
+            fflush(stdout);
+        }
+        pending = batch;
+        pending_label = label;
         
         g_free(letter_path);
     }
 
-    g_dir_close(dir);
-    
-    if (total_count > 0) {
-        *images = realloc(*images, total_count * sizeof(ImageData));
+    if (pending_label >= 0) {
+        int loaded = finish_folder_load(pending, pending_label, set);
+        printf("  Loading letter '%c' (label %d)... %d images loaded\n", 'A' + pending_label, pending_label, loaded);
     }
-    
-    return total_count;
+
+    g_dir_close(dir);
+    return set->count;
 }
 
 // Free allocated memory for the images
-void free_images(ImageData *images, int count) {
-    for (int i = 0; i < count; i++) {
-        free(images[i].pixels);
-    }
-    free(images);
+void free_glyph_set(GlyphSet *set) {
+    free(set->glyphs);
+    free(set->labels);
+    memset(set, 0, sizeof(*set));
 }
 
 void print_image(double *pixels) {
@@ -257,44 +665,48 @@ int load_grid_images(const char *folder_path, GridLetter **letters) {
         return 0;
     }
 
-    int count = 0;
+    // Initialize an array for the letters of the grid
+    GArray *cells = g_array_new(FALSE, FALSE, sizeof(GridLetter));
+    GPtrArray *paths = g_ptr_array_new();
     const gchar *filename;
     
     // Parse file names with function made for that
     while ((filename = g_dir_read_name(dir)) != NULL) {
-        int x, y;
-        if (parse_grid_filename(filename, &x, &y)) count++;
+        GridLetter cell = { .pixels = NULL, .predicted_letter = '?' };
+        if (!parse_grid_filename(filename, &cell.x, &cell.y)) continue;
+        g_array_append_val(cells, cell);
+        g_ptr_array_add(paths, g_build_filename(folder_path, filename, NULL));
     }
+    g_dir_close(dir);
     
-    if (count == 0) {
-        g_dir_close(dir);
+    if (cells->len == 0) {
+        g_ptr_array_free(paths, TRUE);
+        g_array_free(cells, TRUE);
         return 0;
     }
     
-    // Initialize an array for the letters of the grid
+    // Decode every cell on the workers, then keep the ones that loaded
+    int count;
+    double **pixels = decode_batch_finish(decode_batch_start(steal_paths(paths)), &count);
     *letters = malloc(count * sizeof(GridLetter));
-    
-    g_dir_rewind(dir);
     int loaded = 0;
     
-    while ((filename = g_dir_read_name(dir)) != NULL) {
-        int x, y;
-        if (!parse_grid_filename(filename, &x, &y)) continue;
-        
-        gchar *filepath = g_build_filename(folder_path, filename, NULL);
-        double *pixels = load_and_convert_image(filepath);
-        g_free(filepath);
-        
-        if (!pixels) continue;
+    for (int i = 0; i < count; i++) {
+        if (!pixels[i]) continue;
         
-        (*letters)[loaded].x = x;
-        (*letters)[loaded].y = y;
-        (*letters)[loaded].pixels = pixels;
-        (*letters)[loaded].predicted_letter = '?';
+        (*letters)[loaded] = g_array_index(cells, GridLetter, i);
+        (*letters)[loaded].pixels = pixels[i];
         loaded++;
     }
     
-    g_dir_close(dir);
+    free(pixels);
+    g_array_free(cells, TRUE);
+
+    // Callers only free the letters when there are some
+    if (loaded == 0) {
+        free(*letters);
+        *letters = NULL;
+    }
     printf("Loaded %d grid images\n", loaded);
     return loaded;
 }
@@ -360,7 +772,8 @@ static gboolean parse_number_filename(const char *filename, int *number) {
     return FALSE;
 }
 
-char* load_and_predict_word(const char *word_folder, Network *net) {
+// Queues the letters of a word folder in reading order, NULL if the folder can't be read
+static DecodeBatch *start_word_letters(const char *word_folder) {
     GError *error = NULL;
     GDir *dir = g_dir_open(word_folder, 0, &error);
     
@@ -386,69 +799,94 @@ char* load_and_predict_word(const char *word_folder, Network *net) {
     }
     g_dir_close(dir);
     
-    if (files_array->len == 0) {
-        g_ptr_array_free(files_array, TRUE);
-        return NULL;
-    }
-    
     qsort(files_array->pdata, files_array->len, sizeof(gpointer), compare_numbered_files);
     
-    char *word = malloc((files_array->len + 1) * sizeof(char));
+    GPtrArray *paths = g_ptr_array_new();
+    for (guint i = 0; i < files_array->len; i++) {
+        NumberedFile *nf = g_ptr_array_index(files_array, i);
+        g_ptr_array_add(paths, g_build_filename(word_folder, nf->filename, NULL));
+
+        g_free(nf->filename);
+        free(nf);
+    }
+    g_ptr_array_free(files_array, TRUE);
     
-    double *hidden = malloc(net->hidden_size * sizeof(double));
-    double *output = malloc(net->output_size * sizeof(double));
+    return decode_batch_start(steal_paths(paths));
+}
 
+// Letters of a start_word_letters() batch
+// Returns the number of letters (-1 if the folder can't be read), NULL entries are unreadable images
+static int finish_word_letters(DecodeBatch *batch, double ***letters) {
+    *letters = NULL;
+    if (!batch) return -1;
 
-    // Decrypt the words with the neural network
-    for (guint i = 0; i < files_array->len; i++) {
-        NumberedFile *nf = g_ptr_array_index(files_array, i);
-        gchar *filepath = g_build_filename(word_folder, nf->filename, NULL);
-        
-        double *pixels = load_and_convert_image(filepath);
-        g_free(filepath);
-        
+    int count;
+    double **pixels = decode_batch_finish(batch, &count);
+    if (count == 0) {
+        free(pixels);
+        return 0;
+    }
+    *letters = pixels;
+    return count;
+}
+
+static int argmax(const double *values, size_t count) {
+    int best = 0;
+    for (size_t j = 1; j < count; j++) {
+        if (values[j] > values[best]) best = (int)j;
+    }
+    return best;
+}
+
+// Predicts the word of a start_word_letters() batch, NULL if it has no letter
+static char *predict_word_letters(DecodeBatch *decoding, Network *net) {
+    double **letters;
+    int count = finish_word_letters(decoding, &letters);
+    if (count <= 0) return NULL;
+    
+    char *word = malloc((count + 1) * sizeof(char));
+
+    // Decrypt every letter of the word in one batch
+    double *inputs = malloc(count * net->input_size * sizeof(double));
+    double *outputs = malloc(count * net->output_size * sizeof(double));
+    int batch = 0;
+    for (int i = 0; i < count; i++) {
+        if (letters[i]) {
+            memcpy(inputs + batch * net->input_size, letters[i], net->input_size * sizeof(double));
+            batch++;
+        }
+    }
+    forward_batch(net, inputs, outputs, batch);
+
+    batch = 0;
+    for (int i = 0; i < count; i++) {
         // Fill voids with question marks to debug
-        if (!pixels) {
+        if (!letters[i]) {
             word[i] = '?';
             continue;
         }
-        
-        // Guess letter
-        forward(net, pixels, hidden, output);
-        
-        int predicted = 0;
-        double max_prob = output[0];    
-    
-        for (size_t j = 1; j < net->output_size; j++) {
-            if (output[j] > max_prob) {
-                max_prob = output[j];
-                predicted = (int)j;
-            }
-        }
-        
-        word[i] = 'A' + predicted;
-        free(pixels);
+        word[i] = 'A' + argmax(outputs + batch * net->output_size, net->output_size);
+        batch++;
+        free(letters[i]);
     }
     
     // terminate the array with \0 to be able to iterate over it
-
-    word[files_array->len] = '\0';
+    word[count] = '\0';
     
     // Careful not to leak memory
-    free(hidden);
-    free(output);
-    
-    for (guint i = 0; i < files_array->len; i++) {
-        NumberedFile *nf = g_ptr_array_index(files_array, i);
-        g_free(nf->filename);
-        free(nf);
-    }
-    g_ptr_array_free(files_array, TRUE);
+    free(inputs);
+    free(outputs);
+    free(letters);
     
     return word;
 }
 
-int load_and_predict_words(const char *words_folder, Network *net, Word **words) {
+char* load_and_predict_word(const char *word_folder, Network *net) {
+    return predict_word_letters(start_word_letters(word_folder), net);
+}
+
+// Lists the word folders (sorted by name)
+static GPtrArray* list_word_folders(const char *words_folder) {
     GError *error = NULL;
     GDir *dir = g_dir_open(words_folder, 0, &error);
 
@@ -456,7 +894,7 @@ int load_and_predict_words(const char *words_folder, Network *net, Word **words)
     if (!dir) {
         fprintf(stderr, "Error: Cannot open folder '%s': %s\n", words_folder, error->message);
         g_error_free(error);
-        return 0;
+        return NULL;
     }
 
     // Initialize array of valid words folder
@@ -478,6 +916,19 @@ int load_and_predict_words(const char *words_folder, Network *net, Word **words)
     // Don't forget to close opened folders
     g_dir_close(dir);
     
+    g_ptr_array_sort(folders, (GCompareFunc)strcmp);
+    return folders;
+}
+
+static const char* folder_basename(const char *folder_path) {
+    const char *folder_name = strrchr(folder_path, '/');
+    if (!folder_name) folder_name = strrchr(folder_path, '\\');
+    return folder_name ? folder_name + 1 : folder_path;
+}
+
+int load_and_predict_words(const char *words_folder, Network *net, Word **words) {
+    GPtrArray *folders = list_word_folders(words_folder);
+    if (!folders) return 0;
 
     // Get amount of words from the amount of folders loaded
     guint num_words = folders->len;
@@ -486,21 +937,20 @@ int load_and_predict_words(const char *words_folder, Network *net, Word **words)
         return 0;
     }
     
-    g_ptr_array_sort(folders, (GCompareFunc)strcmp);
-    
     // Initialize words variable
     *words = malloc(num_words * sizeof(Word));
     
+    // The next word decodes while this one is predicted
+    DecodeBatch *next = start_word_letters(g_ptr_array_index(folders, 0));
     for (guint i = 0; i < num_words; i++) {
         const char *folder_path = g_ptr_array_index(folders, i);
-        const char *folder_name = strrchr(folder_path, '/');
-        if (!folder_name) folder_name = strrchr(folder_path, '\\');
-        folder_name = folder_name ? folder_name + 1 : folder_path;
+        DecodeBatch *batch = next;
+        next = (i + 1 < num_words) ? start_word_letters(g_ptr_array_index(folders, i + 1)) : NULL;
         
-        printf("  Processing word folder '%s'...", folder_name);
+        printf("  Processing word folder '%s'...", folder_basename(folder_path));
         fflush(stdout);
         
-        char *word = load_and_predict_word(folder_path, net);
+        char *word = predict_word_letters(batch, net);
         
         if (word) {
             (*words)[i].word = word;
@@ -517,6 +967,44 @@ int load_and_predict_words(const char *words_folder, Network *net, Word **words)
     return (int)num_words;
 }
 
+int load_word_images(const char *words_folder, WordImages **words) {
+    GPtrArray *folders = list_word_folders(words_folder);
+    if (!folders) return 0;
+
+    guint num_words = folders->len;
+    if (num_words == 0) {
+        g_ptr_array_free(folders, TRUE);
+        return 0;
+    }
+
+    // Every folder is queued up front, the workers go from one to the next
+    *words = malloc(num_words * sizeof(WordImages));
+    DecodeBatch **batches = malloc(num_words * sizeof(DecodeBatch*));
+    for (guint i = 0; i < num_words; i++) {
+        batches[i] = start_word_letters(g_ptr_array_index(folders, i));
+    }
+    for (guint i = 0; i < num_words; i++) {
+        const char *folder_path = g_ptr_array_index(folders, i);
+        (*words)[i].name = g_strdup(folder_basename(folder_path));
+        (*words)[i].letter_count = finish_word_letters(batches[i], &(*words)[i].letters);
+    }
+    free(batches);
+
+    g_ptr_array_free(folders, TRUE);
+    return (int)num_words;
+}
+
+void free_word_images(WordImages *words, int count) {
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < words[i].letter_count; j++) {
+            free(words[i].letters[j]);
+        }
+        free(words[i].letters);
+        g_free(words[i].name);
+    }
+    free(words);
+}
+
 
 // Free all allocated memory for the words
 void free_words(Word *words, int count) {
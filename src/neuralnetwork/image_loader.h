@@ -4,23 +4,50 @@
 #include <gtk/gtk.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
 #include "neural_network.h"
+#include "glyph.h"
 
-#define IMAGE_SIZE 30 
-
-#define PIXEL_COUNT (IMAGE_SIZE * IMAGE_SIZE)
+// Training set kept bit-packed: glyph i is the GLYPH_WORDS words at
+// glyphs + i * GLYPH_WORDS (pixels packed as by pack_input), labels[i] its
+// letter. 120 bytes per image instead of 900 doubles.
+#define GLYPH_WORDS NN_PACKED_WORDS(PIXEL_COUNT)
 
 typedef struct {
-    double *pixels;
-    int label;
-} ImageData;
+    uint64_t *glyphs;
+    uint8_t *labels;
+    int count;
+    int capacity;
+} GlyphSet;
 
 double* load_and_convert_image(const char *filepath);
 
-int load_images_from_folder(const char *folder_path, int label, ImageData **images, int *current_count, int max_images);
+// Room for at least `capacity` glyphs, growing geometrically
+void glyph_set_reserve(GlyphSet *set, int capacity);
+
+// Appends a decoded 0/1 image to the set
+void glyph_set_add(GlyphSet *set, const double *pixels, int label);
+
+const uint64_t *glyph_set_glyph(const GlyphSet *set, int index);
+
+int load_images_from_folder(const char *folder_path, int label, GlyphSet *set, int max_images);
+
+// Uses root_path/DATASET_PACK_NAME instead of decoding the images when it
+// was packed from exactly the images currently in the folder
+int load_dataset(const char *root_path, GlyphSet *set, int max_per_letter);
 
-int load_dataset(const char *root_path, ImageData **images, int max_per_letter);
+// Decodes every image of a dataset folder once into root_path/DATASET_PACK_NAME
+// (labels, bit-packed glyphs and a hash of the source images' paths, sizes
+// and modification times).
+// Returns the number of glyphs packed, 0 on error.
+#define DATASET_PACK_NAME "dataset.pack"
+int pack_dataset(const char *root_path);
 
-void free_images(ImageData *images, int count);
+// Writes glyphs that have no image files (`ocr_trainer generate`) as the
+// pack of root_path, a folder without letter images that load_dataset()
+// then reads like any packed dataset (all the glyphs, whatever
+// max_per_letter). Returns the glyph count, 0 on error.
+int save_dataset_pack(const char *root_path, const GlyphSet *set);
+
+void free_glyph_set(GlyphSet *set);
 
 void print_image(double *pixels);
 
@@ -47,4 +74,15 @@ int load_and_predict_words(const char *words_folder, Network *net, Word **words)
 
 void free_words(Word *words, int count);
 
+// Letters of a word folder, loaded without prediction (for batched inference)
+typedef struct {
+    char *name;
+    int letter_count;   // -1 if the folder couldn't be read
+    double **letters;   // NULL entries are images that failed to load
+} WordImages;
+
+int load_word_images(const char *words_folder, WordImages **words);
+
+void free_word_images(WordImages *words, int count);
+
 #endif
@@ -1,6 +1,13 @@
 #include "neural_network.h"
 #include "image_loader.h"
 #include "network_io.h"
+#include "nn_kernels.h"
+#include "nn_pool.h"
+#include "nn_train.h"
+#include "nn_augment.h"
+#include "glyph_generator.h"
+#include "nn_telemetry.h"
+#include "nn_compress.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,44 +18,474 @@
 #define NUM_CLASSES 26
 #define MAX_IMAGES_PER_LETTER 500
 
-void shuffle_dataset(ImageData *images, int count) {
-    for (int i = count - 1; i > 0; i--) {
+// Share of the dataset the training modes hold out for validation (see
+// is_held_out)
+static double validation_split = 0.1;
+
+// Optimizer of the training modes, `continue` resumes the saved state
+static NNOptimizerKind optimizer_kind = NN_OPTIMIZER_SGD;
+static int optimizer_given = 0;
+static double momentum = -1.0;     // < 0: the optimizer's default
+
+// Schedule options given on the command line, `continue` takes the others
+// from the saved state
+enum {
+    GIVEN_SCHEDULE = 1,
+    GIVEN_WARMUP = 2,
+    GIVEN_SCHEDULE_EPOCHS = 4,
+    GIVEN_STEP_EPOCHS = 8,
+    GIVEN_GAMMA = 16
+};
+static int schedule_given = 0;
+
+// Distortions of the training images, drawn again every epoch (--augment)
+static NNAugmentConfig augmentation;
+static int augment = 0;
+
+// Font-rendered glyphs added to the dataset images (--synthetic)
+static GlyphGenConfig synthetic;
+
+// Per-epoch training log (--log), CSV or JSON
+static const char *training_log = NULL;
+
+// Model compression (prune, distill, pareto)
+static NNPruneCriterion prune_criterion = NN_PRUNE_MAGNITUDE;
+static double distill_temperature = 4.0;
+static double distill_weight = 0.7;
+static double target_accuracy = 0.0;    // Percent, 0 = none
+
+// Whether image i is held out for validation. Decided by a hash of its
+// pixels and label, not by its place in the set: every run (train, then
+// continue, seeded or not) holds out the same images, and duplicates of an
+// image all land on the same side.
+int is_held_out(const GlyphSet *images, int i) {
+    const uint64_t *glyph = glyph_set_glyph(images, i);
+    uint64_t hash = 14695981039346656037ULL;
+    for (int w = 0; w < GLYPH_WORDS; w++) hash = (hash ^ glyph[w]) * 1099511628211ULL;
+    hash = (hash ^ images->labels[i]) * 1099511628211ULL;
+
+    // splitmix64 finalizer: FNV's low bits alone are poorly mixed
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return (double)(hash >> 11) * 0x1.0p-53 < validation_split;
+}
+
+// Moves the held-out images after the others, both sides keeping their
+// order. Returns how many are held out.
+int split_held_out(GlyphSet *images) {
+    int count = images->count, kept = 0, held_out = 0;
+    uint64_t *glyphs = malloc((size_t)(count > 0 ? count : 1) * GLYPH_WORDS * sizeof(uint64_t));
+    uint8_t *labels = malloc(count > 0 ? count : 1);
+    uint8_t *side = malloc(count > 0 ? count : 1);
+    for (int i = 0; i < count; i++) {
+        side[i] = (uint8_t)is_held_out(images, i);
+        if (!side[i]) kept++;
+    }
+
+    int next[2] = { 0, kept };
+    for (int i = 0; i < count; i++) {
+        int to = next[side[i]]++;
+        memcpy(glyphs + (size_t)to * GLYPH_WORDS, glyph_set_glyph(images, i), GLYPH_WORDS * sizeof(uint64_t));
+        labels[to] = images->labels[i];
+    }
+    memcpy(images->glyphs, glyphs, (size_t)count * GLYPH_WORDS * sizeof(uint64_t));
+    memcpy(images->labels, labels, (size_t)count);
+    held_out = count - kept;
+
+    free(glyphs);
+    free(labels);
+    free(side);
+    return held_out;
+}
+
+// Shuffles the set, then moves the held-out images to its end, where
+// train_network expects them
+void shuffle_dataset(GlyphSet *images) {
+    for (int i = images->count - 1; i > 0; i--) {
         int j = rand() % (i + 1);
-        ImageData temp = images[i];
-        images[i] = images[j];
-        images[j] = temp;
+        uint64_t temp[GLYPH_WORDS];
+        memcpy(temp, glyph_set_glyph(images, i), sizeof(temp));
+        memcpy(images->glyphs + (size_t)i * GLYPH_WORDS, glyph_set_glyph(images, j), sizeof(temp));
+        memcpy(images->glyphs + (size_t)j * GLYPH_WORDS, temp, sizeof(temp));
+
+        uint8_t label = images->labels[i];
+        images->labels[i] = images->labels[j];
+        images->labels[j] = label;
     }
+    split_held_out(images);
 }
 
-void train_network(Network *net, ImageData *images, int num_images, int epochs, float learning_rate) {
+// Training log of a run, with what it takes to compare it to another one:
+// the settings, the machine and the kernels
+NNTelemetry *start_telemetry(Network *net, const TrainConfig *config, int num_examples) {
+    NNTelemetry *telemetry = telemetry_new();
+    char started[64];
+    time_t now = time(NULL);
+    strftime(started, sizeof(started), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+
+    telemetry_set_string(telemetry, "started", started);
+    telemetry_set_string(telemetry, "host", g_get_host_name());
+    telemetry_set_number(telemetry, "cpus", g_get_num_processors());
+    telemetry_set_string(telemetry, "kernels", nn_kernels->name);
+    telemetry_set_number(telemetry, "input_size", net->input_size);
+    telemetry_set_number(telemetry, "hidden_size", net->hidden_size);
+    telemetry_set_number(telemetry, "output_size", net->output_size);
+    telemetry_set_number(telemetry, "binarized", net->binarized);
+    telemetry_set_number(telemetry, "examples", num_examples);
+    telemetry_set_number(telemetry, "validation_examples", config->validation_count);
+    telemetry_set_number(telemetry, "epochs", config->epochs);
+    telemetry_set_number(telemetry, "batch_size", config->batch_size);
+    telemetry_set_number(telemetry, "threads", config->threads > 0 ? config->threads : (int)g_get_num_processors());
+    telemetry_set_number(telemetry, "hogwild", config->hogwild);
+    telemetry_set_number(telemetry, "seed", config->seed);
+    telemetry_set_number(telemetry, "learning_rate", config->learning_rate);
+    telemetry_set_string(telemetry, "optimizer", nn_optimizer_name(config->optimizer ? config->optimizer->kind : NN_OPTIMIZER_SGD));
+    telemetry_set_string(telemetry, "schedule", nn_schedule_name(config->schedule));
+    telemetry_set_number(telemetry, "warmup_epochs", config->warmup_epochs);
+    telemetry_set_number(telemetry, "augment", augment);
+    return telemetry;
+}
+
+void train_network(Network *net, const GlyphSet *images, const TrainConfig *config) {
+    int num_images = images->count;
     TrainingExample *examples = malloc(num_images * sizeof(TrainingExample));
     for (int i = 0; i < num_images; i++) {
-        examples[i].pixels = images[i].pixels;
-        examples[i].label = images[i].label;
+        examples[i].bits = glyph_set_glyph(images, i);
+        examples[i].label = images->labels[i];
+    }
+
+    // The held-out images are the last ones, shuffle_dataset put them there
+    TrainConfig local = *config;
+    int held_out = 0;
+    for (int i = 0; i < num_images; i++) held_out += is_held_out(images, i);
+    if (held_out > 0 && held_out < num_images) {
+        local.validation = examples + (num_images - held_out);
+        local.validation_count = (size_t)held_out;
+    } else {
+        held_out = 0;
     }
 
     printf("\nStarting training...\n");
-    printf("Images: %d, Epochs: %d, Learning rate: %.4f\n\n", num_images, epochs, learning_rate);
+    printf("Images: %d (%d held out), Epochs: %d, Learning rate: %.4f, Batch size: %zu\n",
+           num_images - held_out, held_out, config->epochs, config->learning_rate, config->batch_size);
+    if (config->optimizer) {
+        printf("Optimizer: %s, schedule: %s", nn_optimizer_name(config->optimizer->kind),
+               nn_schedule_name(config->schedule));
+        if (config->warmup_epochs > 0) printf(", warmup %d epochs", config->warmup_epochs);
+        if (config->optimizer->epoch > 0) printf(", resuming after epoch %d", config->optimizer->epoch);
+        printf("\n");
+    }
+    printf("\n");
 
-    train(net, examples, num_images, epochs, learning_rate);
+    // A cosine decaying to the end of the run gets its last epoch fixed
+    // now, and the schedule goes with the optimizer state it trains
+    if (local.schedule == NN_SCHEDULE_COSINE && local.schedule_epochs == 0) {
+        local.schedule_epochs = (config->optimizer ? config->optimizer->epoch : 0) + config->epochs;
+    }
+    if (config->optimizer) {
+        NNOptimizer *opt = config->optimizer;
+        opt->schedule = local.schedule;
+        opt->learning_rate = local.learning_rate;
+        opt->warmup_epochs = local.warmup_epochs;
+        opt->schedule_epochs = local.schedule == NN_SCHEDULE_COSINE ? local.schedule_epochs : 0;
+        opt->step_epochs = local.step_epochs;
+        opt->step_gamma = local.step_gamma;
+    }
+
+    // The held-out images stay clean
+    NNAugmenter *augmenter = NULL;
+    if (augment) {
+        augmentation.seed = config->seed ? config->seed : (unsigned int)rand();
+        augmentation.first_epoch = config->optimizer ? config->optimizer->epoch : 0;
+        augmenter = augmenter_start(&augmentation, examples, (size_t)(num_images - held_out));
+        local.epoch_begin = augmenter_epoch_begin;
+        local.epoch_begin_data = augmenter;
+    }
+
+    NNTelemetry *telemetry = training_log ? start_telemetry(net, &local, num_images - held_out) : NULL;
+    if (telemetry) {
+        local.epoch_stats = telemetry_epoch;
+        local.validation_stats = telemetry_validation;
+        local.stats_data = telemetry;
+    }
 
+    train_data_parallel(net, examples, num_images - held_out, &local);
+
+    if (telemetry) {
+        telemetry_write(telemetry, training_log);
+        telemetry_free(telemetry);
+    }
+    augmenter_free(augmenter);
     free(examples);
 }
 
-void test_network(Network *net, ImageData *images, int num_images, int num_tests) {
+// Appends the --synthetic glyphs to the loaded images, which the caller
+// shuffles afterwards. Returns the new image count.
+int add_synthetic_glyphs(GlyphSet *images, const TrainConfig *config) {
+    if (synthetic.count <= 0) return images->count;
+    synthetic.seed = config->seed ? config->seed : (unsigned int)rand();
+    generate_glyphs(&synthetic, images);
+    return images->count;
+}
+
+// Optimizer state of a training run: the one saved next to resume_model
+// unless --optimizer asks for another kind, else a new one
+NNOptimizer *training_optimizer(Network *net, const char *resume_model) {
+    NNOptimizer *opt = NULL;
+    if (resume_model) {
+        gchar *path = g_strconcat(resume_model, NN_OPTIMIZER_SUFFIX, NULL);
+        if (g_file_test(path, G_FILE_TEST_EXISTS)) opt = load_optimizer(net, path);
+        g_free(path);
+    }
+    if (opt && optimizer_given && opt->kind != optimizer_kind) {
+        printf("Saved optimizer state is %s, starting a new %s state\n",
+               nn_optimizer_name(opt->kind), nn_optimizer_name(optimizer_kind));
+        free_optimizer(opt);
+        opt = NULL;
+    }
+    if (!opt) opt = create_optimizer(net, optimizer_kind);
+    if (momentum >= 0.0) opt->beta1 = momentum;
+    return opt;
+}
+
+// Schedule of the runs that trained the saved state, for the options not
+// given again, so `continue` picks the learning rate up where it stopped
+void resume_schedule(TrainConfig *config) {
+    const NNOptimizer *opt = config->optimizer;
+    if (opt->learning_rate <= 0.0) return;
+
+    if (!(schedule_given & GIVEN_SCHEDULE)) config->schedule = opt->schedule;
+    if (!(schedule_given & GIVEN_WARMUP)) config->warmup_epochs = opt->warmup_epochs;
+    if (!(schedule_given & GIVEN_SCHEDULE_EPOCHS) && config->schedule == opt->schedule) {
+        config->schedule_epochs = opt->schedule_epochs;
+    }
+    if (!(schedule_given & GIVEN_STEP_EPOCHS) && opt->step_epochs > 0) config->step_epochs = opt->step_epochs;
+    if (!(schedule_given & GIVEN_GAMMA) && opt->step_gamma > 0.0) config->step_gamma = opt->step_gamma;
+
+    printf("Resuming the %s schedule of the saved state", nn_schedule_name(config->schedule));
+    if (config->schedule == NN_SCHEDULE_COSINE) printf(" (decays until epoch %d)", config->schedule_epochs);
+    printf("\n");
+    if (config->learning_rate != opt->learning_rate) {
+        printf("Learning rate %.4f replaces the saved %.4f\n", config->learning_rate, opt->learning_rate);
+    }
+}
+
+// Saves the optimizer state next to the model, unless it has nothing a
+// resumed run would need (plain SGD at a constant rate, without
+// augmentation, whose draws follow the epoch count)
+void save_training_state(Network *net, const TrainConfig *config, const char *model_file) {
+    const NNOptimizer *opt = config->optimizer;
+    if (opt->kind == NN_OPTIMIZER_SGD && config->schedule == NN_SCHEDULE_CONSTANT && config->warmup_epochs == 0 &&
+        !augment) return;
+    gchar *path = g_strconcat(model_file, NN_OPTIMIZER_SUFFIX, NULL);
+    save_optimizer(opt, net, path);
+    g_free(path);
+}
+
+// Options after the positional arguments of the training modes
+int parse_train_options(int argc, char *argv[], int first, TrainConfig *config) {
+    config->patience = 5;
+    augment_config_default(&augmentation, IMAGE_SIZE);
+    glyph_gen_config_default(&synthetic);
+    for (int i = first; i < argc; i++) {
+        if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            int batch = atoi(argv[++i]);
+            if (batch <= 0) {
+                fprintf(stderr, "Error: --batch must be positive\n");
+                return 0;
+            }
+            config->batch_size = (size_t)batch;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            config->threads = atoi(argv[++i]);
+            if (config->threads < 0) {
+                fprintf(stderr, "Error: --threads must be 0 (one per core) or more\n");
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--hogwild") == 0) {
+            config->hogwild = 1;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            config->seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--validation") == 0 && i + 1 < argc) {
+            validation_split = atof(argv[++i]);
+            if (validation_split < 0.0 || validation_split >= 1.0) {
+                fprintf(stderr, "Error: --validation must be in [0, 1)\n");
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--eval-every") == 0 && i + 1 < argc) {
+            config->eval_every = atoi(argv[++i]);
+            if (config->eval_every <= 0) {
+                fprintf(stderr, "Error: --eval-every must be positive\n");
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--patience") == 0 && i + 1 < argc) {
+            config->patience = atoi(argv[++i]);
+            if (config->patience < 0) {
+                fprintf(stderr, "Error: --patience must be 0 (no early stop) or more\n");
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--optimizer") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            if (strcmp(name, "sgd") == 0) optimizer_kind = NN_OPTIMIZER_SGD;
+            else if (strcmp(name, "momentum") == 0) optimizer_kind = NN_OPTIMIZER_MOMENTUM;
+            else if (strcmp(name, "adam") == 0) optimizer_kind = NN_OPTIMIZER_ADAM;
+            else {
+                fprintf(stderr, "Error: --optimizer must be sgd, momentum or adam\n");
+                return 0;
+            }
+            optimizer_given = 1;
+        } else if (strcmp(argv[i], "--momentum") == 0 && i + 1 < argc) {
+            momentum = atof(argv[++i]);
+            if (momentum < 0.0 || momentum >= 1.0) {
+                fprintf(stderr, "Error: --momentum must be in [0, 1)\n");
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--schedule") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            if (strcmp(name, "constant") == 0) config->schedule = NN_SCHEDULE_CONSTANT;
+            else if (strcmp(name, "cosine") == 0) config->schedule = NN_SCHEDULE_COSINE;
+            else if (strcmp(name, "step") == 0) config->schedule = NN_SCHEDULE_STEP;
+            else {
+                fprintf(stderr, "Error: --schedule must be constant, cosine or step\n");
+                return 0;
+            }
+            schedule_given |= GIVEN_SCHEDULE;
+        } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            config->warmup_epochs = atoi(argv[++i]);
+            if (config->warmup_epochs < 0) {
+                fprintf(stderr, "Error: --warmup must be 0 or more\n");
+                return 0;
+            }
+            schedule_given |= GIVEN_WARMUP;
+        } else if (strcmp(argv[i], "--schedule-epochs") == 0 && i + 1 < argc) {
+            config->schedule_epochs = atoi(argv[++i]);
+            if (config->schedule_epochs < 0) {
+                fprintf(stderr, "Error: --schedule-epochs must be 0 (end of the run) or more\n");
+                return 0;
+            }
+            schedule_given |= GIVEN_SCHEDULE_EPOCHS;
+        } else if (strcmp(argv[i], "--step-epochs") == 0 && i + 1 < argc) {
+            config->step_epochs = atoi(argv[++i]);
+            if (config->step_epochs <= 0) {
+                fprintf(stderr, "Error: --step-epochs must be positive\n");
+                return 0;
+            }
+            schedule_given |= GIVEN_STEP_EPOCHS;
+        } else if (strcmp(argv[i], "--augment") == 0) {
+            augment = 1;
+        } else if (strcmp(argv[i], "--shift") == 0 && i + 1 < argc) {
+            augmentation.shift = atof(argv[++i]);
+            augment = 1;
+            if (augmentation.shift < 0.0) {
+                fprintf(stderr, "Error: --shift must be 0 or more\n");
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--rotate") == 0 && i + 1 < argc) {
+            augmentation.rotation = atof(argv[++i]);
+            augment = 1;
+            if (augmentation.rotation < 0.0) {
+                fprintf(stderr, "Error: --rotate must be 0 or more\n");
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+            augmentation.scale = atof(argv[++i]);
+            augment = 1;
+            if (augmentation.scale < 0.0 || augmentation.scale >= 1.0) {
+                fprintf(stderr, "Error: --scale must be in [0, 1)\n");
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--morph") == 0 && i + 1 < argc) {
+            augmentation.morphology = atof(argv[++i]);
+            augment = 1;
+            if (augmentation.morphology < 0.0 || augmentation.morphology > 0.5) {
+                fprintf(stderr, "Error: --morph must be in [0, 0.5]\n");
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--noise") == 0 && i + 1 < argc) {
+            augmentation.noise = atof(argv[++i]);
+            augment = 1;
+            if (augmentation.noise < 0.0 || augmentation.noise > 1.0) {
+                fprintf(stderr, "Error: --noise must be in [0, 1]\n");
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--augment-threads") == 0 && i + 1 < argc) {
+            augmentation.threads = atoi(argv[++i]);
+            if (augmentation.threads < 0) {
+                fprintf(stderr, "Error: --augment-threads must be 0 (one per core) or more\n");
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--synthetic") == 0 && i + 1 < argc) {
+            synthetic.count = atoi(argv[++i]);
+            if (synthetic.count < 0) {
+                fprintf(stderr, "Error: --synthetic must be 0 or more\n");
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--fonts") == 0 && i + 1 < argc) {
+            synthetic.fonts = argv[++i];
+        } else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            training_log = argv[++i];
+        } else if (strcmp(argv[i], "--criterion") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            if (strcmp(name, "magnitude") == 0) prune_criterion = NN_PRUNE_MAGNITUDE;
+            else if (strcmp(name, "activation") == 0) prune_criterion = NN_PRUNE_ACTIVATION;
+            else {
+                fprintf(stderr, "Error: Unknown criterion '%s' (expected magnitude or activation)\n", name);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--temperature") == 0 && i + 1 < argc) {
+            distill_temperature = atof(argv[++i]);
+            if (distill_temperature <= 0.0) {
+                fprintf(stderr, "Error: --temperature must be positive\n");
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--soft-weight") == 0 && i + 1 < argc) {
+            distill_weight = atof(argv[++i]);
+            if (distill_weight < 0.0 || distill_weight > 1.0) {
+                fprintf(stderr, "Error: --soft-weight must be in [0, 1]\n");
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--target") == 0 && i + 1 < argc) {
+            target_accuracy = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--gamma") == 0 && i + 1 < argc) {
+            config->step_gamma = atof(argv[++i]);
+            if (config->step_gamma <= 0.0 || config->step_gamma > 1.0) {
+                fprintf(stderr, "Error: --gamma must be in (0, 1]\n");
+                return 0;
+            }
+            schedule_given |= GIVEN_GAMMA;
+        } else {
+            fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+            return 0;
+        }
+    }
+
+    if (config->schedule == NN_SCHEDULE_STEP && config->step_epochs <= 0) {
+        fprintf(stderr, "Error: --schedule step needs --step-epochs\n");
+        return 0;
+    }
+
+    // Same seed, same thread count: same model (synchronous mode)
+    if (config->seed) seed_network_rng(config->seed);
+    return 1;
+}
+
+void test_network(Network *net, const GlyphSet *images, int num_tests) {
     printf("\n=== Testing Network ===\n");
     
+    int num_images = images->count;
     double *hidden = malloc(net->hidden_size * sizeof(double));
     double *output = malloc(net->output_size * sizeof(double));
+    double pixels[PIXEL_COUNT];
     int correct = 0;
 
     for (int i = 0; i < num_tests && i < num_images; i++) {
         int test_idx = rand() % num_images;
         
-        printf("\nTest %d - Expected: %c\n", i + 1, 'A' + images[test_idx].label);
-        print_image(images[test_idx].pixels);
+        printf("\nTest %d - Expected: %c\n", i + 1, 'A' + images->labels[test_idx]);
+        unpack_input(glyph_set_glyph(images, test_idx), PIXEL_COUNT, pixels);
+        print_image(pixels);
         
-        forward(net, images[test_idx].pixels, hidden, output);
+        forward(net, pixels, hidden, output);
         
         // Trouver la prédiction
         int predicted = 0;
@@ -62,7 +499,7 @@ void test_network(Network *net, ImageData *images, int num_images, int num_tests
         
         printf("Predicted: %c (Confidence: %.2f%%)\n", 'A' + predicted, max_prob * 100);
         
-        if (predicted == images[test_idx].label) {
+        if (predicted == images->labels[test_idx]) {
             printf("✓ CORRECT\n");
             correct++;
         } else {
@@ -78,19 +515,210 @@ void test_network(Network *net, ImageData *images, int num_images, int num_tests
     free(output);
 }
 
+// Accuracy on every image, through the inference pool; predictions[i] gets the class of image i
+#define ACCURACY_CHUNK 4096
+
+double dataset_accuracy(Network *net, const GlyphSet *images, int *predictions) {
+    // Unpacked a chunk at a time, the whole set as doubles would not fit
+    int num_images = images->count;
+    double *inputs = malloc((size_t)ACCURACY_CHUNK * net->input_size * sizeof(double));
+    double *outputs = malloc((size_t)ACCURACY_CHUNK * net->output_size * sizeof(double));
+    InferencePool *pool = inference_pool_new(net, 0);
+
+    int correct = 0;
+    for (int start = 0; start < num_images; start += ACCURACY_CHUNK) {
+        int count = num_images - start < ACCURACY_CHUNK ? num_images - start : ACCURACY_CHUNK;
+        for (int i = 0; i < count; i++) {
+            unpack_input(glyph_set_glyph(images, start + i), net->input_size, inputs + (size_t)i * net->input_size);
+        }
+        inference_pool_run(pool, inputs, outputs, count);
+
+        for (int i = 0; i < count; i++) {
+            const double *out = outputs + (size_t)i * net->output_size;
+            int predicted = 0;
+            for (size_t j = 1; j < net->output_size; j++) {
+                if (out[j] > out[predicted]) predicted = (int)j;
+            }
+            predictions[start + i] = predicted;
+            if (predicted == images->labels[start + i]) correct++;
+        }
+    }
+
+    inference_pool_free(pool);
+    free(inputs);
+    free(outputs);
+    return num_images > 0 ? (double)correct / num_images * 100.0 : 0.0;
+}
+
+// Examples over images [first, first + count)
+TrainingExample *glyph_examples(const GlyphSet *images, int first, int count) {
+    TrainingExample *examples = malloc((count > 0 ? count : 1) * sizeof(TrainingExample));
+    for (int i = 0; i < count; i++) {
+        examples[i].bits = glyph_set_glyph(images, first + i);
+        examples[i].label = images->labels[first + i];
+    }
+    return examples;
+}
+
+// The images train_network holds out (all of them without --validation)
+int held_out_count(const GlyphSet *images) {
+    int held_out = 0;
+    for (int i = 0; i < images->count; i++) held_out += is_held_out(images, i);
+    return held_out > 0 && held_out < images->count ? held_out : images->count;
+}
+
+// Hidden sizes of prune/distill, e.g. "64,32,16": largest first, each one
+// below the previous (and below limit when given). Returns the count, 0 on error.
+int parse_hidden_sizes(const char *list, size_t limit, size_t *sizes, int max) {
+    gchar **parts = g_strsplit(list, ",", -1);
+    int count = 0, ok = 1;
+    for (int i = 0; parts[i] && ok; i++) {
+        long size = atol(parts[i]);
+        size_t previous = count ? sizes[count - 1] : limit;
+        if (size <= 0 || count == max || (previous && (size_t)size >= previous)) ok = 0;
+        else sizes[count++] = (size_t)size;
+    }
+    g_strfreev(parts);
+    if (!ok || count == 0) {
+        fprintf(stderr, "Error: Hidden sizes must be positive and decreasing%s (got '%s')\n",
+                limit ? ", below the model's" : "", list);
+        return 0;
+    }
+    return count;
+}
+
+// Output of size `hidden`: output_file itself if it is the only one, else
+// "<stem>_h<hidden>.bin"
+gchar *sized_model_name(const char *output_file, size_t hidden, int count) {
+    if (count == 1) return g_strdup(output_file);
+    gchar *stem = g_str_has_suffix(output_file, ".bin") ? g_strndup(output_file, strlen(output_file) - 4)
+                                                        : g_strdup(output_file);
+    gchar *name = g_strdup_printf("%s_h%zu.bin", stem, hidden);
+    g_free(stem);
+    return name;
+}
+
+// Accuracy of a cascade (second NULL: first alone) over every image, a
+// chunk at a time like dataset_accuracy; metrics gets the stage counts
+double cascade_accuracy(InferencePool *first, InferencePool *second, double threshold, const GlyphSet *images,
+                        size_t input_size, size_t output_size, NNCascadeMetrics *metrics) {
+    int num_images = images->count;
+    double *inputs = malloc((size_t)ACCURACY_CHUNK * input_size * sizeof(double));
+    double *outputs = malloc((size_t)ACCURACY_CHUNK * output_size * sizeof(double));
+    memset(metrics, 0, sizeof(*metrics));
+
+    int correct = 0;
+    for (int start = 0; start < num_images; start += ACCURACY_CHUNK) {
+        int count = num_images - start < ACCURACY_CHUNK ? num_images - start : ACCURACY_CHUNK;
+        for (int i = 0; i < count; i++) {
+            unpack_input(glyph_set_glyph(images, start + i), input_size, inputs + (size_t)i * input_size);
+        }
+        inference_cascade_run(first, second, threshold, inputs, outputs, count, metrics);
+
+        for (int i = 0; i < count; i++) {
+            const double *out = outputs + (size_t)i * output_size;
+            int predicted = 0;
+            for (size_t j = 1; j < output_size; j++) {
+                if (out[j] > out[predicted]) predicted = (int)j;
+            }
+            if (predicted == images->labels[start + i]) correct++;
+        }
+    }
+
+    free(inputs);
+    free(outputs);
+    return num_images > 0 ? (double)correct / num_images * 100.0 : 0.0;
+}
+
+void print_cascade_row(const char *name, double accuracy, const NNCascadeMetrics *m) {
+    double seconds = m->seconds[0] + m->seconds[1];
+    printf("%-18s %8.2f%% %9.1f%% %9zu %10.0f\n", name, accuracy,
+           m->glyphs ? (double)m->escalated / m->glyphs * 100.0 : 0.0, m->changed,
+           m->glyphs ? seconds / m->glyphs * 1e9 : 0.0);
+}
+
+// Bytes of weights (and int8 scales) the forward pass streams through
+size_t weight_bytes(Network *net) {
+    size_t count = net->input_size * net->hidden_size + net->hidden_size * net->output_size;
+    switch (net->dtype) {
+    case NN_DTYPE_F32: return count * sizeof(float);
+    case NN_DTYPE_I8:  return count + (net->hidden_size + net->output_size) * sizeof(float);
+    case NN_DTYPE_BIN: return net->hidden_size * NN_PACKED_WORDS(net->input_size) * sizeof(uint64_t)
+                              + (net->hidden_size + net->hidden_size * net->output_size) * sizeof(double);
+    default:           return count * sizeof(double);
+    }
+}
+
 int main(int argc, char *argv[]) {
     gtk_init(&argc, &argv);
 
-    if (argc < 3) {
+    if (argc < 3 && !(argc == 2 && strcmp(argv[1], "selftest") == 0)) {
         fprintf(stderr, "Usage:\n");
-        fprintf(stderr, "  Train:      %s train <dataset_folder> <epochs> <learning_rate> <output_file.bin>\n", argv[0]);
-        fprintf(stderr, "  Continue:   %s continue <dataset_folder> <input_file.bin> <epochs> <learning_rate> <output_file.bin>\n", argv[0]);
+        fprintf(stderr, "  Train:      %s train <dataset_folder> <epochs> <learning_rate> <output_file.bin> [options]\n", argv[0]);
+        fprintf(stderr, "  Continue:   %s continue <dataset_folder> <input_file.bin> <epochs> <learning_rate> <output_file.bin> [options]\n", argv[0]);
         fprintf(stderr, "  Test:       %s test <dataset_folder> <model_file.bin> [num_tests]\n", argv[0]);
         fprintf(stderr, "  Solve:      %s solve <grid_folder> <words_folder> <model_file.bin> <output_folder>\n", argv[0]);
+        fprintf(stderr, "  Quantize:   %s quantize <heldout_folder> <model_file.bin> <f32|i8|bin> <output_file.bin>\n", argv[0]);
+        fprintf(stderr, "  Binarize:   %s binarize <dataset_folder> <model_file.bin> <epochs> <learning_rate> <output_file.bin> [options]\n", argv[0]);
+        fprintf(stderr, "  Prune:      %s prune <dataset_folder> <model_file.bin> <hidden_sizes> <epochs> <learning_rate> <output_file.bin> [options]\n", argv[0]);
+        fprintf(stderr, "  Distill:    %s distill <dataset_folder> <teacher.bin> <hidden_sizes> <epochs> <learning_rate> <output_file.bin> [options]\n", argv[0]);
+        fprintf(stderr, "  Pareto:     %s pareto <heldout_folder> <model_file.bin>... [--target ACC]\n", argv[0]);
+        fprintf(stderr, "  Cascade:    %s cascade <heldout_folder> <small_model.bin> <large_model.bin> [--threshold P]\n", argv[0]);
+        fprintf(stderr, "  Codegen:    %s codegen <model_file.bin> <output_file.c> [name]\n", argv[0]);
+        fprintf(stderr, "  Convert:    %s convert <model_file.bin> <output_file.bin>\n", argv[0]);
+        fprintf(stderr, "  Pack:       %s pack <dataset_folder>\n", argv[0]);
+        fprintf(stderr, "  Generate:   %s generate <output_folder> <count> [--fonts F1,F2] [--seed S] [--threads N]\n", argv[0]);
+        fprintf(stderr, "  Selftest:   %s selftest\n", argv[0]);
+        fprintf(stderr, "\nTraining options:\n");
+        fprintf(stderr, "  --batch N   Samples per weight update (default 1). The learning rate\n");
+        fprintf(stderr, "              applies to the mean gradient of the batch, scale it up with N.\n");
+        fprintf(stderr, "  --threads N Split every batch across N threads (0 = one per core)\n");
+        fprintf(stderr, "  --hogwild   Threads update the weights asynchronously, without locks\n");
+        fprintf(stderr, "  --seed S    Fixed seed for weights and shuffles (reproducible runs)\n");
+        fprintf(stderr, "  --validation F  Share of the images held out for validation (default 0.1,\n");
+        fprintf(stderr, "              0 = none), picked by content so continue holds out the same ones.\n");
+        fprintf(stderr, "              The model keeps the weights of the best validation loss.\n");
+        fprintf(stderr, "  --eval-every K  Evaluate on the held-out images every K epochs (default 1)\n");
+        fprintf(stderr, "  --patience P    Stop after P evaluations without a better loss (default 5, 0 = never)\n");
+        fprintf(stderr, "  --optimizer O   sgd (default), momentum or adam. The state is saved to\n");
+        fprintf(stderr, "              <output_file>.opt and resumed by continue.\n");
+        fprintf(stderr, "  --momentum B    Momentum, or Adam's beta1 (default 0.9)\n");
+        fprintf(stderr, "  --schedule S    Learning rate schedule: constant (default), cosine or step\n");
+        fprintf(stderr, "  --warmup E      Ramp the learning rate up linearly over the first E epochs\n");
+        fprintf(stderr, "  --schedule-epochs T  Cosine: decay over T epochs in all (default: to the end\n");
+        fprintf(stderr, "              of this run). The schedule is saved with the optimizer state,\n");
+        fprintf(stderr, "              continue follows it unless these options are given again.\n");
+        fprintf(stderr, "  --step-epochs N Step: multiply the learning rate by --gamma G (default 0.1)\n");
+        fprintf(stderr, "              every N epochs\n");
+        fprintf(stderr, "  --augment       Distort the training images anew every epoch, on producer\n");
+        fprintf(stderr, "              threads. Defaults: --shift 1.5 (pixels) --rotate 8 (degrees)\n");
+        fprintf(stderr, "              --scale 0.1 --morph 0.15 (dilation, same for erosion)\n");
+        fprintf(stderr, "              --noise 0.01 (pixels flipped). Setting one implies --augment.\n");
+        fprintf(stderr, "  --augment-threads N  Producer threads (default 0 = one per core)\n");
+        fprintf(stderr, "  --synthetic N   Add N glyphs rendered from the installed fonts (random\n");
+        fprintf(stderr, "              size, weight and margins, normalized like the exported letters)\n");
+        fprintf(stderr, "  --fonts F1,F2   Font families of --synthetic and generate (default: all)\n");
+        fprintf(stderr, "  --log FILE      Per-epoch time, samples/s, loss, validation and time by phase\n");
+        fprintf(stderr, "              (data, forward, backward, update, eval) to FILE: JSON if it ends\n");
+        fprintf(stderr, "              in .json, CSV otherwise\n");
+        fprintf(stderr, "\nCompression options (prune, distill; hidden_sizes like 64,32,16 give\n");
+        fprintf(stderr, "<output_file>_h64.bin etc., each pruned from the previous one):\n");
+        fprintf(stderr, "  --criterion C   Hidden units pruned first: lowest magnitude (default,\n");
+        fprintf(stderr, "              weights in x weights out) or activation (spread on the images)\n");
+        fprintf(stderr, "  --temperature T Softening of the teacher's probabilities (default 4)\n");
+        fprintf(stderr, "  --soft-weight A Share of the error from the teacher (default 0.7)\n");
+        fprintf(stderr, "  --target ACC    Point out the fastest model with ACC%% held-out accuracy\n");
         fprintf(stderr, "\nExamples:\n");
         fprintf(stderr, "  %s train ./dataset 1000 0.05 model.bin\n", argv[0]);
+        fprintf(stderr, "  %s train ./dataset 100 1.0 model.bin --batch 32 --threads 0 --seed 42\n", argv[0]);
+        fprintf(stderr, "  %s train ./dataset 30 0.005 model.bin --batch 32 --optimizer adam --schedule cosine --warmup 2\n", argv[0]);
         fprintf(stderr, "  %s continue ./dataset model.bin 500 0.01 model_improved.bin\n", argv[0]);
         fprintf(stderr, "  %s test ./dataset model.bin 20\n", argv[0]);
+        fprintf(stderr, "  %s prune ./dataset model.bin 64,32,16 5 0.005 small.bin --batch 32 --optimizer adam\n", argv[0]);
+        fprintf(stderr, "  %s distill ./dataset model.bin 32 30 0.005 student.bin --batch 32 --optimizer adam\n", argv[0]);
+        fprintf(stderr, "  %s pack ./dataset   (train/continue/test then skip image decoding)\n", argv[0]);
+        fprintf(stderr, "  %s generate ./synthetic 100000   (then train ./synthetic ...)\n", argv[0]);
+        fprintf(stderr, "  %s train ./dataset 30 0.005 model.bin --batch 32 --optimizer adam --synthetic 20000\n", argv[0]);
         fprintf(stderr, "  %s solve ./grid_images ./words_folder model.bin ./output\n", argv[0]);
         return 1;
     }
@@ -101,9 +729,9 @@ int main(int argc, char *argv[]) {
 
     if (strcmp(mode, "train") == 0) {
         // ========== MODE ENTRAÎNEMENT ==========
-        if (argc != 6) {
+        if (argc < 6) {
             fprintf(stderr, "Error: train mode requires 4 arguments\n");
-            fprintf(stderr, "Usage: %s train <dataset_folder> <epochs> <learning_rate> <output_file.bin>\n", argv[0]);
+            fprintf(stderr, "Usage: %s train <dataset_folder> <epochs> <learning_rate> <output_file.bin> [options]\n", argv[0]);
             return 1;
         }
 
@@ -112,6 +740,12 @@ int main(int argc, char *argv[]) {
         float learning_rate = atof(argv[4]);
         const char *output_file = argv[5];
 
+        TrainConfig config;
+        train_config_default(&config);
+        if (!parse_train_options(argc, argv, 6, &config)) return 1;
+        config.epochs = epochs;
+        config.learning_rate = learning_rate;
+
         if (epochs <= 0) {
             fprintf(stderr, "Error: epochs must be positive\n");
             return 1;
@@ -128,8 +762,9 @@ int main(int argc, char *argv[]) {
         printf("Max images per letter: %d\n\n", MAX_IMAGES_PER_LETTER);
 
         // Charger les images
-        ImageData *images;
+        GlyphSet images;
         int num_images = load_dataset(dataset_path, &images, MAX_IMAGES_PER_LETTER);
+        num_images = add_synthetic_glyphs(&images, &config);
 
         if (num_images == 0) {
             fprintf(stderr, "Error: No images loaded\n");
@@ -140,34 +775,37 @@ int main(int argc, char *argv[]) {
 
         // Mélanger le dataset
         printf("Shuffling dataset...\n");
-        shuffle_dataset(images, num_images);
+        shuffle_dataset(&images);
 
         // Créer le réseau
         printf("Creating network: %d -> %d -> %d\n", PIXEL_COUNT, HIDDEN_SIZE, NUM_CLASSES);
         Network *net = create_network(PIXEL_COUNT, HIDDEN_SIZE, NUM_CLASSES);
+        config.optimizer = training_optimizer(net, NULL);
 
         // Entraîner
-        train_network(net, images, num_images, epochs, learning_rate);
+        train_network(net, &images, &config);
 
         // Sauvegarder
         if (save_network(net, output_file)) {
             printf("\n✓ Model saved successfully!\n");
+            save_training_state(net, &config, output_file);
         } else {
             fprintf(stderr, "\n✗ Failed to save model\n");
         }
 
         // Tester
-        test_network(net, images, num_images, 10);
+        test_network(net, &images, 10);
 
         // Libérer la mémoire
-        free_images(images, num_images);
+        free_glyph_set(&images);
+        free_optimizer(config.optimizer);
         free_network(net);
 
     } else if (strcmp(mode, "continue") == 0) {
         // ========== MODE CONTINUATION ==========
-        if (argc != 7) {
+        if (argc < 7) {
             fprintf(stderr, "Error: continue mode requires 5 arguments\n");
-            fprintf(stderr, "Usage: %s continue <dataset_folder> <input_file.bin> <epochs> <learning_rate> <output_file.bin>\n", argv[0]);
+            fprintf(stderr, "Usage: %s continue <dataset_folder> <input_file.bin> <epochs> <learning_rate> <output_file.bin> [options]\n", argv[0]);
             return 1;
         }
 
@@ -177,6 +815,12 @@ int main(int argc, char *argv[]) {
         float learning_rate = atof(argv[5]);
         const char *output_file = argv[6];
 
+        TrainConfig config;
+        train_config_default(&config);
+        if (!parse_train_options(argc, argv, 7, &config)) return 1;
+        config.epochs = epochs;
+        config.learning_rate = learning_rate;
+
         if (epochs <= 0) {
             fprintf(stderr, "Error: epochs must be positive\n");
             return 1;
@@ -206,8 +850,9 @@ int main(int argc, char *argv[]) {
                net->input_size, net->hidden_size, net->output_size);
 
         // Charger les images
-        ImageData *images;
+        GlyphSet images;
         int num_images = load_dataset(dataset_path, &images, MAX_IMAGES_PER_LETTER);
+        num_images = add_synthetic_glyphs(&images, &config);
 
         if (num_images == 0) {
             fprintf(stderr, "Error: No images loaded\n");
@@ -219,23 +864,27 @@ int main(int argc, char *argv[]) {
 
         // Mélanger le dataset
         printf("Shuffling dataset...\n");
-        shuffle_dataset(images, num_images);
+        shuffle_dataset(&images);
 
         // Continuer l'entraînement
-        train_network(net, images, num_images, epochs, learning_rate);
+        config.optimizer = training_optimizer(net, input_file);
+        resume_schedule(&config);
+        train_network(net, &images, &config);
 
         // Sauvegarder le modèle amélioré
         if (save_network(net, output_file)) {
             printf("\n✓ Improved model saved successfully!\n");
+            save_training_state(net, &config, output_file);
         } else {
             fprintf(stderr, "\n✗ Failed to save model\n");
         }
 
         // Tester
-        test_network(net, images, num_images, 10);
+        test_network(net, &images, 10);
 
         // Libérer la mémoire
-        free_images(images, num_images);
+        free_glyph_set(&images);
+        free_optimizer(config.optimizer);
         free_network(net);
 
     } else if (strcmp(mode, "test") == 0) {
@@ -266,7 +915,7 @@ int main(int argc, char *argv[]) {
                net->input_size, net->hidden_size, net->output_size);
 
         // Charger les images
-        ImageData *images;
+        GlyphSet images;
         int num_images = load_dataset(dataset_path, &images, MAX_IMAGES_PER_LETTER);
 
         if (num_images == 0) {
@@ -278,10 +927,10 @@ int main(int argc, char *argv[]) {
         printf("Total images loaded: %d\n", num_images);
 
         // Tester
-        test_network(net, images, num_images, num_tests);
+        test_network(net, &images, num_tests);
 
         // Libérer la mémoire
-        free_images(images, num_images);
+        free_glyph_set(&images);
         free_network(net);
 
     } else if (strcmp(mode, "predict") == 0) {
@@ -492,9 +1141,515 @@ int main(int argc, char *argv[]) {
         free_words(words, num_words);
         free_network(net);
 
+    } else if (strcmp(mode, "quantize") == 0) {
+        // ========== MODE QUANTIFICATION ==========
+        if (argc != 6) {
+            fprintf(stderr, "Error: quantize mode requires 4 arguments\n");
+            fprintf(stderr, "Usage: %s quantize <heldout_folder> <model_file.bin> <f32|i8|bin> <output_file.bin>\n", argv[0]);
+            return 1;
+        }
+
+        const char *dataset_path = argv[2];
+        const char *model_file = argv[3];
+        const char *dtype_arg = argv[4];
+        const char *output_file = argv[5];
+
+        NNDtype dtype;
+        if (strcmp(dtype_arg, "f32") == 0) dtype = NN_DTYPE_F32;
+        else if (strcmp(dtype_arg, "i8") == 0) dtype = NN_DTYPE_I8;
+        else if (strcmp(dtype_arg, "bin") == 0) dtype = NN_DTYPE_BIN;
+        else {
+            fprintf(stderr, "Error: Unknown dtype '%s' (expected f32, i8 or bin)\n", dtype_arg);
+            return 1;
+        }
+
+        printf("=== Neural Network Quantization Mode ===\n");
+        printf("Held-out set: %s\n", dataset_path);
+        printf("Model file: %s\n", model_file);
+        printf("Target dtype: %s\n\n", nn_dtype_name(dtype));
+
+        Network *net = load_network(model_file);
+        if (!net) {
+            fprintf(stderr, "Error: Failed to load model\n");
+            return 1;
+        }
+
+        Network *quantized = quantize_network(net, dtype);
+        if (!quantized) {
+            free_network(net);
+            return 1;
+        }
+
+        GlyphSet images;
+        int num_images = load_dataset(dataset_path, &images, MAX_IMAGES_PER_LETTER);
+        if (num_images == 0) {
+            fprintf(stderr, "Error: No images loaded\n");
+            free_network(quantized);
+            free_network(net);
+            return 1;
+        }
+
+        // Compare both models on the same held-out images
+        int *reference = malloc(num_images * sizeof(int));
+        int *reduced = malloc(num_images * sizeof(int));
+        double acc_reference = dataset_accuracy(net, &images, reference);
+        double acc_reduced = dataset_accuracy(quantized, &images, reduced);
+
+        int changed = 0;
+        for (int i = 0; i < num_images; i++) {
+            if (reference[i] != reduced[i]) changed++;
+        }
+
+        printf("\n========================================\n");
+        printf("Images:            %d\n", num_images);
+        printf("Weights:           %zu KB -> %zu KB\n", weight_bytes(net) / 1024, weight_bytes(quantized) / 1024);
+        printf("Accuracy %-8s  %.2f%%\n", nn_dtype_name(net->dtype), acc_reference);
+        printf("Accuracy %-8s  %.2f%%\n", nn_dtype_name(dtype), acc_reduced);
+        printf("Delta:             %+.2f%%\n", acc_reduced - acc_reference);
+        printf("Changed answers:   %d\n", changed);
+        printf("========================================\n");
+
+        int saved = save_network(quantized, output_file);
+
+        free(reference);
+        free(reduced);
+        free_glyph_set(&images);
+        free_network(quantized);
+        free_network(net);
+        if (!saved) return 1;
+
+    } else if (strcmp(mode, "binarize") == 0) {
+        // ========== MODE BINARISATION (STRAIGHT-THROUGH ESTIMATOR) ==========
+        if (argc < 7) {
+            fprintf(stderr, "Error: binarize mode requires 5 arguments\n");
+            fprintf(stderr, "Usage: %s binarize <dataset_folder> <model_file.bin> <epochs> <learning_rate> <output_file.bin> [options]\n", argv[0]);
+            return 1;
+        }
+
+        const char *dataset_path = argv[2];
+        const char *model_file = argv[3];
+        int epochs = atoi(argv[4]);
+        float learning_rate = atof(argv[5]);
+        const char *output_file = argv[6];
+
+        TrainConfig config;
+        train_config_default(&config);
+        if (!parse_train_options(argc, argv, 7, &config)) return 1;
+        config.epochs = epochs;
+        config.learning_rate = learning_rate;
+
+        printf("=== Neural Network Binarization Mode ===\n");
+        printf("Dataset: %s\n", dataset_path);
+        printf("Starting model: %s\n", model_file);
+        printf("Epochs: %d\n", epochs);
+        printf("Learning rate: %.4f\n", learning_rate);
+        printf("Output: %s\n\n", output_file);
+
+        Network *net = load_network(model_file);
+        if (!net || net->dtype != NN_DTYPE_F64) {
+            fprintf(stderr, "Error: binarize needs a float64 model\n");
+            if (net) free_network(net);
+            return 1;
+        }
+
+        GlyphSet images;
+        int num_images = load_dataset(dataset_path, &images, MAX_IMAGES_PER_LETTER);
+        num_images = add_synthetic_glyphs(&images, &config);
+        if (num_images == 0) {
+            fprintf(stderr, "Error: No images loaded\n");
+            free_network(net);
+            return 1;
+        }
+
+        int *predictions = malloc(num_images * sizeof(int));
+        double acc_float = dataset_accuracy(net, &images, predictions);
+
+        // Fine-tune the float weights through the binarized first layer
+        // (0 epochs = plain post-training binarization)
+        set_binarized_training(net, 1);
+        printf("Binarized before fine-tuning: %.2f%%\n", dataset_accuracy(net, &images, predictions));
+        if (epochs > 0) {
+            shuffle_dataset(&images);
+            config.optimizer = training_optimizer(net, NULL);
+            train_network(net, &images, &config);
+            free_optimizer(config.optimizer);
+        }
+
+        Network *binary = quantize_network(net, NN_DTYPE_BIN);
+        double acc_binary = dataset_accuracy(binary, &images, predictions);
+
+        printf("\n========================================\n");
+        printf("Weights:           %zu KB -> %zu KB\n", weight_bytes(net) / 1024, weight_bytes(binary) / 1024);
+        printf("Accuracy float64   %.2f%%\n", acc_float);
+        printf("Accuracy binary    %.2f%%\n", acc_binary);
+        printf("Delta:             %+.2f%%\n", acc_binary - acc_float);
+        printf("========================================\n");
+
+        int saved = save_network(binary, output_file);
+
+        free(predictions);
+        free_glyph_set(&images);
+        free_network(binary);
+        free_network(net);
+        if (!saved) return 1;
+
+    } else if (strcmp(mode, "codegen") == 0) {
+        // ========== MODE GÉNÉRATION DE CODE ==========
+        if (argc != 4 && argc != 5) {
+            fprintf(stderr, "Error: codegen mode requires 2 or 3 arguments\n");
+            fprintf(stderr, "Usage: %s codegen <model_file.bin> <output_file.c> [name]\n", argv[0]);
+            return 1;
+        }
+
+        const char *model_file = argv[2];
+        const char *output_file = argv[3];
+        const char *name = (argc == 5) ? argv[4] : "model";
+
+        Network *net = load_network(model_file);
+        if (!net) {
+            fprintf(stderr, "Error: Failed to load model\n");
+            return 1;
+        }
+
+        int ok = export_network_c(net, output_file, name);
+        free_network(net);
+        if (!ok) return 1;
+
+    } else if (strcmp(mode, "convert") == 0) {
+        // ========== MODE CONVERSION (format v2) ==========
+        if (argc != 4) {
+            fprintf(stderr, "Error: convert mode requires 2 arguments\n");
+            fprintf(stderr, "Usage: %s convert <model_file.bin> <output_file.bin>\n", argv[0]);
+            return 1;
+        }
+
+        // Any readable model (v1 or v2) is written back in the current format
+        Network *net = load_network(argv[2]);
+        if (!net) {
+            fprintf(stderr, "Error: Failed to load model\n");
+            return 1;
+        }
+
+        int ok = save_network(net, argv[3]);
+        free_network(net);
+        if (!ok) return 1;
+
+    } else if (strcmp(mode, "pack") == 0) {
+        // ========== MODE CACHE DU DATASET ==========
+        if (argc != 3) {
+            fprintf(stderr, "Error: pack mode requires 1 argument\n");
+            fprintf(stderr, "Usage: %s pack <dataset_folder>\n", argv[0]);
+            return 1;
+        }
+
+        // load_dataset picks the pack up as long as the images don't change
+        if (!pack_dataset(argv[2])) return 1;
+
+    } else if (strcmp(mode, "generate") == 0) {
+        // ========== MODE GÉNÉRATION DE GLYPHES ==========
+        if (argc < 4) {
+            fprintf(stderr, "Error: generate mode requires 2 arguments\n");
+            fprintf(stderr, "Usage: %s generate <output_folder> <count> [--fonts F1,F2] [--seed S] [--threads N]\n", argv[0]);
+            return 1;
+        }
+
+        GlyphGenConfig gen;
+        glyph_gen_config_default(&gen);
+        gen.count = atoi(argv[3]);
+        gen.seed = (unsigned int)rand();
+        if (gen.count <= 0) {
+            fprintf(stderr, "Error: count must be positive\n");
+            return 1;
+        }
+        for (int i = 4; i < argc; i++) {
+            if (strcmp(argv[i], "--fonts") == 0 && i + 1 < argc) {
+                gen.fonts = argv[++i];
+            } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+                gen.seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+            } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+                gen.threads = atoi(argv[++i]);
+            } else {
+                fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+
+        // Written as a pack: train/continue/test read the folder like a dataset
+        if (g_mkdir_with_parents(argv[2], 0755) != 0) {
+            fprintf(stderr, "Error: Cannot create folder '%s'\n", argv[2]);
+            return 1;
+        }
+        GlyphSet glyphs = { 0 };
+        int ok = generate_glyphs(&gen, &glyphs) > 0 && save_dataset_pack(argv[2], &glyphs) > 0;
+        free_glyph_set(&glyphs);
+        if (!ok) return 1;
+
+    } else if (strcmp(mode, "prune") == 0 || strcmp(mode, "distill") == 0) {
+        // ========== MODES COMPRESSION (ÉLAGAGE, DISTILLATION) ==========
+        int distill = strcmp(mode, "distill") == 0;
+        if (argc < 8) {
+            fprintf(stderr, "Error: %s mode requires 6 arguments\n", mode);
+            fprintf(stderr, "Usage: %s %s <dataset_folder> <%s.bin> <hidden_sizes> <epochs> <learning_rate> <output_file.bin> [options]\n",
+                    argv[0], mode, distill ? "teacher" : "model_file");
+            return 1;
+        }
+
+        const char *dataset_path = argv[2];
+        const char *model_file = argv[3];
+        int epochs = atoi(argv[5]);
+        float learning_rate = atof(argv[6]);
+        const char *output_file = argv[7];
+
+        TrainConfig config;
+        train_config_default(&config);
+        if (!parse_train_options(argc, argv, 8, &config)) return 1;
+        config.epochs = epochs;
+        config.learning_rate = learning_rate;
+
+        if (epochs < (distill ? 1 : 0)) {
+            fprintf(stderr, "Error: epochs must be %s\n", distill ? "positive" : "0 or more");
+            return 1;
+        }
+
+        Network *net = load_network(model_file);
+        if (!net || (!distill && net->dtype != NN_DTYPE_F64)) {
+            fprintf(stderr, "Error: %s\n", net ? "prune needs a float64 model" : "Failed to load model");
+            if (net) free_network(net);
+            return 1;
+        }
+
+        size_t sizes[32];
+        int num_sizes = parse_hidden_sizes(argv[4], distill ? 0 : net->hidden_size, sizes, 32);
+        if (num_sizes == 0) {
+            free_network(net);
+            return 1;
+        }
+
+        printf("=== Neural Network %s Mode ===\n", distill ? "Distillation" : "Pruning");
+        printf("Dataset: %s\n", dataset_path);
+        printf("%s: %s (%zu hidden units)\n", distill ? "Teacher" : "Model", model_file, net->hidden_size);
+        if (distill) printf("Temperature: %.2f, soft target weight: %.2f\n", distill_temperature, distill_weight);
+        else printf("Criterion: %s, fine-tuning: %d epochs\n", nn_prune_criterion_name(prune_criterion), epochs);
+        printf("\n");
+
+        GlyphSet images;
+        int num_images = load_dataset(dataset_path, &images, MAX_IMAGES_PER_LETTER);
+        num_images = add_synthetic_glyphs(&images, &config);
+        if (num_images == 0) {
+            fprintf(stderr, "Error: No images loaded\n");
+            free_network(net);
+            return 1;
+        }
+        shuffle_dataset(&images);
+
+        // Models are compared on the images train_network holds out,
+        // pruning statistics and soft targets come from the others
+        int held_out = held_out_count(&images);
+        int num_train = held_out < num_images ? num_images - held_out : num_images;
+        TrainingExample *train_examples = glyph_examples(&images, 0, num_train);
+        TrainingExample *test_examples = glyph_examples(&images, num_images - held_out, held_out);
+
+        NNModelPoint *points = malloc((num_sizes + 1) * sizeof(NNModelPoint));
+        measure_model(net, test_examples, held_out, model_file, &points[0]);
+        points[0].weight_bytes = weight_bytes(net);
+
+        // Soft targets are indexed like the images, as train_network numbers them
+        float *soft_targets = NULL;
+        if (distill) {
+            soft_targets = teacher_soft_targets(net, train_examples, num_train, distill_temperature);
+            config.soft_targets = soft_targets;
+            config.temperature = distill_temperature;
+            config.soft_weight = distill_weight;
+        }
+
+        // Pruning goes down the sizes, each one from the previous fine-tuned model
+        Network *previous = net;
+        int num_points = 1, saved = 1;
+        for (int s = 0; s < num_sizes; s++) {
+            Network *model;
+            if (distill) {
+                model = create_network(PIXEL_COUNT, sizes[s], NUM_CLASSES);
+            } else {
+                model = prune_hidden_units(previous, sizes[s], prune_criterion, train_examples, num_train);
+                if (!model) {
+                    saved = 0;
+                    break;
+                }
+                NNModelPoint pruned;
+                measure_model(model, test_examples, held_out, "", &pruned);
+                printf("\nPruned to %zu hidden units: %.2f%% before fine-tuning\n", sizes[s], pruned.accuracy);
+            }
+
+            if (epochs > 0) {
+                config.optimizer = training_optimizer(model, NULL);
+                train_network(model, &images, &config);
+                free_optimizer(config.optimizer);
+                config.optimizer = NULL;
+            }
+
+            gchar *name = sized_model_name(output_file, sizes[s], num_sizes);
+            saved = save_network(model, name) && saved;
+            measure_model(model, test_examples, held_out, name, &points[num_points]);
+            points[num_points++].weight_bytes = weight_bytes(model);
+            g_free(name);
+
+            if (previous != net) free_network(previous);
+            previous = model;
+        }
+        if (previous != net) free_network(previous);
+
+        printf("\n=== Accuracy vs inference time (%d held-out images, 1 thread) ===\n", held_out);
+        print_pareto_table(points, num_points, target_accuracy);
+
+        free(points);
+        free(soft_targets);
+        free(train_examples);
+        free(test_examples);
+        free_glyph_set(&images);
+        free_network(net);
+        if (!saved) return 1;
+
+    } else if (strcmp(mode, "cascade") == 0) {
+        // ========== MODE CASCADE (PETIT MODÈLE, PUIS GRAND SI INCERTAIN) ==========
+        if (argc < 5) {
+            fprintf(stderr, "Error: cascade mode requires 3 arguments\n");
+            fprintf(stderr, "Usage: %s cascade <heldout_folder> <small_model.bin> <large_model.bin> [--threshold P]\n", argv[0]);
+            return 1;
+        }
+
+        // Default: a sweep of thresholds to choose from
+        double thresholds[] = { 0.5, 0.7, 0.8, 0.9, 0.95, 0.99 };
+        int num_thresholds = sizeof(thresholds) / sizeof(thresholds[0]);
+        for (int i = 5; i < argc; i++) {
+            if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+                thresholds[0] = atof(argv[++i]);
+                num_thresholds = 1;
+                if (thresholds[0] <= 0.0 || thresholds[0] > 1.0) {
+                    fprintf(stderr, "Error: --threshold must be in (0, 1]\n");
+                    fprintf(stderr, "Usage: %s cascade <heldout_folder> <small_model.bin> <large_model.bin> [--threshold P]\n", argv[0]);
+                    return 1;
+                }
+            } else {
+                fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+
+        Network *small = load_network(argv[3]);
+        Network *large = small ? load_network(argv[4]) : NULL;
+        if (!small || !large || large->input_size != small->input_size || large->output_size != small->output_size) {
+            fprintf(stderr, "Error: Need two loadable models of the same input and output sizes\n");
+            if (small) free_network(small);
+            if (large) free_network(large);
+            return 1;
+        }
+
+        GlyphSet images;
+        int num_images = load_dataset(argv[2], &images, MAX_IMAGES_PER_LETTER);
+        if (num_images == 0) {
+            fprintf(stderr, "Error: No images loaded\n");
+            free_network(small);
+            free_network(large);
+            return 1;
+        }
+
+        InferencePool *small_pool = inference_pool_new(small, 0);
+        InferencePool *large_pool = inference_pool_new(large, 0);
+        NNCascadeMetrics metrics;
+
+        printf("\n=== Cascade %s (%zu hidden) -> %s (%zu hidden), %d images ===\n",
+               argv[3], small->hidden_size, argv[4], large->hidden_size, num_images);
+        printf("%-18s %9s %10s %9s %10s\n", "Stage", "Accuracy", "Escalated", "Changed", "ns/glyph");
+        double accuracy = cascade_accuracy(small_pool, NULL, 0.0, &images, small->input_size, small->output_size, &metrics);
+        print_cascade_row("small only", accuracy, &metrics);
+        accuracy = cascade_accuracy(large_pool, NULL, 0.0, &images, large->input_size, large->output_size, &metrics);
+        print_cascade_row("large only", accuracy, &metrics);
+        for (int t = 0; t < num_thresholds; t++) {
+            char name[32];
+            snprintf(name, sizeof(name), "threshold %.2f", thresholds[t]);
+            accuracy = cascade_accuracy(small_pool, large_pool, thresholds[t], &images,
+                                        small->input_size, small->output_size, &metrics);
+            print_cascade_row(name, accuracy, &metrics);
+        }
+
+        inference_pool_free(small_pool);
+        inference_pool_free(large_pool);
+        free_glyph_set(&images);
+        free_network(small);
+        free_network(large);
+
+    } else if (strcmp(mode, "pareto") == 0) {
+        // ========== MODE COMPARAISON PRÉCISION / TEMPS ==========
+        if (argc < 4) {
+            fprintf(stderr, "Error: pareto mode requires at least 2 arguments\n");
+            fprintf(stderr, "Usage: %s pareto <heldout_folder> <model_file.bin>... [--target ACC]\n", argv[0]);
+            return 1;
+        }
+
+        GlyphSet images;
+        int num_images = load_dataset(argv[2], &images, MAX_IMAGES_PER_LETTER);
+        if (num_images == 0) {
+            fprintf(stderr, "Error: No images loaded\n");
+            return 1;
+        }
+        TrainingExample *examples = glyph_examples(&images, 0, num_images);
+
+        NNModelPoint *points = malloc(argc * sizeof(NNModelPoint));
+        int num_points = 0, failed = 0;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--target") == 0 && i + 1 < argc) {
+                target_accuracy = atof(argv[++i]);
+                continue;
+            }
+            Network *net = load_network(argv[i]);
+            if (!net) {
+                fprintf(stderr, "Error: Failed to load model '%s'\n", argv[i]);
+                failed = 1;
+                continue;
+            }
+            measure_model(net, examples, num_images, argv[i], &points[num_points]);
+            points[num_points++].weight_bytes = weight_bytes(net);
+            free_network(net);
+        }
+
+        printf("=== Accuracy vs inference time (%d images, 1 thread) ===\n", num_images);
+        print_pareto_table(points, num_points, target_accuracy);
+
+        free(points);
+        free(examples);
+        free_glyph_set(&images);
+        if (failed) return 1;
+
+    } else if (strcmp(mode, "selftest") == 0) {
+        // ========== MODE VÉRIFICATION DES KERNELS SIMD ==========
+        static const char *level_names[NN_SIMD_COUNT] = { "scalar", "sse2", "avx2+fma", "avx512f" };
+        int failures = 0;
+
+        printf("=== SIMD Kernel Self-Test ===\n");
+        printf("Selected kernels: %s\n\n", nn_kernels->name);
+
+        for (int level = 0; level < NN_SIMD_COUNT; level++) {
+            const NNKernels *k = nn_kernels_for((NNSimdLevel)level);
+            if (!k) {
+                printf("  %-10s not supported on this CPU\n", level_names[level]);
+                continue;
+            }
+
+            // Tolerance 16 eps: errors are in units of DBL_EPSILON (FLT_EPSILON for float kernels)
+            double max_error;
+            int ok = nn_kernels_check(k, 16.0, &max_error);
+            printf("  %-10s max error vs scalar: %5.2f eps  %s\n", k->name, max_error, ok ? "OK" : "FAILED");
+            if (!ok) failures++;
+        }
+
+        if (failures > 0) {
+            fprintf(stderr, "Error: %d kernel set(s) out of tolerance\n", failures);
+            return 1;
+        }
+
     } else {
         fprintf(stderr, "Error: Unknown mode '%s'\n", mode);
-        fprintf(stderr, "Valid modes: train, continue, test, predict, words\n");
+        fprintf(stderr, "Valid modes: train, continue, test, predict, words, quantize, binarize, prune, distill, pareto, cascade, codegen, convert, pack, generate, selftest\n");
         return 1;
     }
 
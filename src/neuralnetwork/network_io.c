@@ -1,41 +1,274 @@
 #include "network_io.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-int save_network(Network *net, const char *filename) {
-    FILE *file = fopen(filename, "wb");
-    if (!file) {
-        fprintf(stderr, "Error: Cannot open file '%s' for writing\n", filename);
-        return 0;
+// Current format (v2): a 64-byte header, a section table, then one section
+// per weight block, each starting on a 64-byte boundary and holding the
+// block exactly as it sits in memory (padded rows included). Loading maps
+// the file and points the network at the sections, nothing is copied.
+static const char MODEL_MAGIC[4] = { 'O', 'C', 'R', 'N' };
+#define MODEL_VERSION 2
+#define MODEL_MAX_SECTIONS 8
+
+// Largest layer a v1 (headerless) file is trusted to declare
+#define V1_MAX_LAYER (1 << 20)
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t dtype;
+    uint32_t layer_count;   // Weight layers, shape[l] -> shape[l + 1]
+    uint32_t shape[3];      // input, hidden, output
+    uint32_t section_count;
+    uint64_t file_size;
+    uint32_t payload_crc;   // CRC-32 of everything after the section table
+    uint32_t header_crc;    // CRC-32 of the header (this field at 0) and section table
+    uint8_t reserved[16];
+} ModelHeader;
+
+typedef struct {
+    uint32_t id;
+    uint32_t stride;        // Elements per row, 0 for vectors
+    uint64_t offset;
+    uint64_t size;          // Bytes, whole cache lines
+} ModelSection;
+
+_Static_assert(sizeof(ModelHeader) == NN_ALIGNMENT, "model header must fill one cache line");
+
+enum {
+    SECTION_BIAS_HIDDEN = 1,
+    SECTION_BIAS_OUTPUT,
+    SECTION_W_IH_F64,
+    SECTION_W_HO_F64,
+    SECTION_W_IH_F32,
+    SECTION_W_HO_F32,
+    SECTION_W_IH_I8,
+    SECTION_W_HO_I8,
+    SECTION_SCALE_HIDDEN,
+    SECTION_SCALE_OUTPUT,
+    SECTION_W_IH_BIN,
+    SECTION_ALPHA_HIDDEN
+};
+
+// One weight block of a network: where its pointer lives and how big it is
+typedef struct {
+    uint32_t id;
+    uint32_t stride;
+    void **block;
+    size_t size;
+} ModelBlock;
+
+static size_t align_up(size_t size) {
+    return (size + NN_ALIGNMENT - 1) / NN_ALIGNMENT * NN_ALIGNMENT;
+}
+
+static void add_block(ModelBlock *blocks, size_t *count, uint32_t id, void *block,
+                      size_t rows, size_t stride, size_t elem_size, int is_matrix) {
+    blocks[*count] = (ModelBlock){ id, is_matrix ? (uint32_t)stride : 0,
+                                   (void**)block, align_up(rows * stride * elem_size) };
+    (*count)++;
+}
+
+// Blocks stored for the network's dtype, in file order
+static size_t model_blocks(Network *net, ModelBlock *blocks) {
+    size_t count = 0;
+    size_t in = net->input_size, hid = net->hidden_size, out = net->output_size;
+
+    add_block(blocks, &count, SECTION_BIAS_HIDDEN, &net->bias_hidden, 1, hid, sizeof(double), 0);
+    add_block(blocks, &count, SECTION_BIAS_OUTPUT, &net->bias_output, 1, out, sizeof(double), 0);
+    switch (net->dtype) {
+    case NN_DTYPE_F32:
+        add_block(blocks, &count, SECTION_W_IH_F32, &net->w_input_hidden_f32, in, net->hidden_stride, sizeof(float), 1);
+        add_block(blocks, &count, SECTION_W_HO_F32, &net->w_hidden_output_f32, hid, net->output_stride, sizeof(float), 1);
+        break;
+    case NN_DTYPE_I8:
+        add_block(blocks, &count, SECTION_W_IH_I8, &net->w_input_hidden_i8, in, net->hidden_stride, 1, 1);
+        add_block(blocks, &count, SECTION_W_HO_I8, &net->w_hidden_output_i8, hid, net->output_stride, 1, 1);
+        add_block(blocks, &count, SECTION_SCALE_HIDDEN, &net->scale_hidden, 1, hid, sizeof(float), 0);
+        add_block(blocks, &count, SECTION_SCALE_OUTPUT, &net->scale_output, 1, out, sizeof(float), 0);
+        break;
+    case NN_DTYPE_BIN:
+        add_block(blocks, &count, SECTION_W_IH_BIN, &net->w_input_hidden_bin, hid, NN_PACKED_WORDS(in), sizeof(uint64_t), 1);
+        add_block(blocks, &count, SECTION_ALPHA_HIDDEN, &net->alpha_hidden, 1, hid, sizeof(double), 0);
+        add_block(blocks, &count, SECTION_W_HO_F64, &net->w_hidden_output, hid, net->output_stride, sizeof(double), 1);
+        break;
+    default:
+        add_block(blocks, &count, SECTION_W_IH_F64, &net->w_input_hidden, in, net->hidden_stride, sizeof(double), 1);
+        add_block(blocks, &count, SECTION_W_HO_F64, &net->w_hidden_output, hid, net->output_stride, sizeof(double), 1);
+        break;
+    }
+    return count;
+}
+
+// CRC-32 (IEEE 802.3, reflected), table built on first use
+static uint32_t crc32_update(uint32_t crc, const void *data, size_t size) {
+    static uint32_t table[256];
+    if (!table[1]) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
     }
 
-    // Write data of size of 4 bytes
-    int input = (int)net->input_size;
-    int hidden = (int)net->hidden_size;
-    int output = (int)net->output_size;
+    const unsigned char *bytes = (const unsigned char*)data;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
 
-    fwrite(&input, sizeof(int), 1, file);
-    fwrite(&hidden, sizeof(int), 1, file);
-    fwrite(&output, sizeof(int), 1, file);
+static size_t payload_start(size_t section_count) {
+    return align_up(sizeof(ModelHeader) + section_count * sizeof(ModelSection));
+}
 
+static uint32_t header_crc(const ModelHeader *header, const ModelSection *sections) {
+    ModelHeader copy = *header;
+    copy.header_crc = 0;
+    uint32_t crc = crc32_update(0, &copy, sizeof(copy));
+    return crc32_update(crc, sections, header->section_count * sizeof(ModelSection));
+}
 
-    // Write first layer (input)
-    for (size_t i = 0; i < net->input_size; i++) {
-        fwrite(net->weights_input_hidden[i], sizeof(double), net->hidden_size, file);
+// The whole file is assembled in memory and written at once
+static int save_v2(Network *net, FILE *file) {
+    ModelBlock blocks[MODEL_MAX_SECTIONS] = { 0 };
+    size_t count = model_blocks(net, blocks);
+
+    size_t size = payload_start(count);
+    for (size_t i = 0; i < count; i++) size += blocks[i].size;
+
+    unsigned char *image = aligned_alloc(NN_ALIGNMENT, size);
+    if (!image) return 0;
+    memset(image, 0, size);
+
+    ModelHeader *header = (ModelHeader*)image;
+    ModelSection *sections = (ModelSection*)(image + sizeof(ModelHeader));
+    memcpy(header->magic, MODEL_MAGIC, sizeof(MODEL_MAGIC));
+    header->version = MODEL_VERSION;
+    header->dtype = (uint32_t)net->dtype;
+    header->layer_count = 2;
+    header->shape[0] = (uint32_t)net->input_size;
+    header->shape[1] = (uint32_t)net->hidden_size;
+    header->shape[2] = (uint32_t)net->output_size;
+    header->section_count = (uint32_t)count;
+    header->file_size = size;
+
+    size_t offset = payload_start(count);
+    for (size_t i = 0; i < count; i++) {
+        sections[i] = (ModelSection){ blocks[i].id, blocks[i].stride, offset, blocks[i].size };
+        memcpy(image + offset, *blocks[i].block, blocks[i].size);
+        offset += blocks[i].size;
     }
 
-    // Second layer (hidden)
-    for (size_t i = 0; i < net->hidden_size; i++) {
-        fwrite(net->weights_hidden_output[i], sizeof(double), net->output_size, file);
+    header->payload_crc = crc32_update(0, image + payload_start(count), size - payload_start(count));
+    header->header_crc = header_crc(header, sections);
+
+    int ok = fwrite(image, 1, size, file) == size;
+    free(image);
+    return ok;
+}
+
+// Network whose blocks point into a v2 image (not copied, not owned). The
+// header checksum is always checked, the payload one (which reads every
+// page) only with verify_payload.
+static Network *network_from_image(const unsigned char *image, size_t size, int verify_payload) {
+    const ModelHeader *header = (const ModelHeader*)image;
+    const ModelSection *sections = (const ModelSection*)(image + sizeof(ModelHeader));
+    if (size < sizeof(ModelHeader) || memcmp(header->magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)) != 0) {
+        fprintf(stderr, "Error: Not a v2 model\n");
+        return NULL;
+    }
+    if ((uintptr_t)image % NN_ALIGNMENT != 0) {
+        fprintf(stderr, "Error: Model image is not %d-byte aligned\n", NN_ALIGNMENT);
+        return NULL;
+    }
+    if (header->version != MODEL_VERSION || header->dtype > NN_DTYPE_BIN || header->layer_count != 2 ||
+        header->shape[0] == 0 || header->shape[1] == 0 || header->shape[2] == 0 ||
+        header->section_count > MODEL_MAX_SECTIONS || header->file_size != size ||
+        payload_start(header->section_count) > size) {
+        fprintf(stderr, "Error: Unsupported model (version %u, dtype %u)\n", header->version, header->dtype);
+        return NULL;
+    }
+    if (header->header_crc != header_crc(header, sections)) {
+        fprintf(stderr, "Error: Corrupted model header (CRC mismatch)\n");
+        return NULL;
     }
+    if (verify_payload) {
+        size_t start = payload_start(header->section_count);
+        if (header->payload_crc != crc32_update(0, image + start, size - start)) {
+            fprintf(stderr, "Error: Corrupted model weights (CRC mismatch)\n");
+            return NULL;
+        }
+    }
+
+    Network *net = create_network_shell(header->shape[0], header->shape[1], header->shape[2], (NNDtype)header->dtype);
+    net->mapping = (void*)image;
+    net->mapping_size = size;
+
+    // Sections must be exactly the blocks this dtype and these strides expect
+    ModelBlock blocks[MODEL_MAX_SECTIONS] = { 0 };
+    size_t count = model_blocks(net, blocks);
+    int ok = count == header->section_count;
+    for (size_t i = 0; ok && i < count; i++) {
+        const ModelSection *s = &sections[i];
+        ok = s->id == blocks[i].id && s->stride == blocks[i].stride && s->size == blocks[i].size &&
+             s->offset % NN_ALIGNMENT == 0 && s->offset >= payload_start(count) &&
+             s->offset <= size && s->size <= size - s->offset;
+        if (ok) *blocks[i].block = (void*)(image + s->offset);
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: Model sections don't match a %s network\n", nn_dtype_name(net->dtype));
+        free_network(net);
+        return NULL;
+    }
+
+    link_network_rows(net);
+    return net;
+}
+
+// Maps the file privately: pages are loaded on first use and shared with
+// every other process mapping the same model until one of them writes
+// (training after `continue`), which then gets its own copy.
+// OCR_MODEL_VERIFY=0 skips the payload checksum.
+static Network *load_v2(FILE *file) {
+    struct stat st;
+    if (fstat(fileno(file), &st) != 0 || (size_t)st.st_size < sizeof(ModelHeader)) {
+        fprintf(stderr, "Error: Truncated model header\n");
+        return NULL;
+    }
+
+    size_t size = (size_t)st.st_size;
+    unsigned char *image = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(file), 0);
+    if (image == MAP_FAILED) {
+        perror("Error: Cannot map model file");
+        return NULL;
+    }
+
+    const char *verify = getenv("OCR_MODEL_VERIFY");
+    Network *net = network_from_image(image, size, !(verify && strcmp(verify, "0") == 0));
+    if (!net) {
+        munmap(image, size);
+        return NULL;
+    }
+    net->mapping_owned = 1;
+    return net;
+}
 
-    // Thrid layer (output)
-    fwrite(net->bias_hidden, sizeof(double), net->hidden_size, file);
-    fwrite(net->bias_output, sizeof(double), net->output_size, file);
+int save_network(Network *net, const char *filename) {
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open file '%s' for writing\n", filename);
+        return 0;
+    }
 
+    int ok = save_v2(net, file);
     fclose(file);
-    printf("Network saved to '%s'\n", filename);
-    return 1;
+    if (ok) printf("Network saved to '%s' (%s)\n", filename, nn_dtype_name(net->dtype));
+    else fprintf(stderr, "Error: Failed to write '%s'\n", filename);
+    return ok;
 }
 
 Network* load_network(const char *filename) {
@@ -45,6 +278,20 @@ Network* load_network(const char *filename) {
         return NULL;
     }
 
+    // v2 models carry a magic, v1 ones (float64 only, read only) start with the sizes
+    char magic[4];
+    int has_magic = fread(magic, 1, sizeof(magic), file) == sizeof(magic);
+    if (has_magic && memcmp(magic, MODEL_MAGIC, sizeof(magic)) == 0) {
+        Network *net = load_v2(file);
+        fclose(file);
+        if (net) {
+            printf("Network loaded from '%s' (Architecture: %zu -> %zu -> %zu, %s)\n",
+                   filename, net->input_size, net->hidden_size, net->output_size, nn_dtype_name(net->dtype));
+        }
+        return net;
+    }
+    rewind(file);
+
     // Incompatibility problems when reading/writing size_t data so we use int
     int input, hidden, output;
     
@@ -56,6 +303,12 @@ Network* load_network(const char *filename) {
         fclose(file);
         return NULL;
     }
+    if (input <= 0 || hidden <= 0 || output <= 0 ||
+        input > V1_MAX_LAYER || hidden > V1_MAX_LAYER || output > V1_MAX_LAYER) {
+        fprintf(stderr, "Error: '%s' is not a model file (sizes %d, %d, %d)\n", filename, input, hidden, output);
+        fclose(file);
+        return NULL;
+    }
 
     // Recreate network with parsed data
     Network *net = create_network((size_t)input, (size_t)hidden, (size_t)output);
@@ -98,3 +351,299 @@ Network* load_network(const char *filename) {
            filename, input, hidden, output);
     return net;
 }
+
+static Network *network_from_memory(const void *data, size_t size, int verify_payload) {
+    Network *net = network_from_image(data, size, verify_payload);
+    if (net) {
+        net->read_only = 1;
+        printf("Network loaded from memory (Architecture: %zu -> %zu -> %zu, %s)\n",
+               net->input_size, net->hidden_size, net->output_size, nn_dtype_name(net->dtype));
+    }
+    return net;
+}
+
+Network* load_network_from_memory(const void *data, size_t size) {
+    return network_from_memory(data, size, 1);
+}
+
+// Optimizer state: a 128-byte header, then the moment blocks exactly as in
+// memory, first moments in NN_OPT_* order, then the second moments (Adam)
+static const char OPTIMIZER_MAGIC[4] = { 'O', 'C', 'R', 'O' };
+#define OPTIMIZER_VERSION 2
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t kind;
+    uint32_t shape[3];      // input, hidden, output of the network
+    uint32_t epoch;
+    uint32_t payload_crc;   // CRC-32 of the moment blocks
+    uint64_t step;
+    double beta1;
+    double beta2;
+    double epsilon;
+    // Learning-rate schedule (NNOptimizer)
+    uint32_t schedule;
+    uint32_t warmup_epochs;
+    uint32_t schedule_epochs;
+    uint32_t step_epochs;
+    double learning_rate;
+    double step_gamma;
+    uint8_t reserved[32];
+} OptimizerHeader;
+
+_Static_assert(sizeof(OptimizerHeader) == 2 * NN_ALIGNMENT, "optimizer header must fill two cache lines");
+
+// Moment blocks of the optimizer in file order, ids[i] is the NN_OPT_*
+// block that blocks[i] follows
+static size_t optimizer_blocks(const NNOptimizer *opt, double **blocks, int *ids) {
+    size_t count = 0;
+    for (int b = 0; b < NN_OPT_BLOCKS; b++) {
+        if (opt->m[b]) { blocks[count] = opt->m[b]; ids[count++] = b; }
+    }
+    for (int b = 0; b < NN_OPT_BLOCKS; b++) {
+        if (opt->v[b]) { blocks[count] = opt->v[b]; ids[count++] = b; }
+    }
+    return count;
+}
+
+int save_optimizer(const NNOptimizer *opt, const Network *net, const char *filename) {
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open file '%s' for writing\n", filename);
+        return 0;
+    }
+
+    double *blocks[2 * NN_OPT_BLOCKS];
+    int ids[2 * NN_OPT_BLOCKS];
+    size_t count = optimizer_blocks(opt, blocks, ids);
+
+    OptimizerHeader header = { 0 };
+    memcpy(header.magic, OPTIMIZER_MAGIC, sizeof(OPTIMIZER_MAGIC));
+    header.version = OPTIMIZER_VERSION;
+    header.kind = (uint32_t)opt->kind;
+    header.shape[0] = (uint32_t)net->input_size;
+    header.shape[1] = (uint32_t)net->hidden_size;
+    header.shape[2] = (uint32_t)net->output_size;
+    header.epoch = (uint32_t)opt->epoch;
+    header.step = opt->step;
+    header.beta1 = opt->beta1;
+    header.beta2 = opt->beta2;
+    header.epsilon = opt->epsilon;
+    header.schedule = (uint32_t)opt->schedule;
+    header.warmup_epochs = (uint32_t)opt->warmup_epochs;
+    header.schedule_epochs = (uint32_t)opt->schedule_epochs;
+    header.step_epochs = (uint32_t)opt->step_epochs;
+    header.learning_rate = opt->learning_rate;
+    header.step_gamma = opt->step_gamma;
+    for (size_t i = 0; i < count; i++) {
+        header.payload_crc = crc32_update(header.payload_crc, blocks[i],
+                                          optimizer_block_size(net, ids[i]) * sizeof(double));
+    }
+
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (size_t i = 0; ok && i < count; i++) {
+        size_t n = optimizer_block_size(net, ids[i]);
+        ok = fwrite(blocks[i], sizeof(double), n, file) == n;
+    }
+    fclose(file);
+    if (ok) printf("Optimizer state saved to '%s' (%s, epoch %d)\n", filename, nn_optimizer_name(opt->kind), opt->epoch);
+    else fprintf(stderr, "Error: Failed to write '%s'\n", filename);
+    return ok;
+}
+
+NNOptimizer *load_optimizer(const Network *net, const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open file '%s' for reading\n", filename);
+        return NULL;
+    }
+
+    OptimizerHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, OPTIMIZER_MAGIC, sizeof(OPTIMIZER_MAGIC)) != 0 ||
+        header.version != OPTIMIZER_VERSION || header.kind > NN_OPTIMIZER_ADAM ||
+        header.schedule > NN_SCHEDULE_STEP) {
+        fprintf(stderr, "Error: '%s' is not an optimizer state\n", filename);
+        fclose(file);
+        return NULL;
+    }
+    if (header.shape[0] != net->input_size || header.shape[1] != net->hidden_size ||
+        header.shape[2] != net->output_size) {
+        fprintf(stderr, "Error: Optimizer state '%s' is for a %u -> %u -> %u network\n",
+                filename, header.shape[0], header.shape[1], header.shape[2]);
+        fclose(file);
+        return NULL;
+    }
+
+    NNOptimizer *opt = create_optimizer(net, (NNOptimizerKind)header.kind);
+    opt->epoch = (int)header.epoch;
+    opt->step = header.step;
+    opt->beta1 = header.beta1;
+    opt->beta2 = header.beta2;
+    opt->epsilon = header.epsilon;
+    opt->schedule = (NNSchedule)header.schedule;
+    opt->warmup_epochs = (int)header.warmup_epochs;
+    opt->schedule_epochs = (int)header.schedule_epochs;
+    opt->step_epochs = (int)header.step_epochs;
+    opt->learning_rate = header.learning_rate;
+    opt->step_gamma = header.step_gamma;
+
+    double *blocks[2 * NN_OPT_BLOCKS];
+    int ids[2 * NN_OPT_BLOCKS];
+    size_t count = optimizer_blocks(opt, blocks, ids);
+    uint32_t crc = 0;
+    int ok = 1;
+    for (size_t i = 0; ok && i < count; i++) {
+        size_t n = optimizer_block_size(net, ids[i]);
+        ok = fread(blocks[i], sizeof(double), n, file) == n;
+        if (ok) crc = crc32_update(crc, blocks[i], n * sizeof(double));
+    }
+    fclose(file);
+    if (!ok || crc != header.payload_crc) {
+        fprintf(stderr, "Error: %s optimizer state '%s'\n", ok ? "Corrupted" : "Truncated", filename);
+        free_optimizer(opt);
+        return NULL;
+    }
+
+    printf("Optimizer state loaded from '%s' (%s, %d epochs, %llu updates)\n", filename,
+           nn_optimizer_name(opt->kind), opt->epoch, (unsigned long long)opt->step);
+    return opt;
+}
+
+// Defined by embedded_model.S when the executable is built with EMBED_MODEL=1
+extern const unsigned char nn_embedded_model[] __attribute__((weak));
+extern const unsigned char nn_embedded_model_end[] __attribute__((weak));
+
+int has_embedded_network(void) {
+    return nn_embedded_model != NULL;
+}
+
+Network* load_embedded_network(void) {
+    if (!has_embedded_network()) {
+        fprintf(stderr, "Error: No model embedded in this executable\n");
+        return NULL;
+    }
+    // `convert` checked the weights when the model was built, and they sit
+    // in a read-only section: only the header is checked, so startup stays
+    // page-ins of the weights actually used
+    return network_from_memory(nn_embedded_model, (size_t)(nn_embedded_model_end - nn_embedded_model), 0);
+}
+
+// Rows of `cols` doubles, 4 per line, exact round-trip formatting
+static void write_c_matrix(FILE *file, const double *data, size_t stride, size_t rows, size_t cols) {
+    for (size_t j = 0; j < rows; j++) {
+        fprintf(file, "    {");
+        for (size_t i = 0; i < cols; i++) {
+            if (i % 4 == 0) fprintf(file, "\n        ");
+            fprintf(file, "%.17g,%s", data[j * stride + i], (i % 4 == 3 || i + 1 == cols) ? "" : " ");
+        }
+        fprintf(file, "\n    },\n");
+    }
+}
+
+static void write_c_vector(FILE *file, const double *data, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (i % 4 == 0) fprintf(file, "%s    ", i ? "\n" : "");
+        fprintf(file, "%.17g,%s", data[i], (i % 4 == 3 || i + 1 == count) ? "" : " ");
+    }
+    fprintf(file, "\n");
+}
+
+int export_network_c(Network *net, const char *filename, const char *name) {
+    if (net->dtype != NN_DTYPE_F64) {
+        fprintf(stderr, "Error: Only float64 models can be turned into C code\n");
+        return 0;
+    }
+
+    // The name ends up in a C identifier
+    for (const char *c = name; *c; c++) {
+        if (!(isalnum((unsigned char)*c) || *c == '_') || (c == name && isdigit((unsigned char)*c))) {
+            fprintf(stderr, "Error: '%s' is not a valid C identifier\n", name);
+            return 0;
+        }
+    }
+
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open file '%s' for writing\n", filename);
+        return 0;
+    }
+
+    size_t in = net->input_size, hid = net->hidden_size, out = net->output_size;
+    unsigned long long fingerprint = (unsigned long long)nn_fingerprint(net);
+
+    fprintf(file,
+        "// Generated by `ocr_trainer codegen` from a %zu -> %zu -> %zu model, do not edit.\n"
+        "// Fingerprint 0x%016llx: nn_attach_generated() only uses this code for\n"
+        "// the exact weights it was generated from.\n"
+        "#include \"neural_network.h\"\n"
+        "#include <math.h>\n"
+        "#include <string.h>\n\n"
+        "#define IN %zu\n#define HID %zu\n#define OUT %zu\n\n"
+        "// The file is built for the baseline ISA: the forward is cloned for\n"
+        "// AVX-512 and AVX2, the loader picks the clone for the running CPU\n"
+        "#if defined(__x86_64__)\n"
+        "#define FORWARD_CLONES __attribute__((target_clones(\"avx512f\", \"avx2\", \"default\")))\n"
+        "#else\n"
+        "#define FORWARD_CLONES\n"
+        "#endif\n\n",
+        in, hid, out, fingerprint, in, hid, out);
+
+    fprintf(file, "static const double w_ih[IN][HID] __attribute__((aligned(64))) = {\n");
+    write_c_matrix(file, net->w_input_hidden, net->hidden_stride, in, hid);
+    fprintf(file, "};\n\nstatic const double w_ho[HID][OUT] __attribute__((aligned(64))) = {\n");
+    write_c_matrix(file, net->w_hidden_output, net->output_stride, hid, out);
+    fprintf(file, "};\n\nstatic const double b_h[HID] __attribute__((aligned(64))) = {\n");
+    write_c_vector(file, net->bias_hidden, hid);
+    fprintf(file, "};\n\nstatic const double b_o[OUT] __attribute__((aligned(64))) = {\n");
+    write_c_vector(file, net->bias_output, out);
+    fprintf(file, "};\n\n");
+
+    // Same summation order as forward() with the scalar kernels
+    fprintf(file,
+        "FORWARD_CLONES\n"
+        "double *forward_%s(const double *input, double *hidden, double *output) {\n"
+        "    double h[HID] __attribute__((aligned(64)));\n"
+        "    double o[OUT];\n"
+        "    memcpy(h, b_h, sizeof(h));\n\n"
+        "    // Input -> hidden: the constant trip count lets the compiler unroll the\n"
+        "    // inner loop into whole vectors and keep the accumulators in registers\n"
+        "    // for the whole input loop, zero pixels are skipped\n"
+        "    for (int j = 0; j < IN; j++) {\n"
+        "        const double x = input[j];\n"
+        "        if (x == 0.0) continue;\n"
+        "        for (int i = 0; i < HID; i++) h[i] += x * w_ih[j][i];\n"
+        "    }\n\n"
+        "    for (int i = 0; i < HID; i++) hidden[i] = 1.0 / (1.0 + exp(-h[i]));\n\n"
+        "    memcpy(o, b_o, sizeof(o));\n"
+        "    for (int j = 0; j < HID; j++) {\n"
+        "        const double a = hidden[j];\n"
+        "        for (int i = 0; i < OUT; i++) o[i] += a * w_ho[j][i];\n"
+        "    }\n\n",
+        name);
+
+    if (out == 1) {
+        fprintf(file, "    output[0] = 1.0 / (1.0 + exp(-o[0]));\n");
+    } else {
+        fprintf(file,
+            "    double max_val = o[0];\n"
+            "    for (int i = 1; i < OUT; i++) if (o[i] > max_val) max_val = o[i];\n"
+            "    double sum = 0.0;\n"
+            "    for (int i = 0; i < OUT; i++) { output[i] = exp(o[i] - max_val); sum += output[i]; }\n"
+            "    for (int i = 0; i < OUT; i++) output[i] /= sum;\n");
+    }
+
+    fprintf(file,
+        "    return output;\n"
+        "}\n\n"
+        "const NNGeneratedModel nn_generated_model = {\n"
+        "    \"%s\", IN, HID, OUT, 0x%016llxULL, forward_%s\n"
+        "};\n",
+        name, fingerprint, name);
+
+    int ok = !ferror(file);
+    fclose(file);
+    if (ok) printf("C code for '%s' written to '%s' (fingerprint 0x%016llx)\n", name, filename, fingerprint);
+    return ok;
+}
@@ -7,4 +7,28 @@ int save_network(Network *net, const char *filename);
 
 Network* load_network(const char *filename);
 
+// Network over a v2 model image already in memory (64-byte aligned). The
+// weights are used in place: the image must outlive the network, which is
+// marked read-only (training refuses it, see nn_trainable).
+Network* load_network_from_memory(const void *data, size_t size);
+
+// Optimizer state of a training run, kept next to its model
+// (NN_OPTIMIZER_SUFFIX appended to the model's name) so that `continue`
+// resumes the moments, the update count and the schedule where they were.
+// load_optimizer checks the state is for a network of net's shape.
+#define NN_OPTIMIZER_SUFFIX ".opt"
+int save_optimizer(const NNOptimizer *opt, const Network *net, const char *filename);
+NNOptimizer* load_optimizer(const Network *net, const char *filename);
+
+// Model linked into the executable by `make EMBED_MODEL=1`, read-only. Only
+// its header checksum is checked at load time, the weights were at build time.
+int has_embedded_network(void);
+Network* load_embedded_network(void);
+
+// C source of a float64 model with compile-time dimensions and its weights
+// as static const arrays, defining forward_<name>() and nn_generated_model.
+// On x86-64 the forward is cloned for AVX-512, AVX2 and the baseline, so the
+// file builds for any CPU of the target and runs the best clone at load time.
+int export_network_c(Network *net, const char *filename, const char *name);
+
 #endif
@@ -1,40 +1,325 @@
 #include "neural_network.h" 
+#include "nn_kernels.h"
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
 
 // Sigmoid function, useful for manipulating weights in the neural network
 double sigmoid(double x) {
     return 1.0 / (1.0 + exp(-x));
 }
 
-Network *create_network(size_t input, size_t hidden, size_t output) {
+// Round a number of elements up to a whole number of cache lines
+static size_t padded_elements(size_t count, size_t elem_size) {
+    size_t per_line = NN_ALIGNMENT / elem_size;
+    return (count + per_line - 1) / per_line * per_line;
+}
 
-    // Initialize network fromthe parameters
-    Network *net = (Network *)malloc(sizeof(Network));
+// Round a number of doubles up to a whole number of cache lines
+size_t nn_padded_size(size_t count) {
+    return padded_elements(count, sizeof(double));
+}
+
+// Zeroed, 64-byte aligned block
+static void *alloc_aligned_bytes(size_t bytes) {
+    bytes = padded_elements(bytes, 1);
+    void *data = aligned_alloc(NN_ALIGNMENT, bytes ? bytes : NN_ALIGNMENT);
+    if (data) memset(data, 0, bytes);
+    return data;
+}
+
+// Zeroed, 64-byte aligned array of doubles
+static double *alloc_aligned(size_t count) {
+    return alloc_aligned_bytes(count * sizeof(double));
+}
+
+Network *create_network_shell(size_t input, size_t hidden, size_t output, NNDtype dtype) {
+    Network *net = (Network *)calloc(1, sizeof(Network));
     net->input_size = input;
     net->hidden_size = hidden;
     net->output_size = output;
+    net->dtype = dtype;
 
-    net->weights_input_hidden = malloc(input * sizeof(double*));
-    for (size_t i = 0; i < input; i++) {
-        net->weights_input_hidden[i] = malloc(hidden * sizeof(double));
+    // Strides count elements of the dtype's matrices, binary models keep
+    // their second layer in float64
+    switch (dtype) {
+    case NN_DTYPE_F32:
+        net->hidden_stride = padded_elements(hidden, sizeof(float));
+        net->output_stride = padded_elements(output, sizeof(float));
+        break;
+    case NN_DTYPE_I8:
+        net->hidden_stride = padded_elements(hidden, sizeof(int8_t));
+        net->output_stride = padded_elements(output, sizeof(int8_t));
+        break;
+    default:
+        net->hidden_stride = nn_padded_size(hidden);
+        net->output_stride = nn_padded_size(output);
+        break;
     }
-    
-    net->weights_hidden_output = malloc(hidden * sizeof(double*));
-    for (size_t i = 0; i < hidden; i++) {
-        net->weights_hidden_output[i] = malloc(output * sizeof(double));
+    return net;
+}
+
+void link_network_rows(Network *net) {
+    if (net->w_input_hidden) {
+        free(net->weights_input_hidden);
+        net->weights_input_hidden = malloc(net->input_size * sizeof(double*));
+        for (size_t i = 0; i < net->input_size; i++) {
+            net->weights_input_hidden[i] = net->w_input_hidden + i * net->hidden_stride;
+        }
     }
-    
-    net->bias_hidden = (double *)malloc(hidden * sizeof(double));
-    net->bias_output = (double *)malloc(output * sizeof(double));
+    if (net->w_hidden_output) {
+        free(net->weights_hidden_output);
+        net->weights_hidden_output = malloc(net->hidden_size * sizeof(double*));
+        for (size_t i = 0; i < net->hidden_size; i++) {
+            net->weights_hidden_output[i] = net->w_hidden_output + i * net->output_stride;
+        }
+    }
+}
+
+Network *create_network_dtype(size_t input, size_t hidden, size_t output, NNDtype dtype) {
+
+    // Initialize network fromthe parameters
+    Network *net = create_network_shell(input, hidden, output, dtype);
+
+    // One block per matrix instead of one malloc per row
+    switch (dtype) {
+    case NN_DTYPE_F32:
+        net->w_input_hidden_f32 = alloc_aligned_bytes(input * net->hidden_stride * sizeof(float));
+        net->w_hidden_output_f32 = alloc_aligned_bytes(hidden * net->output_stride * sizeof(float));
+        break;
+
+    case NN_DTYPE_I8:
+        net->w_input_hidden_i8 = alloc_aligned_bytes(input * net->hidden_stride);
+        net->w_hidden_output_i8 = alloc_aligned_bytes(hidden * net->output_stride);
+        net->scale_hidden = alloc_aligned_bytes(hidden * sizeof(float));
+        net->scale_output = alloc_aligned_bytes(output * sizeof(float));
+        break;
+
+    case NN_DTYPE_BIN:
+        net->w_input_hidden_bin = alloc_aligned_bytes(hidden * NN_PACKED_WORDS(input) * sizeof(uint64_t));
+        net->alpha_hidden = alloc_aligned(hidden);
+        net->w_hidden_output = alloc_aligned(hidden * net->output_stride);
+        break;
+
+    default:
+        net->w_input_hidden = alloc_aligned(input * net->hidden_stride);
+        net->w_hidden_output = alloc_aligned(hidden * net->output_stride);
+        break;
+    }
+
+    link_network_rows(net);
+    net->bias_hidden = alloc_aligned(hidden);
+    net->bias_output = alloc_aligned(output);
+    return net;
+}
 
+Network *create_network(size_t input, size_t hidden, size_t output) {
+    Network *net = create_network_dtype(input, hidden, output, NN_DTYPE_F64);
     initialize_weights(net);
     return net;
 }
 
+const char *nn_dtype_name(NNDtype dtype) {
+    switch (dtype) {
+    case NN_DTYPE_F32: return "float32";
+    case NN_DTYPE_I8:  return "int8";
+    case NN_DTYPE_BIN: return "binary";
+    default:           return "float64";
+    }
+}
+
+// int8 weights of one layer: every destination neuron (column) gets the
+// scale that maps its largest weight to 127
+static void quantize_layer(const double *src, size_t src_stride, int8_t *dst, size_t dst_stride,
+                           float *scales, size_t rows, size_t cols) {
+    for (size_t i = 0; i < cols; i++) {
+        double max_abs = 0.0;
+        for (size_t j = 0; j < rows; j++) {
+            double w = fabs(src[j * src_stride + i]);
+            if (w > max_abs) max_abs = w;
+        }
+        scales[i] = (float)(max_abs / 127.0);
+    }
+
+    for (size_t j = 0; j < rows; j++) {
+        for (size_t i = 0; i < cols; i++) {
+            long q = scales[i] > 0.0f ? lrint(src[j * src_stride + i] / scales[i]) : 0;
+            if (q > 127) q = 127;
+            if (q < -127) q = -127;
+            dst[j * dst_stride + i] = (int8_t)q;
+        }
+    }
+}
+
+// alpha of every hidden neuron: mean magnitude of its input weights
+static void compute_alpha(const Network *net, double *alpha) {
+    for (size_t i = 0; i < net->hidden_size; i++) alpha[i] = 0.0;
+    for (size_t j = 0; j < net->input_size; j++) {
+        const double *row = net->w_input_hidden + j * net->hidden_stride;
+        for (size_t i = 0; i < net->hidden_size; i++) alpha[i] += fabs(row[i]);
+    }
+    for (size_t i = 0; i < net->hidden_size; i++) alpha[i] /= (double)net->input_size;
+}
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+uint64_t nn_fingerprint(const Network *net) {
+    if (net->dtype != NN_DTYPE_F64) return 0;
+
+    // Logical weights only, so padding and strides don't matter
+    uint64_t sizes[3] = { net->input_size, net->hidden_size, net->output_size };
+    uint64_t hash = fnv1a(0xcbf29ce484222325ULL, sizes, sizeof(sizes));
+    for (size_t j = 0; j < net->input_size; j++) {
+        hash = fnv1a(hash, net->w_input_hidden + j * net->hidden_stride, net->hidden_size * sizeof(double));
+    }
+    for (size_t j = 0; j < net->hidden_size; j++) {
+        hash = fnv1a(hash, net->w_hidden_output + j * net->output_stride, net->output_size * sizeof(double));
+    }
+    hash = fnv1a(hash, net->bias_hidden, net->hidden_size * sizeof(double));
+    hash = fnv1a(hash, net->bias_output, net->output_size * sizeof(double));
+    return hash;
+}
+
+int nn_attach_generated(Network *net, const NNGeneratedModel *model) {
+    if (!model || net->dtype != NN_DTYPE_F64 || net->binarized ||
+        model->input_size != net->input_size || model->hidden_size != net->hidden_size ||
+        model->output_size != net->output_size || model->fingerprint != nn_fingerprint(net)) {
+        return 0;
+    }
+
+    // Probe glyph through both paths before trusting the generated code
+    double input[net->input_size];
+    double hidden[net->hidden_size];
+    double expected[net->output_size];
+    double got[net->output_size];
+    for (size_t j = 0; j < net->input_size; j++) input[j] = (j % 5 == 0) ? 1.0 : 0.0;
+
+    net->specialized = NULL;
+    forward(net, input, hidden, expected);
+    model->forward(input, hidden, got);
+    for (size_t i = 0; i < net->output_size; i++) {
+        if (fabs(got[i] - expected[i]) > 1e-9) return 0;
+    }
+
+    net->specialized = model->forward;
+    return 1;
+}
+
+int nn_trainable(const Network *net) {
+    // Reduced-precision networks are frozen copies of a float64 one
+    if (net->dtype != NN_DTYPE_F64) {
+        fprintf(stderr, "Error: Cannot train a %s network\n", nn_dtype_name(net->dtype));
+        return 0;
+    }
+    if (net->read_only) {
+        fprintf(stderr, "Error: Cannot train a read-only model, load it from a file\n");
+        return 0;
+    }
+    return 1;
+}
+
+void set_binarized_training(Network *net, int enabled) {
+    if (net->dtype != NN_DTYPE_F64 || !nn_trainable(net)) return;
+
+    net->binarized = enabled;
+    if (enabled) {
+        if (!net->alpha_hidden) net->alpha_hidden = alloc_aligned(net->hidden_size);
+        compute_alpha(net, net->alpha_hidden);
+    }
+}
+
+void copy_network_weights(Network *dst, const Network *src) {
+    memcpy(dst->w_input_hidden, src->w_input_hidden, src->input_size * src->hidden_stride * sizeof(double));
+    memcpy(dst->w_hidden_output, src->w_hidden_output, src->hidden_size * src->output_stride * sizeof(double));
+    memcpy(dst->bias_hidden, src->bias_hidden, src->hidden_size * sizeof(double));
+    memcpy(dst->bias_output, src->bias_output, src->output_size * sizeof(double));
+
+    dst->binarized = src->binarized;
+    if (src->alpha_hidden) {
+        if (!dst->alpha_hidden) dst->alpha_hidden = alloc_aligned(src->hidden_size);
+        memcpy(dst->alpha_hidden, src->alpha_hidden, src->hidden_size * sizeof(double));
+    }
+    dst->specialized = NULL;
+}
+
+Network *quantize_network(const Network *net, NNDtype dtype) {
+    if (net->dtype != NN_DTYPE_F64) {
+        fprintf(stderr, "Error: Only float64 networks can be quantized\n");
+        return NULL;
+    }
+
+    Network *q = create_network_dtype(net->input_size, net->hidden_size, net->output_size, dtype);
+    memcpy(q->bias_hidden, net->bias_hidden, net->hidden_size * sizeof(double));
+    memcpy(q->bias_output, net->bias_output, net->output_size * sizeof(double));
+
+    switch (dtype) {
+    case NN_DTYPE_F32:
+        for (size_t j = 0; j < net->input_size; j++) {
+            for (size_t i = 0; i < net->hidden_size; i++) {
+                q->w_input_hidden_f32[j * q->hidden_stride + i] = (float)net->w_input_hidden[j * net->hidden_stride + i];
+            }
+        }
+        for (size_t j = 0; j < net->hidden_size; j++) {
+            for (size_t i = 0; i < net->output_size; i++) {
+                q->w_hidden_output_f32[j * q->output_stride + i] = (float)net->w_hidden_output[j * net->output_stride + i];
+            }
+        }
+        break;
+
+    case NN_DTYPE_I8:
+        quantize_layer(net->w_input_hidden, net->hidden_stride, q->w_input_hidden_i8, q->hidden_stride,
+                       q->scale_hidden, net->input_size, net->hidden_size);
+        quantize_layer(net->w_hidden_output, net->output_stride, q->w_hidden_output_i8, q->output_stride,
+                       q->scale_output, net->hidden_size, net->output_size);
+        break;
+
+    case NN_DTYPE_BIN: {
+        const size_t words = NN_PACKED_WORDS(net->input_size);
+        compute_alpha(net, q->alpha_hidden);
+        for (size_t j = 0; j < net->input_size; j++) {
+            const double *row = net->w_input_hidden + j * net->hidden_stride;
+            for (size_t i = 0; i < net->hidden_size; i++) {
+                if (row[i] > 0.0) q->w_input_hidden_bin[i * words + j / 64] |= (uint64_t)1 << (j % 64);
+            }
+        }
+        for (size_t j = 0; j < net->hidden_size; j++) {
+            memcpy(q->weights_hidden_output[j], net->weights_hidden_output[j], net->output_size * sizeof(double));
+        }
+        break;
+    }
+
+    default:
+        for (size_t j = 0; j < net->input_size; j++) {
+            memcpy(q->weights_input_hidden[j], net->weights_input_hidden[j], net->hidden_size * sizeof(double));
+        }
+        for (size_t j = 0; j < net->hidden_size; j++) {
+            memcpy(q->weights_hidden_output[j], net->weights_hidden_output[j], net->output_size * sizeof(double));
+        }
+        break;
+    }
+
+    return q;
+}
+
+// Set once the random generator behind weights and shuffles is seeded
+static int rng_seeded = 0;
+
+void seed_network_rng(unsigned int seed) {
+    srand(seed);
+    rng_seeded = 1;
+}
+
 void initialize_weights(Network *net) {
-    static int seeded = 0;
-    if (!seeded) {
+    if (!rng_seeded) {
         srand(time(NULL));
-        seeded = 1;
+        rng_seeded = 1;
     }
     
     // Initialize input-hidden weights with value between -0.5 and 0.5
@@ -66,76 +351,544 @@ void initialize_weights(Network *net) {
 
 
 
+// Blocks inside the model image are not ours to free
+static void free_block(Network *net, void *block) {
+    const char *base = (const char*)net->mapping;
+    if (base && (const char*)block >= base && (const char*)block < base + net->mapping_size) return;
+    free(block);
+}
+
 // Free all network data (no leaks)
 void free_network(Network *net) {
-    for (size_t i = 0; i < net->input_size; i++) {
-        free(net->weights_input_hidden[i]);
-    }
     free(net->weights_input_hidden);
-    
-    for (size_t i = 0; i < net->hidden_size; i++) {
-        free(net->weights_hidden_output[i]);
-    }
     free(net->weights_hidden_output);
+    free_block(net, net->w_input_hidden);
+    free_block(net, net->w_hidden_output);
+    free_block(net, net->w_input_hidden_f32);
+    free_block(net, net->w_hidden_output_f32);
+    free_block(net, net->w_input_hidden_i8);
+    free_block(net, net->w_hidden_output_i8);
+    free_block(net, net->scale_hidden);
+    free_block(net, net->scale_output);
+    free_block(net, net->w_input_hidden_bin);
+    free_block(net, net->alpha_hidden);
     
-    free(net->bias_hidden);
-    free(net->bias_output);
+    free_block(net, net->bias_hidden);
+    free_block(net, net->bias_output);
+    if (net->mapping && net->mapping_owned) munmap(net->mapping, net->mapping_size);
     free(net);
 }
 
-double *forward(Network *net, double *input, double *hidden, double *output) {
+// Softmax (or sigmoid for a single output) applied in place on the output layer
+static void output_activation(Network *net, double *output) {
+    // If only one output layers (true or false), then use sigmoid (used before for the binary operations)
+    if (net->output_size == 1) {
+        output[0] = sigmoid(output[0]);
+    }
+
+    // Otherwise use softmax
+    else {
+        nn_kernels->softmax(output, net->output_size);
+    }
+}
+
+// Hidden pre-activations -> output probabilities, float64 weights
+static double *finish_f64(Network *net, double *hidden, double *output) {
+    const NNKernels *k = nn_kernels;
+
+    // Soften calculated value with sigmoid
+    k->sigmoid(hidden, net->hidden_size);
     
-    // Calculate hidden values from the input, weights and bias
+    // Propagate to the output layers
+    memcpy(output, net->bias_output, net->output_size * sizeof(double));
+    for (size_t j = 0; j < net->hidden_size; j++) {
+        k->axpy(net->output_size, hidden[j], net->w_hidden_output + j * net->output_stride, output);
+    }
+
+    output_activation(net, output);
+    return output;
+}
+
+// float32 weights, float accumulation, activations in double
+static double *finish_f32(Network *net, const float *acc_hidden, double *hidden, double *output) {
+    const NNKernels *k = nn_kernels;
+    float acc_output[net->output_stride];
+
+    for (size_t i = 0; i < net->hidden_size; i++) hidden[i] = acc_hidden[i];
+    k->sigmoid(hidden, net->hidden_size);
+
+    for (size_t i = 0; i < net->output_size; i++) acc_output[i] = (float)net->bias_output[i];
+    for (size_t j = 0; j < net->hidden_size; j++) {
+        k->axpy_f32(net->output_size, (float)hidden[j], net->w_hidden_output_f32 + j * net->output_stride, acc_output);
+    }
+    for (size_t i = 0; i < net->output_size; i++) output[i] = acc_output[i];
+
+    output_activation(net, output);
+    return output;
+}
+
+// int8 weights, activations quantized to [0, 127], int32 accumulation,
+// dequantized once per neuron with its scale
+static double *finish_i8(Network *net, const int32_t *acc_hidden, double *hidden, double *output) {
+    const NNKernels *k = nn_kernels;
+    int32_t acc_output[net->output_stride];
+
     for (size_t i = 0; i < net->hidden_size; i++) {
-        hidden[i] = net->bias_hidden[i];
-        for (size_t j = 0; j < net->input_size; j++) {
-            hidden[i] += input[j] * net->weights_input_hidden[j][i];
+        hidden[i] = net->bias_hidden[i] + acc_hidden[i] * (double)net->scale_hidden[i] / NN_I8_ACT_MAX;
+    }
+    k->sigmoid(hidden, net->hidden_size);
+
+    memset(acc_output, 0, net->output_size * sizeof(int32_t));
+    for (size_t j = 0; j < net->hidden_size; j++) {
+        int32_t a = (int32_t)lrint(hidden[j] * NN_I8_ACT_MAX);
+        if (a != 0) {
+            k->axpy_i8(net->output_size, a, net->w_hidden_output_i8 + j * net->output_stride, acc_output);
+        }
+    }
+    for (size_t i = 0; i < net->output_size; i++) {
+        output[i] = net->bias_output[i] + acc_output[i] * (double)net->scale_output[i] / NN_I8_ACT_MAX;
+    }
+
+    output_activation(net, output);
+    return output;
+}
+
+// Zero inputs (most pixels of a glyph) are skipped in every first layer:
+// they add nothing, so results are unchanged and forward, forward_batch and
+// forward_packed stay bit-identical
+
+static double *forward_f32(Network *net, const double *input, double *hidden, double *output) {
+    float acc_hidden[net->hidden_stride];
+
+    for (size_t i = 0; i < net->hidden_size; i++) acc_hidden[i] = (float)net->bias_hidden[i];
+    for (size_t j = 0; j < net->input_size; j++) {
+        if (input[j] == 0.0) continue;
+        nn_kernels->axpy_f32(net->hidden_size, (float)input[j], net->w_input_hidden_f32 + j * net->hidden_stride, acc_hidden);
+    }
+    return finish_f32(net, acc_hidden, hidden, output);
+}
+
+static double *forward_i8(Network *net, const double *input, double *hidden, double *output) {
+    int32_t acc_hidden[net->hidden_stride];
+
+    memset(acc_hidden, 0, net->hidden_size * sizeof(int32_t));
+    for (size_t j = 0; j < net->input_size; j++) {
+        int32_t a = (int32_t)lrint(input[j] * NN_I8_ACT_MAX);
+        if (a != 0) {
+            nn_kernels->axpy_i8(net->hidden_size, a, net->w_input_hidden_i8 + j * net->hidden_stride, acc_hidden);
         }
+    }
+    return finish_i8(net, acc_hidden, hidden, output);
+}
+
+// Binarized first layer from a packed 0/1 glyph.
+// Binary models: sum = 2 * popcount(x & w) - popcount(x) per neuron.
+// Binarized training: the same +/-1 sum from the signs of the float64 weights,
+// so both give exactly the same pre-activations.
+static void binarized_layer_packed(Network *net, const uint64_t *bits, double *hidden) {
+    const size_t words = NN_PACKED_WORDS(net->input_size);
 
-        // Soften calculated value with sigmoid
-        hidden[i] = sigmoid(hidden[i]);
+    if (net->dtype == NN_DTYPE_BIN) {
+        int32_t counts[net->hidden_size];
+        int32_t total = 0;
+        for (size_t w = 0; w < words; w++) total += __builtin_popcountll(bits[w]);
+
+        nn_kernels->and_popcount(bits, net->w_input_hidden_bin, words, net->hidden_size, counts);
+        for (size_t i = 0; i < net->hidden_size; i++) {
+            hidden[i] = net->bias_hidden[i] + net->alpha_hidden[i] * (double)(2 * counts[i] - total);
+        }
+        return;
     }
+
+    double acc[net->hidden_size];
+    memset(acc, 0, sizeof(acc));
+    for (size_t w = 0; w < words; w++) {
+        for (uint64_t word = bits[w]; word; word &= word - 1) {
+            const double *row = net->w_input_hidden + (w * 64 + (size_t)__builtin_ctzll(word)) * net->hidden_stride;
+            for (size_t i = 0; i < net->hidden_size; i++) acc[i] += row[i] > 0.0 ? 1.0 : -1.0;
+        }
+    }
+    for (size_t i = 0; i < net->hidden_size; i++) {
+        hidden[i] = net->bias_hidden[i] + net->alpha_hidden[i] * acc[i];
+    }
+}
+
+// Binarized first layer for inputs that are not strictly 0/1
+static void binarized_layer_dense(Network *net, const double *input, double *hidden) {
+    const size_t words = NN_PACKED_WORDS(net->input_size);
+    double acc[net->hidden_size];
+    memset(acc, 0, sizeof(acc));
+
+    for (size_t j = 0; j < net->input_size; j++) {
+        if (input[j] == 0.0) continue;
+        for (size_t i = 0; i < net->hidden_size; i++) {
+            int positive = (net->dtype == NN_DTYPE_BIN)
+                ? (int)((net->w_input_hidden_bin[i * words + j / 64] >> (j % 64)) & 1)
+                : net->w_input_hidden[j * net->hidden_stride + i] > 0.0;
+            acc[i] += positive ? input[j] : -input[j];
+        }
+    }
+    for (size_t i = 0; i < net->hidden_size; i++) {
+        hidden[i] = net->bias_hidden[i] + net->alpha_hidden[i] * acc[i];
+    }
+}
+
+static double *forward_binarized(Network *net, const double *input, double *hidden, double *output) {
+    uint64_t bits[NN_PACKED_WORDS(net->input_size)];
+
+    if (pack_input(input, net->input_size, bits)) {
+        binarized_layer_packed(net, bits, hidden);
+    } else {
+        binarized_layer_dense(net, input, hidden);
+    }
+    return finish_f64(net, hidden, output);
+}
+
+double *forward(Network *net, double *input, double *hidden, double *output) {
+    if (net->specialized) return net->specialized(input, hidden, output);
+    if (net->dtype == NN_DTYPE_F32) return forward_f32(net, input, hidden, output);
+    if (net->dtype == NN_DTYPE_I8) return forward_i8(net, input, hidden, output);
+    if (net->dtype == NN_DTYPE_BIN || net->binarized) return forward_binarized(net, input, hidden, output);
     
-    // Propagate to the output layers
-    for (size_t i = 0; i < net->output_size; i++) {
-        output[i] = net->bias_output[i];
-        for (size_t j = 0; j < net->hidden_size; j++) {
-            output[i] += hidden[j] * net->weights_hidden_output[j][i];
+    // Calculate hidden values from the input, weights and bias
+    // Accumulated one input row at a time so weights are read contiguously
+    memcpy(hidden, net->bias_hidden, net->hidden_size * sizeof(double));
+    for (size_t j = 0; j < net->input_size; j++) {
+        if (input[j] == 0.0) continue;
+        nn_kernels->axpy(net->hidden_size, input[j], net->w_input_hidden + j * net->hidden_stride, hidden);
+    }
+
+    return finish_f64(net, hidden, output);
+}
+
+int pack_input(const double *input, size_t n, uint64_t *bits) {
+    int binary = 1;
+
+    // Branchless: a glyph's pixels are too unpredictable for the branch predictor
+    for (size_t w = 0; w < NN_PACKED_WORDS(n); w++) {
+        size_t end = (w * 64 + 64 < n) ? w * 64 + 64 : n;
+        uint64_t word = 0;
+        for (size_t j = w * 64; j < end; j++) {
+            word |= (uint64_t)(input[j] != 0.0) << (j % 64);
+            binary &= (input[j] == 0.0) | (input[j] == 1.0);
         }
+        bits[w] = word;
     }
+    return binary;
+}
 
+void unpack_input(const uint64_t *bits, size_t n, double *input) {
+    for (size_t j = 0; j < n; j++) input[j] = (double)((bits[j / 64] >> (j % 64)) & 1);
+}
 
-    // If only one output layers (true or false), then use sigmoid (used before for the binary operations)
-    if (net->output_size == 1) {
-        output[0] = sigmoid(output[0]);
+double *forward_packed(Network *net, const uint64_t *bits, double *hidden, double *output) {
+    const NNKernels *k = nn_kernels;
+    const size_t words = NN_PACKED_WORDS(net->input_size);
+
+    if (net->dtype == NN_DTYPE_BIN || net->binarized) {
+        binarized_layer_packed(net, bits, hidden);
+        return finish_f64(net, hidden, output);
     }
 
-    // Otherwise use softmax
-    else {
-        double max_val = output[0];
-        for (size_t i = 1; i < net->output_size; i++) {
-            if (output[i] > max_val) max_val = output[i];
+    // Generated code takes plain inputs
+    if (net->specialized) {
+        double input[net->input_size];
+        unpack_input(bits, net->input_size, input);
+        return net->specialized(input, hidden, output);
+    }
+
+    // Walk the set bits: every active pixel is one weight row added to the
+    // accumulators (same ascending order as forward, so same result)
+    switch (net->dtype) {
+    case NN_DTYPE_F32: {
+        float acc_hidden[net->hidden_stride];
+        for (size_t i = 0; i < net->hidden_size; i++) acc_hidden[i] = (float)net->bias_hidden[i];
+        for (size_t w = 0; w < words; w++) {
+            for (uint64_t word = bits[w]; word; word &= word - 1) {
+                size_t j = w * 64 + (size_t)__builtin_ctzll(word);
+                k->axpy_f32(net->hidden_size, 1.0f, net->w_input_hidden_f32 + j * net->hidden_stride, acc_hidden);
+            }
         }
-        double sum = 0.0;
-        for (size_t i = 0; i < net->output_size; i++) {
-            output[i] = exp(output[i] - max_val);
-            sum += output[i];
+        return finish_f32(net, acc_hidden, hidden, output);
+    }
+
+    case NN_DTYPE_I8: {
+        int32_t acc_hidden[net->hidden_stride];
+        memset(acc_hidden, 0, net->hidden_size * sizeof(int32_t));
+        for (size_t w = 0; w < words; w++) {
+            for (uint64_t word = bits[w]; word; word &= word - 1) {
+                size_t j = w * 64 + (size_t)__builtin_ctzll(word);
+                k->axpy_i8(net->hidden_size, NN_I8_ACT_MAX, net->w_input_hidden_i8 + j * net->hidden_stride, acc_hidden);
+            }
         }
-        for (size_t i = 0; i < net->output_size; i++) {
-            output[i] /= sum;
+        return finish_i8(net, acc_hidden, hidden, output);
+    }
+
+    default:
+        memcpy(hidden, net->bias_hidden, net->hidden_size * sizeof(double));
+        for (size_t w = 0; w < words; w++) {
+            for (uint64_t word = bits[w]; word; word &= word - 1) {
+                size_t j = w * 64 + (size_t)__builtin_ctzll(word);
+                k->add(net->hidden_size, net->w_input_hidden + j * net->hidden_stride, hidden);
+            }
         }
+        return finish_f64(net, hidden, output);
     }
-    return output;
 }
 
-void backpropagate(Network* net, double *input, double *target, double learning_rate) {
-    double *hidden = malloc(net->hidden_size * sizeof(double));
-    double *output = malloc(net->output_size * sizeof(double));
+void forward_batch(Network *net, const double *inputs, double *outputs, size_t count) {
+    const size_t n_in = net->input_size;
+    const size_t n_hid = net->hidden_size;
+    const size_t n_out = net->output_size;
+    const size_t stride = net->hidden_stride;
+    const NNKernels *k = nn_kernels;
+
+    // Reduced-precision weights are small enough to stay cached, and generated
+    // code has its own blocking: one glyph at a time
+    if (net->dtype != NN_DTYPE_F64 || net->binarized || net->specialized) {
+        double *h = malloc(n_hid * sizeof(double));
+        for (size_t s = 0; s < count; s++) {
+            forward(net, (double *)(inputs + s * n_in), h, outputs + s * n_out);
+        }
+        free(h);
+        return;
+    }
+
+    // One hidden row and one packed glyph per glyph of the tile
+    const size_t words = NN_PACKED_WORDS(n_in);
+    double *hidden = malloc(NN_BATCH_TILE * stride * sizeof(double));
+    uint64_t *bits = malloc(NN_BATCH_TILE * words * sizeof(uint64_t));
+    int binary[NN_BATCH_TILE];
+
+    for (size_t s0 = 0; s0 < count; s0 += NN_BATCH_TILE) {
+        size_t tile = (count - s0 < NN_BATCH_TILE) ? count - s0 : NN_BATCH_TILE;
+
+        for (size_t s = 0; s < tile; s++) {
+            memcpy(hidden + s * stride, net->bias_hidden, n_hid * sizeof(double));
+            binary[s] = pack_input(inputs + (s0 + s) * n_in, n_in, bits + s * words);
+        }
+
+        // Input -> hidden as a blocked matrix-matrix product:
+        // a tile of NN_INPUT_TILE weight rows stays in cache while every glyph
+        // of the batch tile consumes it (same summation order as forward)
+        for (size_t j0 = 0; j0 < n_in; j0 += NN_INPUT_TILE) {
+            size_t j1 = (j0 + NN_INPUT_TILE < n_in) ? j0 + NN_INPUT_TILE : n_in;
+
+            for (size_t s = 0; s < tile; s++) {
+                const double *x = inputs + (s0 + s) * n_in;
+                double *h = hidden + s * stride;
+
+                // 0/1 glyphs walk their set bits (NN_INPUT_TILE covers whole words)
+                if (binary[s]) {
+                    const uint64_t *b = bits + s * words;
+                    for (size_t w = j0 / 64; w < (j1 + 63) / 64; w++) {
+                        for (uint64_t word = b[w]; word; word &= word - 1) {
+                            size_t j = w * 64 + (size_t)__builtin_ctzll(word);
+                            k->add(n_hid, net->w_input_hidden + j * stride, h);
+                        }
+                    }
+                    continue;
+                }
+
+                for (size_t j = j0; j < j1; j++) {
+                    if (x[j] == 0.0) continue;
+                    k->axpy(n_hid, x[j], net->w_input_hidden + j * stride, h);
+                }
+            }
+        }
+
+        // Hidden -> output (small matrix, fully cached)
+        for (size_t s = 0; s < tile; s++) {
+            finish_f64(net, hidden + s * stride, outputs + (s0 + s) * n_out);
+        }
+    }
+
+    free(hidden);
+    free(bits);
+}
+
+NNWorkspace *create_workspace(const Network *net, size_t batch_size) {
+    const size_t hidden_stride = nn_padded_size(net->hidden_size);
+    const size_t output_stride = nn_padded_size(net->output_size);
+    if (batch_size == 0) batch_size = 1;
+
+    NNWorkspace *ws = calloc(1, sizeof(NNWorkspace));
+    ws->batch_size = batch_size;
+    ws->hidden = alloc_aligned(batch_size * hidden_stride);
+    ws->output = alloc_aligned(batch_size * output_stride);
+    ws->output_errors = alloc_aligned(batch_size * output_stride);
+    ws->delta_hidden = alloc_aligned(batch_size * hidden_stride);
+    ws->target = alloc_aligned(net->output_size);
+    ws->labels = calloc(batch_size, sizeof(int));
+    ws->inputs_t = alloc_aligned(net->input_size * batch_size);
+    ws->input = alloc_aligned(net->input_size);
+    ws->row = alloc_aligned(hidden_stride > output_stride ? hidden_stride : output_stride);
+    ws->soft = alloc_aligned(batch_size * output_stride);
+    return ws;
+}
+
+void free_workspace(NNWorkspace *ws) {
+    if (!ws) return;
+    free(ws->hidden);
+    free(ws->output);
+    free(ws->output_errors);
+    free(ws->delta_hidden);
+    free(ws->target);
+    free(ws->labels);
+    free(ws->inputs_t);
+    free(ws->input);
+    free(ws->row);
+    free(ws->soft);
+    free(ws);
+}
+
+const char *nn_optimizer_name(NNOptimizerKind kind) {
+    switch (kind) {
+    case NN_OPTIMIZER_MOMENTUM: return "momentum";
+    case NN_OPTIMIZER_ADAM:     return "adam";
+    default:                    return "sgd";
+    }
+}
+
+size_t optimizer_block_size(const Network *net, int block) {
+    const size_t hidden_stride = nn_padded_size(net->hidden_size);
+    const size_t output_stride = nn_padded_size(net->output_size);
+    switch (block) {
+    case NN_OPT_W_INPUT_HIDDEN:  return net->input_size * hidden_stride;
+    case NN_OPT_W_HIDDEN_OUTPUT: return net->hidden_size * output_stride;
+    case NN_OPT_BIAS_HIDDEN:     return net->hidden_size;
+    default:                     return net->output_size;
+    }
+}
+
+NNOptimizer *create_optimizer(const Network *net, NNOptimizerKind kind) {
+    NNOptimizer *opt = calloc(1, sizeof(NNOptimizer));
+    opt->kind = kind;
+    opt->beta1 = 0.9;
+    opt->beta2 = 0.999;
+    opt->epsilon = 1e-8;
+    for (int b = 0; b < NN_OPT_BLOCKS && kind != NN_OPTIMIZER_SGD; b++) {
+        opt->m[b] = alloc_aligned(optimizer_block_size(net, b));
+        if (kind == NN_OPTIMIZER_ADAM) opt->v[b] = alloc_aligned(optimizer_block_size(net, b));
+    }
+    return opt;
+}
+
+void free_optimizer(NNOptimizer *opt) {
+    if (!opt) return;
+    for (int b = 0; b < NN_OPT_BLOCKS; b++) {
+        free(opt->m[b]);
+        free(opt->v[b]);
+    }
+    free(opt);
+}
+
+void copy_optimizer(NNOptimizer *dst, const NNOptimizer *src, const Network *net) {
+    for (int b = 0; b < NN_OPT_BLOCKS; b++) {
+        size_t n = optimizer_block_size(net, b);
+        if (src->m[b]) memcpy(dst->m[b], src->m[b], n * sizeof(double));
+        if (src->v[b]) memcpy(dst->v[b], src->v[b], n * sizeof(double));
+    }
+    dst->beta1 = src->beta1;
+    dst->beta2 = src->beta2;
+    dst->epsilon = src->epsilon;
+    dst->step = src->step;
+    dst->epoch = src->epoch;
+    dst->schedule = src->schedule;
+    dst->learning_rate = src->learning_rate;
+    dst->warmup_epochs = src->warmup_epochs;
+    dst->schedule_epochs = src->schedule_epochs;
+    dst->step_epochs = src->step_epochs;
+    dst->step_gamma = src->step_gamma;
+}
+
+// One weight update. Plain SGD stays a single axpy per block.
+typedef struct {
+    const NNOptimizer *opt; // NULL for plain SGD
+    double step;            // -learning rate / samples
+    double scale;           // 1 / samples: gradient sums to mean gradients
+    double rate;            // Adam: learning rate with this update's bias correction
+} UpdateStep;
+
+static UpdateStep update_step(const NNOptimizer *opt, double learning_rate, size_t count) {
+    UpdateStep s = { opt && opt->kind != NN_OPTIMIZER_SGD ? opt : NULL,
+                     -learning_rate / (double)count, 1.0 / (double)count, learning_rate };
+    if (s.opt && s.opt->kind == NN_OPTIMIZER_ADAM) {
+        double t = (double)(s.opt->step + 1);
+        s.rate = learning_rate * sqrt(1.0 - pow(s.opt->beta2, t)) / (1.0 - pow(s.opt->beta1, t));
+    }
+    return s;
+}
+
+// Change of one weight for the gradient sum g, m and v are its moments
+static inline double update_delta(const UpdateStep *s, double g, double *m, double *v) {
+    const NNOptimizer *opt = s->opt;
+    if (opt->kind == NN_OPTIMIZER_MOMENTUM) {
+        *m = opt->beta1 * *m + s->step * g;
+        return *m;
+    }
+    g *= s->scale;
+    *m = opt->beta1 * *m + (1.0 - opt->beta1) * g;
+    *v = opt->beta2 * *v + (1.0 - opt->beta2) * g * g;
+    return -s->rate * *m / (sqrt(*v) + opt->epsilon);
+}
+
+// n weights of a block, starting at element `offset` of the block
+static void update_params(const UpdateStep *s, int block, size_t offset, double *param, const double *g, size_t n) {
+    if (!s->opt) {
+        nn_kernels->axpy(n, s->step, g, param);
+        return;
+    }
+    double *m = s->opt->m[block] + offset;
+    double *v = s->opt->v[block] ? s->opt->v[block] + offset : NULL;
+    for (size_t i = 0; i < n; i++) param[i] += update_delta(s, g[i], m + i, v ? v + i : NULL);
+}
+
+double nn_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+const char *nn_phase_name(NNPhase phase) {
+    switch (phase) {
+    case NN_PHASE_DATA:     return "data";
+    case NN_PHASE_FORWARD:  return "forward";
+    case NN_PHASE_BACKWARD: return "backward";
+    case NN_PHASE_UPDATE:   return "update";
+    case NN_PHASE_EVAL:     return "eval";
+    default:                return "unknown";
+    }
+}
+
+// Cross-entropy of one prediction (softmax outputs, or the single sigmoid
+// output standing for class 0)
+static double sample_loss(const Network *net, const double *output, int label) {
+    double p = output[0];
+    if (net->output_size == 1) {
+        if (label != 0) p = 1.0 - p;
+    } else {
+        p = output[label];
+    }
+    return -log(p > 1e-12 ? p : 1e-12);
+}
+
+void backpropagate(Network* net, NNWorkspace *ws, double *input, double *target, double learning_rate) {
+    if (!nn_trainable(net)) return;
+
+    // Generated code has the old weights baked in
+    net->specialized = NULL;
+
+    double *hidden = ws->hidden;
+    double *output = ws->output;
+    double started = nn_seconds();
     
     // Calculate output
     forward(net, input, hidden, output);
+    double forwarded = nn_seconds();
+    ws->phase_seconds[NN_PHASE_FORWARD] += forwarded - started;
     
-    double *output_errors = malloc(net->output_size * sizeof(double));
+    double *output_errors = ws->output_errors;
     // Not used since output isnt binary operations anymore
     if (net->output_size == 1) {
         output_errors[0] = (output[0] - target[0]) * output[0] * (1.0 - output[0]);
@@ -149,9 +902,10 @@ void backpropagate(Network* net, double *input, double *target, double learning_
 
     // If the neural network was wrong, change the weights based on the learning rate and gradient function
     for (size_t i = 0; i < net->hidden_size; i++) {
+        double *row = net->w_hidden_output + i * net->output_stride;
         for (size_t j = 0; j < net->output_size; j++) {
             double gradient = hidden[i] * output_errors[j];
-            net->weights_hidden_output[i][j] -= learning_rate * gradient;
+            row[j] -= learning_rate * gradient;
         }
     }  
 
@@ -161,11 +915,12 @@ void backpropagate(Network* net, double *input, double *target, double learning_
     }
 
     // Correct the weights for the input->hidden wiehgts
-    double *delta_hidden = malloc(net->hidden_size * sizeof(double));
+    double *delta_hidden = ws->delta_hidden;
     for (size_t i = 0; i < net->hidden_size; i++) {
+        const double *row = net->w_hidden_output + i * net->output_stride;
         delta_hidden[i] = 0.0;
         for (size_t j = 0; j < net->output_size; j++) {
-            delta_hidden[i] += output_errors[j] * net->weights_hidden_output[i][j];
+            delta_hidden[i] += output_errors[j] * row[j];
         }
 
         // derivative of sigmoid function
@@ -173,68 +928,536 @@ void backpropagate(Network* net, double *input, double *target, double learning_
     }
 
     // And same for the biases
-    for (size_t i = 0; i < net->input_size; i++) {
-        for (size_t j = 0; j < net->hidden_size; j++) {
-            double gradient = input[i] * delta_hidden[j];
-            net->weights_input_hidden[i][j] -= learning_rate * gradient;
+    if (net->binarized) {
+        // Straight-through estimator: the gradient of the binarized weight goes
+        // to the real one, clipped to [-1, 1] as sign() saturates beyond.
+        // Zero inputs give zero gradients, their rows are skipped.
+        for (size_t i = 0; i < net->input_size; i++) {
+            if (input[i] == 0.0) continue;
+            double *row = net->w_input_hidden + i * net->hidden_stride;
+            for (size_t j = 0; j < net->hidden_size; j++) {
+                double old = row[j];
+                double updated = old - learning_rate * input[i] * delta_hidden[j];
+                if (updated > 1.0) updated = 1.0;
+                if (updated < -1.0) updated = -1.0;
+                row[j] = updated;
+                net->alpha_hidden[j] += (fabs(updated) - fabs(old)) / (double)net->input_size;
+            }
+        }
+    } else {
+        for (size_t i = 0; i < net->input_size; i++) {
+            double *row = net->w_input_hidden + i * net->hidden_stride;
+            for (size_t j = 0; j < net->hidden_size; j++) {
+                double gradient = input[i] * delta_hidden[j];
+                row[j] -= learning_rate * gradient;
+            }
         }
     }
 
     for (size_t i = 0; i < net->hidden_size; i++) {
         net->bias_hidden[i] -= learning_rate * delta_hidden[i];
     }
-
-    // Free all allocated memory
-    free(output_errors);
-    free(delta_hidden);
-    free(hidden);
-    free(output);
+    ws->phase_seconds[NN_PHASE_UPDATE] += nn_seconds() - forwarded;
 }
 
-void train(Network* net, TrainingExample* examples, size_t num_examples, int epochs, float learning_rate) {
+// Per-sample SGD over the examples in order
+static void train_epochs(Network *net, TrainingExample *examples, size_t num_examples, const TrainConfig *config) {
+    if (!nn_trainable(net)) return;
     printf("Training started...\n");
-    for (int epoch = 0; epoch < epochs; epoch++) {
+    NNWorkspace *ws = create_workspace(net, 1);
+    const int first_epoch = config->optimizer ? config->optimizer->epoch : 0;
+
+    // backpropagate() is plain SGD on the labels: the optimizers and
+    // distillation go through the batch steps, one sample per batch
+    if (config->optimizer && config->optimizer->kind != NN_OPTIMIZER_SGD) ws->optimizer = config->optimizer;
+    training_soft_targets(ws, config);
+
+    for (int epoch = 0; epoch < config->epochs; epoch++) {
+        double started = nn_seconds();
+        training_stats_reset(ws);
+        if (config->epoch_begin) config->epoch_begin(epoch, config->epoch_begin_data);
+        double learning_rate = scheduled_learning_rate(config, first_epoch, epoch);
+        ws->phase_seconds[NN_PHASE_DATA] += nn_seconds() - started;
+        size_t correct = 0;
         for (size_t i = 0; i < num_examples; i++) {
-            double *target = calloc(net->output_size, sizeof(double));
-            target[examples[i].label] = 1.0;
+            if (ws->optimizer || ws->soft_targets) {
+                training_batch_load(net, ws, examples, &i, 1);
+                correct += training_batch_pass(net, ws, 1);
+                training_batch_update(net, ws, 1, learning_rate);
+                continue;
+            }
+
+            double loaded = nn_seconds();
+            ws->target[examples[i].label] = 1.0;
+            unpack_input(examples[i].bits, net->input_size, ws->input);
+            ws->phase_seconds[NN_PHASE_DATA] += nn_seconds() - loaded;
 
             // Try to guess letter and correct the neural network if wrong
-            backpropagate(net, examples[i].pixels, target, learning_rate);
-            free(target);
+            backpropagate(net, ws, ws->input, ws->target, learning_rate);
+            ws->target[examples[i].label] = 0.0;
+
+            // backpropagate leaves the prediction made before the update in
+            // ws->output: the accuracy comes without a second pass
+            int predicted = 0;
+            for (size_t j = 1; j < net->output_size; j++) {
+                if (ws->output[j] > ws->output[predicted]) predicted = (int)j;
+            }
+            if (predicted == examples[i].label) correct++;
+            ws->loss += sample_loss(net, ws->output, examples[i].label);
         }
 
+        NNEpochStats stats;
+        training_epoch_stats(&stats, ws, epoch, num_examples, correct, ws->loss, learning_rate, started);
+        if (training_epoch_end(net, config, epoch, &stats)) break;
+    }
+    free_workspace(ws);
+}
 
-        // Display accuracy every 1 epochs
-        if ((epoch + 1) % 1 == 0) {
-            int correct = 0;
-            double *hidden = malloc(net->hidden_size * sizeof(double));
-            double *output = malloc(net->output_size * sizeof(double));
+void train(Network* net, TrainingExample* examples, size_t num_examples, int epochs, float learning_rate) {
+    TrainConfig config;
+    train_config_default(&config);
+    config.epochs = epochs;
+    config.learning_rate = learning_rate;
+    train_epochs(net, examples, num_examples, &config);
+}
 
-            for (size_t i = 0; i < num_examples; i++) {
-                forward(net, examples[i].pixels, hidden, output);
-                int predicted = 0;
-                double max_prob = output[0];
-                for (size_t j = 1; j < net->output_size; j++) {
-                    if (output[j] > max_prob) {
-                        max_prob = output[j];
-                        predicted = (int)j;
-                    }
-                }
-                if (predicted == examples[i].label) {
-                    correct++;
-                }
-            }
-            free(hidden);
-            free(output);
+void train_config_default(TrainConfig *config) {
+    config->epochs = 1;
+    config->learning_rate = 0.01;
+    config->batch_size = 1;
+    config->threads = 1;
+    config->hogwild = 0;
+    config->seed = 0;
+    config->validation = NULL;
+    config->validation_count = 0;
+    config->eval_every = 1;
+    config->patience = 0;
+    config->epoch_end = NULL;
+    config->epoch_data = NULL;
+    config->epoch_begin = NULL;
+    config->epoch_begin_data = NULL;
+    config->epoch_stats = NULL;
+    config->validation_stats = NULL;
+    config->stats_data = NULL;
+    config->optimizer = NULL;
+    config->soft_targets = NULL;
+    config->temperature = 1.0;
+    config->soft_weight = 0.0;
+    config->schedule = NN_SCHEDULE_CONSTANT;
+    config->warmup_epochs = 0;
+    config->schedule_epochs = 0;
+    config->step_epochs = 0;
+    config->step_gamma = 0.1;
+}
+
+const char *nn_schedule_name(NNSchedule schedule) {
+    switch (schedule) {
+    case NN_SCHEDULE_COSINE: return "cosine";
+    case NN_SCHEDULE_STEP:   return "step";
+    default:                 return "constant";
+    }
+}
 
-            double accuracy = (double)correct / num_examples * 100.0;
-            printf("Epoch %d/%d - Accuracy: %.2f%%\n", epoch + 1, epochs, accuracy);
+double scheduled_learning_rate(const TrainConfig *config, int first_epoch, int epoch) {
+    const int warmup = config->warmup_epochs;
+    const int e = first_epoch + epoch;
+    if (e < warmup) return config->learning_rate * (e + 1) / warmup;
+
+    switch (config->schedule) {
+    case NN_SCHEDULE_COSINE: {
+        int horizon = config->schedule_epochs > 0 ? config->schedule_epochs : first_epoch + config->epochs;
+        if (horizon <= warmup) return config->learning_rate;
+        double progress = (double)(e - warmup) / (horizon - warmup);
+        if (progress > 1.0) progress = 1.0;
+        return config->learning_rate * 0.5 * (1.0 + cos(M_PI * progress));
+    }
+    case NN_SCHEDULE_STEP:
+        if (config->step_epochs <= 0) return config->learning_rate;
+        return config->learning_rate * pow(config->step_gamma, (e - warmup) / config->step_epochs);
+    default:
+        return config->learning_rate;
+    }
+}
+
+void training_soft_targets(NNWorkspace *ws, const TrainConfig *config) {
+    ws->soft_targets = config->soft_targets;
+    ws->temperature = config->temperature > 0.0 ? config->temperature : 1.0;
+    ws->soft_weight = config->soft_weight;
+}
 
-            // Stop early in case of good training to not have to wait the whole training
-            if (accuracy > 99.9) {
-                printf("!!! Reached > 99.99%% accuracy !!!\n Stopping Early...\n");
-                break;
+void training_stats_reset(NNWorkspace *ws) {
+    ws->loss = 0.0;
+    memset(ws->phase_seconds, 0, sizeof(ws->phase_seconds));
+}
+
+void training_epoch_stats(NNEpochStats *stats, const NNWorkspace *ws, int epoch, size_t samples, size_t correct,
+                          double loss, double learning_rate, double started) {
+    stats->epoch = epoch + 1;
+    stats->samples = samples;
+    stats->correct = correct;
+    stats->loss = samples ? loss / samples : 0.0;
+    stats->learning_rate = learning_rate;
+    stats->seconds = nn_seconds() - started;
+    memcpy(stats->phase_seconds, ws->phase_seconds, sizeof(stats->phase_seconds));
+}
+
+int training_epoch_end(Network *net, const TrainConfig *config, int epoch, NNEpochStats *stats) {
+    double accuracy = stats->samples ? (double)stats->correct / stats->samples * 100.0 : 0.0;
+    printf("Epoch %d/%d - Accuracy: %.2f%% (during the epoch), loss %.4f, %.2fs (%.0f samples/s)\n",
+           epoch + 1, config->epochs, accuracy, stats->loss, stats->seconds,
+           stats->seconds > 0.0 ? stats->samples / stats->seconds : 0.0);
+    fflush(stdout);
+    if (config->optimizer) config->optimizer->epoch++;
+
+    int stop;
+    double started = nn_seconds();
+    if (config->epoch_end) {
+        stop = config->epoch_end(net, epoch, config->epoch_data);
+    } else {
+        // Stop early in case of good training to not have to wait the whole training
+        stop = accuracy > 99.9;
+        if (stop) printf("!!! Reached > 99.99%% accuracy !!!\n Stopping Early...\n");
+    }
+
+    double eval = nn_seconds() - started;
+    stats->phase_seconds[NN_PHASE_EVAL] += eval;
+    stats->seconds += eval;
+    if (config->epoch_stats) config->epoch_stats(stats, config->stats_data);
+    return stop;
+}
+
+void shuffle_order(size_t *order, size_t count) {
+    for (size_t i = count; i > 1; i--) {
+        size_t j = (size_t)rand() % i;
+        size_t tmp = order[i - 1];
+        order[i - 1] = order[j];
+        order[j] = tmp;
+    }
+}
+
+// First-layer row j as the forward pass sees it: the real weights, or
+// +/- alpha of every neuron in binarized training
+static const double *training_row(Network *net, size_t j, double *scratch) {
+    const double *row = net->w_input_hidden + j * net->hidden_stride;
+    if (!net->binarized) return row;
+    for (size_t i = 0; i < net->hidden_size; i++) {
+        scratch[i] = row[i] > 0.0 ? net->alpha_hidden[i] : -net->alpha_hidden[i];
+    }
+    return scratch;
+}
+
+void training_batch_load(Network *net, NNWorkspace *ws, const TrainingExample *examples,
+                         const size_t *order, size_t count) {
+    const size_t batch = ws->batch_size;
+    const size_t words = NN_PACKED_WORDS(net->input_size);
+    double started = nn_seconds();
+
+    // Glyphs are mostly background: clear everything, then scatter the set pixels
+    memset(ws->inputs_t, 0, net->input_size * batch * sizeof(double));
+    for (size_t b = 0; b < count; b++) {
+        const TrainingExample *example = &examples[order[b]];
+        ws->labels[b] = example->label;
+        for (size_t w = 0; w < words; w++) {
+            for (uint64_t word = example->bits[w]; word; word &= word - 1) {
+                ws->inputs_t[(w * 64 + (size_t)__builtin_ctzll(word)) * batch + b] = 1.0;
             }
         }
+        if (ws->soft_targets) {
+            const float *soft = ws->soft_targets + order[b] * net->output_size;
+            for (size_t j = 0; j < net->output_size; j++) ws->soft[b * net->output_stride + j] = soft[j];
+        }
+    }
+    ws->phase_seconds[NN_PHASE_DATA] += nn_seconds() - started;
+}
+
+// Activations of the `count` samples in ws->inputs_t. Every weight row is
+// loaded once and applied to the whole batch while it sits in L1.
+static void batch_forward(Network *net, NNWorkspace *ws, size_t count) {
+    const NNKernels *k = nn_kernels;
+    const size_t hs = net->hidden_stride, os = net->output_stride, batch = ws->batch_size;
+
+    for (size_t b = 0; b < count; b++) {
+        memcpy(ws->hidden + b * hs, net->bias_hidden, net->hidden_size * sizeof(double));
+    }
+    for (size_t j = 0; j < net->input_size; j++) {
+        const double *x = ws->inputs_t + j * batch;
+        size_t b = 0;
+        while (b < count && x[b] == 0.0) b++;
+        if (b == count) continue;
+
+        const double *row = training_row(net, j, ws->row);
+        for (; b < count; b++) {
+            if (x[b] != 0.0) k->axpy(net->hidden_size, x[b], row, ws->hidden + b * hs);
+        }
     }
+
+    for (size_t b = 0; b < count; b++) {
+        k->sigmoid(ws->hidden + b * hs, net->hidden_size);
+        memcpy(ws->output + b * os, net->bias_output, net->output_size * sizeof(double));
+    }
+    for (size_t i = 0; i < net->hidden_size; i++) {
+        const double *row = net->w_hidden_output + i * os;
+        for (size_t b = 0; b < count; b++) {
+            k->axpy(net->output_size, ws->hidden[b * hs + i], row, ws->output + b * os);
+        }
+    }
+    for (size_t b = 0; b < count; b++) output_activation(net, ws->output + b * os);
+}
+
+// Blends the label's output errors with those of distillation, whose
+// gradient is T * (q - teacher) with q the student's softmax at
+// temperature T: the outputs raised to 1/T, renormalized
+static void distillation_errors(Network *net, NNWorkspace *ws, const double *output, const double *teacher, double *errors) {
+    const double t = ws->temperature, w = ws->soft_weight;
+    double *q = ws->row;
+    double sum = 0.0;
+    for (size_t j = 0; j < net->output_size; j++) {
+        q[j] = t == 1.0 ? output[j] : exp(log(output[j] > 1e-300 ? output[j] : 1e-300) / t);
+        sum += q[j];
+    }
+    for (size_t j = 0; j < net->output_size; j++) {
+        errors[j] = (1.0 - w) * errors[j] + w * t * (q[j] / sum - teacher[j]);
+    }
+}
+
+size_t training_batch_pass(Network *net, NNWorkspace *ws, size_t count) {
+    const size_t hs = net->hidden_stride, os = net->output_stride;
+    size_t correct = 0;
+
+    double started = nn_seconds();
+    batch_forward(net, ws, count);
+    double forwarded = nn_seconds();
+    ws->phase_seconds[NN_PHASE_FORWARD] += forwarded - started;
+
+    for (size_t b = 0; b < count; b++) {
+        const double *output = ws->output + b * os;
+        double *errors = ws->output_errors + b * os;
+
+        size_t predicted = 0;
+        for (size_t j = 1; j < net->output_size; j++) {
+            if (output[j] > output[predicted]) predicted = j;
+        }
+        if ((int)predicted == ws->labels[b]) correct++;
+        ws->loss += sample_loss(net, output, ws->labels[b]);
+
+        if (net->output_size == 1) {
+            double target = ws->labels[b] == 0 ? 1.0 : 0.0;
+            errors[0] = (output[0] - target) * output[0] * (1.0 - output[0]);
+        } else {
+            memcpy(errors, output, net->output_size * sizeof(double));
+            errors[ws->labels[b]] -= 1.0;
+        }
+        if (ws->soft_targets) distillation_errors(net, ws, output, ws->soft + b * os, errors);
+    }
+
+    // Hidden deltas go through the weights the batch was evaluated with
+    for (size_t b = 0; b < count; b++) {
+        const double *errors = ws->output_errors + b * os;
+        const double *hidden = ws->hidden + b * hs;
+        double *delta = ws->delta_hidden + b * hs;
+        for (size_t i = 0; i < net->hidden_size; i++) {
+            const double *row = net->w_hidden_output + i * os;
+            double sum = 0.0;
+            for (size_t j = 0; j < net->output_size; j++) sum += errors[j] * row[j];
+            delta[i] = sum * hidden[i] * (1.0 - hidden[i]);
+        }
+    }
+    ws->phase_seconds[NN_PHASE_BACKWARD] += nn_seconds() - forwarded;
+    return correct;
+}
+
+// Sum over the batch of the hidden -> output gradients of hidden neuron i
+static void output_row_gradient(Network *net, NNWorkspace *ws, size_t count, size_t i, double *g) {
+    const size_t hs = net->hidden_stride, os = net->output_stride;
+    memset(g, 0, net->output_size * sizeof(double));
+    for (size_t b = 0; b < count; b++) {
+        nn_kernels->axpy(net->output_size, ws->hidden[b * hs + i], ws->output_errors + b * os, g);
+    }
+}
+
+// Sum over the batch of the input -> hidden gradients of input j,
+// 0 if that input is 0 in every sample (nothing written then)
+static int input_row_gradient(Network *net, NNWorkspace *ws, size_t count, size_t j, double *g) {
+    const double *x = ws->inputs_t + j * ws->batch_size;
+    size_t b = 0;
+    while (b < count && x[b] == 0.0) b++;
+    if (b == count) return 0;
+
+    memset(g, 0, net->hidden_size * sizeof(double));
+    for (; b < count; b++) {
+        if (x[b] != 0.0) nn_kernels->axpy(net->hidden_size, x[b], ws->delta_hidden + b * net->hidden_stride, g);
+    }
+    return 1;
+}
+
+// Column sums of `count` rows of `stride` doubles
+static void sum_rows(const double *rows, size_t stride, size_t count, size_t n, double *sum) {
+    memset(sum, 0, n * sizeof(double));
+    for (size_t b = 0; b < count; b++) nn_kernels->add(n, rows + b * stride, sum);
+}
+
+// Update of first-layer row j, straight-through estimator (as in
+// backpropagate()) in binarized training: alpha moves by the change of
+// mean magnitude
+static void update_input_row(Network *net, const UpdateStep *s, size_t j, const double *g, double *alpha_delta) {
+    const size_t offset = j * net->hidden_stride;
+    double *row = net->w_input_hidden + offset;
+    if (!net->binarized) {
+        update_params(s, NN_OPT_W_INPUT_HIDDEN, offset, row, g, net->hidden_size);
+        return;
+    }
+    double *m = s->opt ? s->opt->m[NN_OPT_W_INPUT_HIDDEN] + offset : NULL;
+    double *v = s->opt && s->opt->v[NN_OPT_W_INPUT_HIDDEN] ? s->opt->v[NN_OPT_W_INPUT_HIDDEN] + offset : NULL;
+    for (size_t i = 0; i < net->hidden_size; i++) {
+        double old = row[i];
+        double updated = s->opt ? old + update_delta(s, g[i], m + i, v ? v + i : NULL) : old + s->step * g[i];
+        if (updated > 1.0) updated = 1.0;
+        if (updated < -1.0) updated = -1.0;
+        row[i] = updated;
+        alpha_delta[i] += (fabs(updated) - fabs(old)) / (double)net->input_size;
+    }
+}
+
+void training_batch_update(Network *net, NNWorkspace *ws, size_t count, double learning_rate) {
+    const UpdateStep s = update_step(ws->optimizer, learning_rate, count);
+    double *g = ws->row;
+    double started = nn_seconds();
+
+    for (size_t i = 0; i < net->hidden_size; i++) {
+        output_row_gradient(net, ws, count, i, g);
+        update_params(&s, NN_OPT_W_HIDDEN_OUTPUT, i * net->output_stride,
+                      net->w_hidden_output + i * net->output_stride, g, net->output_size);
+    }
+    sum_rows(ws->output_errors, net->output_stride, count, net->output_size, g);
+    update_params(&s, NN_OPT_BIAS_OUTPUT, 0, net->bias_output, g, net->output_size);
+
+    for (size_t j = 0; j < net->input_size; j++) {
+        if (input_row_gradient(net, ws, count, j, g)) update_input_row(net, &s, j, g, net->alpha_hidden);
+    }
+
+    sum_rows(ws->delta_hidden, net->hidden_stride, count, net->hidden_size, g);
+    update_params(&s, NN_OPT_BIAS_HIDDEN, 0, net->bias_hidden, g, net->hidden_size);
+
+    // Hogwild threads share the optimizer
+    if (ws->optimizer) __atomic_fetch_add(&ws->optimizer->step, 1, __ATOMIC_RELAXED);
+    ws->phase_seconds[NN_PHASE_UPDATE] += nn_seconds() - started;
+}
+
+NNGradients *create_gradients(const Network *net) {
+    NNGradients *g = calloc(1, sizeof(NNGradients));
+    g->w_input_hidden = alloc_aligned(net->input_size * net->hidden_stride);
+    g->w_hidden_output = alloc_aligned(net->hidden_size * net->output_stride);
+    g->bias_hidden = alloc_aligned(net->hidden_size);
+    g->bias_output = alloc_aligned(net->output_size);
+    g->alpha_delta = alloc_aligned(net->hidden_size);
+    g->input_active = calloc(net->input_size, 1);
+    return g;
+}
+
+void free_gradients(NNGradients *g) {
+    if (!g) return;
+    free(g->w_input_hidden);
+    free(g->w_hidden_output);
+    free(g->bias_hidden);
+    free(g->bias_output);
+    free(g->alpha_delta);
+    free(g->input_active);
+    free(g);
+}
+
+void training_batch_gradients(Network *net, NNWorkspace *ws, size_t count, NNGradients *g) {
+    double started = nn_seconds();
+    for (size_t i = 0; i < net->hidden_size; i++) {
+        output_row_gradient(net, ws, count, i, g->w_hidden_output + i * net->output_stride);
+    }
+    sum_rows(ws->output_errors, net->output_stride, count, net->output_size, g->bias_output);
+    sum_rows(ws->delta_hidden, net->hidden_stride, count, net->hidden_size, g->bias_hidden);
+    for (size_t j = 0; j < net->input_size; j++) {
+        g->input_active[j] = (uint8_t)input_row_gradient(net, ws, count, j, g->w_input_hidden + j * net->hidden_stride);
+    }
+    ws->phase_seconds[NN_PHASE_BACKWARD] += nn_seconds() - started;
+}
+
+void add_gradients(const Network *net, NNGradients *g, NNGradients *other) {
+    const NNKernels *k = nn_kernels;
+    k->add(net->hidden_size * net->output_stride, other->w_hidden_output, g->w_hidden_output);
+    k->add(net->output_size, other->bias_output, g->bias_output);
+    k->add(net->hidden_size, other->bias_hidden, g->bias_hidden);
+    for (size_t j = 0; j < net->input_size; j++) {
+        if (!other->input_active[j]) continue;
+        double *dst = g->w_input_hidden + j * net->hidden_stride;
+        const double *src = other->w_input_hidden + j * net->hidden_stride;
+        if (g->input_active[j]) {
+            k->add(net->hidden_size, src, dst);
+        } else {
+            memcpy(dst, src, net->hidden_size * sizeof(double));
+            g->input_active[j] = 1;
+        }
+        other->input_active[j] = 0;
+    }
+}
+
+void apply_gradients(Network *net, NNGradients *g, NNOptimizer *optimizer, double learning_rate,
+                     size_t count, size_t first_input, size_t end_input, int output_layer,
+                     double *alpha_delta) {
+    const UpdateStep s = update_step(optimizer, learning_rate, count);
+
+    for (size_t j = first_input; j < end_input; j++) {
+        if (!g->input_active[j]) continue;
+        update_input_row(net, &s, j, g->w_input_hidden + j * net->hidden_stride, alpha_delta);
+        g->input_active[j] = 0;
+    }
+
+    if (output_layer) {
+        update_params(&s, NN_OPT_W_HIDDEN_OUTPUT, 0, net->w_hidden_output, g->w_hidden_output,
+                      net->hidden_size * net->output_stride);
+        update_params(&s, NN_OPT_BIAS_OUTPUT, 0, net->bias_output, g->bias_output, net->output_size);
+        update_params(&s, NN_OPT_BIAS_HIDDEN, 0, net->bias_hidden, g->bias_hidden, net->hidden_size);
+    }
+}
+
+void train_minibatch(Network *net, TrainingExample *examples, size_t num_examples, const TrainConfig *config) {
+    if (config->batch_size <= 1) {
+        train_epochs(net, examples, num_examples, config);
+        return;
+    }
+    if (!nn_trainable(net)) return;
+
+    // Generated code has the old weights baked in
+    net->specialized = NULL;
+
+    const size_t batch = config->batch_size;
+    printf("Training started (mini-batches of %zu)...\n", batch);
+    NNWorkspace *ws = create_workspace(net, batch);
+    ws->optimizer = config->optimizer;
+    training_soft_targets(ws, config);
+    const int first_epoch = config->optimizer ? config->optimizer->epoch : 0;
+    size_t *order = malloc((num_examples ? num_examples : 1) * sizeof(size_t));
+    for (size_t i = 0; i < num_examples; i++) order[i] = i;
+
+    for (int epoch = 0; epoch < config->epochs; epoch++) {
+        double started = nn_seconds();
+        training_stats_reset(ws);
+        if (config->epoch_begin) config->epoch_begin(epoch, config->epoch_begin_data);
+        double learning_rate = scheduled_learning_rate(config, first_epoch, epoch);
+        shuffle_order(order, num_examples);
+        ws->phase_seconds[NN_PHASE_DATA] += nn_seconds() - started;
+
+        // Accuracy of the predictions made before each update (free,
+        // unlike a separate pass over the whole set)
+        size_t correct = 0;
+        for (size_t start = 0; start < num_examples; start += batch) {
+            size_t count = num_examples - start < batch ? num_examples - start : batch;
+            training_batch_load(net, ws, examples, order + start, count);
+            correct += training_batch_pass(net, ws, count);
+            training_batch_update(net, ws, count, learning_rate);
+        }
+
+        NNEpochStats stats;
+        training_epoch_stats(&stats, ws, epoch, num_examples, correct, ws->loss, learning_rate, started);
+        if (training_epoch_end(net, config, epoch, &stats)) break;
+    }
+
+    free(order);
+    free_workspace(ws);
 }
@@ -3,31 +3,429 @@
 
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <math.h>
 #include <time.h>
 #include <stdio.h>
 
+// Alignment of the weight matrices (one cache line)
+#define NN_ALIGNMENT 64
+
+// Activations are quantized to [0, NN_I8_ACT_MAX] in int8 mode
+#define NN_I8_ACT_MAX 127
+
+// Same contract as forward(), for one fixed model (see `ocr_trainer codegen`)
+typedef double *(*NNForwardFn)(const double *input, double *hidden, double *output);
+
+// Storage type of the weights
+typedef enum {
+    NN_DTYPE_F64 = 0,   // Training and reference inference
+    NN_DTYPE_F32 = 1,   // Inference only
+    NN_DTYPE_I8  = 2,   // Inference only, int8 weights with one scale per neuron
+    NN_DTYPE_BIN = 3    // Inference only, sign-binarized first layer, float64 second layer
+} NNDtype;
+
 typedef struct {
     size_t input_size;
     size_t hidden_size;
     size_t output_size;
+    NNDtype dtype;
+
+    // Contiguous weight matrices, one row per source neuron:
+    // w_input_hidden[i * hidden_stride + j] links input i to hidden neuron j.
+    // Rows are padded so every row is 64-byte aligned (padding is always 0).
+    // Only the matrices of the network's dtype are allocated, strides count
+    // elements of that type.
+    double *w_input_hidden;
+    double *w_hidden_output;
+    size_t hidden_stride;
+    size_t output_stride;
+
+    float *w_input_hidden_f32;
+    float *w_hidden_output_f32;
+
+    // int8: real weight = q * scale of the destination neuron
+    int8_t *w_input_hidden_i8;
+    int8_t *w_hidden_output_i8;
+    float *scale_hidden;
+    float *scale_output;
+
+    // Binarized first layer: one row of NN_PACKED_WORDS(input_size) words per
+    // hidden neuron, bit j set when the weight from input j is positive.
+    // Real weight = +/- alpha_hidden of the neuron. The second layer stays in
+    // the float64 matrices.
+    uint64_t *w_input_hidden_bin;
+    double *alpha_hidden;
+
+    // float64 network trained for binarization (straight-through estimator):
+    // the first layer is evaluated as alpha_hidden[j] * sign(w) while the
+    // real weights keep receiving the gradients
+    int binarized;
+
+    // Code-generated forward for exactly these weights, NULL if none
+    NNForwardFn specialized;
+
+    // v2 model image holding the weight blocks above, NULL if they were
+    // allocated: a private (copy-on-write) file mapping that free_network
+    // unmaps, or memory owned by someone else (the embedded model)
+    void *mapping;
+    size_t mapping_size;
+    int mapping_owned;
+    int read_only;      // The image can't be written (e.g. in .rodata)
+
+    // Row pointers into the matrices above, kept for compatibility:
+    // weights_input_hidden[i][j] == w_input_hidden[i * hidden_stride + j]
     double **weights_input_hidden;
     double **weights_hidden_output;
     double *bias_hidden;
     double *bias_output;
 } Network;
 
+// One training sample: a 0/1 glyph bit-packed as by pack_input(), the
+// trainers unpack it on the fly into their workspace
 typedef struct {
-    double *pixels;
+    const uint64_t *bits;
     int label;
 } TrainingExample;
 
 Network* create_network(size_t input, size_t hidden, size_t output);
+
+// Zeroed network of the given dtype (weights are not initialized)
+Network* create_network_dtype(size_t input, size_t hidden, size_t output, NNDtype dtype);
+
+// Network of the given dtype with its strides set but no weight blocks:
+// the caller points the blocks somewhere (e.g. a file mapping) and then
+// calls link_network_rows() to build the row pointers
+Network* create_network_shell(size_t input, size_t hidden, size_t output, NNDtype dtype);
+void link_network_rows(Network *net);
+
+// Reduced-precision copy of a float64 network, for inference only
+Network* quantize_network(const Network *net, NNDtype dtype);
+const char* nn_dtype_name(NNDtype dtype);
+
+// 1 if net can be trained: float64 weights that may be written (not a
+// read-only model image). Otherwise prints why and returns 0.
+int nn_trainable(const Network *net);
+
+// Switches a float64 network to (or back from) binarized training
+void set_binarized_training(Network *net, int enabled);
+
+// Copies the weights of a float64 network (binarized training state
+// included) into another float64 network of the same shape
+void copy_network_weights(Network *dst, const Network *src);
+
+// Description of a code-generated model, emitted next to its forward function
+typedef struct {
+    const char *name;
+    size_t input_size;
+    size_t hidden_size;
+    size_t output_size;
+    uint64_t fingerprint;
+    NNForwardFn forward;
+} NNGeneratedModel;
+
+// FNV-1a hash of the sizes, weights and biases of a float64 network (0 otherwise)
+uint64_t nn_fingerprint(const Network *net);
+
+// Routes forward() through the generated code if it was generated from
+// these exact weights. Returns 1 when attached.
+int nn_attach_generated(Network *net, const NNGeneratedModel *model);
+size_t nn_padded_size(size_t count);
 void free_network(Network* net);
 void initialize_weights(Network* net);
 double sigmoid(double x);
 double *forward(Network* net, double *input, double *hidden, double *output);
-void backpropagate(Network* net, double *input, double *target, double learning_rate);
+
+// Glyphs per tile and input rows per tile of forward_batch
+// (NN_INPUT_TILE must stay a multiple of 64, one packed word)
+#define NN_BATCH_TILE 16
+#define NN_INPUT_TILE 64
+
+// Bit-packed binary glyph: bit j (LSB first in each 64-bit word) is set when
+// input j is non-zero. 900 inputs fit in 15 words.
+// Returns 1 if every input was 0 or 1 (the packed glyph is exact).
+#define NN_PACKED_WORDS(n) (((n) + 63) / 64)
+int pack_input(const double *input, size_t n, uint64_t *bits);
+void unpack_input(const uint64_t *bits, size_t n, double *input);
+
+// Same result as forward() on the unpacked 0/1 glyph, but the first layer
+// only reads the weight rows of the set pixels (one vector add each)
+double *forward_packed(Network *net, const uint64_t *bits, double *hidden, double *output);
+
+// Runs `count` inputs at once: inputs is count x input_size (row-major),
+// outputs is count x output_size. Same results as calling forward() on each row.
+void forward_batch(Network *net, const double *inputs, double *outputs, size_t count);
+// Learning rate along the epochs of a training run
+typedef enum {
+    NN_SCHEDULE_CONSTANT = 0,
+    NN_SCHEDULE_COSINE = 1,     // Half cosine from learning_rate down to 0
+    NN_SCHEDULE_STEP = 2        // Multiplied by step_gamma every step_epochs
+} NNSchedule;
+
+// Optimizer of the training steps (train_minibatch, train_data_parallel;
+// backpropagate() stays plain SGD). Its state carries over from one run to
+// the next: the moment buffers, laid out like the weights (padded rows),
+// the number of updates for Adam's bias correction, the epochs trained
+// and the learning-rate schedule they followed.
+typedef enum {
+    NN_OPTIMIZER_SGD = 0,       // No state
+    NN_OPTIMIZER_MOMENTUM = 1,  // Heavy ball: velocity = beta1 * velocity - rate * gradient
+    NN_OPTIMIZER_ADAM = 2
+} NNOptimizerKind;
+
+// Moment blocks, in the order of the weights they follow
+enum {
+    NN_OPT_W_INPUT_HIDDEN,
+    NN_OPT_W_HIDDEN_OUTPUT,
+    NN_OPT_BIAS_HIDDEN,
+    NN_OPT_BIAS_OUTPUT,
+    NN_OPT_BLOCKS
+};
+
+typedef struct {
+    NNOptimizerKind kind;
+    double beta1;                   // Momentum, or Adam's first moment decay
+    double beta2;                   // Adam's second moment decay
+    double epsilon;
+    uint64_t step;                  // Updates applied so far
+    int epoch;                      // Epochs trained so far
+
+    // Schedule of the runs that trained the state, in the terms of
+    // TrainConfig (schedule_epochs resolved to the cosine's last epoch),
+    // for a resumed run to follow. learning_rate 0: none recorded.
+    NNSchedule schedule;
+    double learning_rate;
+    int warmup_epochs;
+    int schedule_epochs;
+    int step_epochs;
+    double step_gamma;
+
+    double *m[NN_OPT_BLOCKS];       // Velocity (momentum) or first moment (Adam)
+    double *v[NN_OPT_BLOCKS];       // Second moment, Adam only
+} NNOptimizer;
+
+// Zeroed state with the usual hyper-parameters (beta1 0.9, Adam's beta2
+// 0.999 and epsilon 1e-8)
+NNOptimizer* create_optimizer(const Network *net, NNOptimizerKind kind);
+void free_optimizer(NNOptimizer *opt);
+// Copies the whole state into another state of the same kind, for net
+void copy_optimizer(NNOptimizer *dst, const NNOptimizer *src, const Network *net);
+const char* nn_optimizer_name(NNOptimizerKind kind);
+
+// Doubles in moment block `block` (padded like the weights)
+size_t optimizer_block_size(const Network *net, int block);
+
+// Where the time of a training epoch goes. The training steps time
+// themselves: loading batches (data), the forward pass, the output errors,
+// hidden deltas and separate gradients (backward), and the weight updates
+// (update: the fused gradient-and-update steps, training_batch_update and
+// backpropagate, count there whole, as do the reduction of the thread
+// gradients and the waits at the barriers). Eval is the trainer's time in
+// TrainConfig.epoch_end (handing weights to the validation thread).
+typedef enum {
+    NN_PHASE_DATA,
+    NN_PHASE_FORWARD,
+    NN_PHASE_BACKWARD,
+    NN_PHASE_UPDATE,
+    NN_PHASE_EVAL,
+    NN_PHASE_COUNT
+} NNPhase;
+
+const char* nn_phase_name(NNPhase phase);
+
+// Monotonic clock, in seconds
+double nn_seconds(void);
+
+// Measurements of one training epoch (see TrainConfig.epoch_stats)
+typedef struct {
+    int epoch;                  // 1-based, in this run
+    size_t samples;
+    size_t correct;             // Predictions made before each update
+    double loss;                // Their mean cross-entropy
+    double learning_rate;
+    double seconds;             // Wall time of the epoch, eval included
+    double phase_seconds[NN_PHASE_COUNT];
+} NNEpochStats;
+
+// Scratch buffers of one training/inference thread, sized once from the
+// network shape and batch size so the per-sample path allocates nothing.
+// Batch buffers hold one row per sample (rows padded like the weights),
+// the per-sample path uses row 0.
+typedef struct {
+    size_t batch_size;
+    double *hidden;
+    double *output;
+    double *output_errors;
+    double *delta_hidden;
+    double *target;         // One-hot target, all zeros between samples
+    int *labels;            // Labels of the batch
+    double *inputs_t;       // Batch inputs transposed: input_size rows of batch_size
+    double *input;          // Unpacked input of the per-sample path
+    double *row;            // One weight row (gradient, binarized weights)
+
+    // Moments updated by training_batch_update, shared by the workspaces
+    // of a run (NULL = plain SGD)
+    NNOptimizer *optimizer;
+
+    // Distillation targets (see TrainConfig.soft_targets, set by
+    // training_soft_targets): soft holds the rows of the loaded batch
+    const float *soft_targets;
+    double temperature;
+    double soft_weight;
+    double *soft;
+
+    // Added up by the training steps of this thread since the last
+    // training_stats_reset(): cross-entropy of the predictions and seconds
+    // by phase
+    double loss;
+    double phase_seconds[NN_PHASE_COUNT];
+} NNWorkspace;
+
+NNWorkspace* create_workspace(const Network *net, size_t batch_size);
+void free_workspace(NNWorkspace *ws);
+
+void backpropagate(Network* net, NNWorkspace *ws, double *input, double *target, double learning_rate);
 void train(Network* net, TrainingExample* examples, size_t num_examples, int epochs, float learning_rate);
 
+// Training options, train_config_default() gives the per-sample SGD of train()
+typedef struct {
+    int epochs;
+    double learning_rate;
+    size_t batch_size;      // Samples per weight update (1 = per-sample SGD)
+    int threads;            // Training threads (see train_data_parallel, 0 = one per core)
+    int hogwild;            // Lock-free asynchronous updates instead of one update per batch
+    unsigned int seed;      // Weight init and shuffles, 0 = from the clock
+
+    // Held-out examples, never trained on (see train_data_parallel): the
+    // weights are evaluated on them every eval_every epochs, and training
+    // stops once the validation loss hasn't improved for `patience`
+    // evaluations (0 = never stop early)
+    const TrainingExample *validation;
+    size_t validation_count;
+    int eval_every;
+    int patience;
+
+    // Called by the training loops at the end of every epoch, returns 1 to
+    // stop. NULL: stop once the training accuracy exceeds 99.9%.
+    int (*epoch_end)(Network *net, int epoch, void *data);
+    void *epoch_data;
+
+    // Called by the training loops before every epoch, while no thread
+    // reads the examples (e.g. to swap in augmented glyphs, see nn_augment.h)
+    void (*epoch_begin)(int epoch, void *data);
+    void *epoch_begin_data;
+
+    // Measurements for a training log (see nn_telemetry.h): epoch_stats
+    // gets every epoch once it ended, validation_stats every evaluation of
+    // the held-out examples once it finished, possibly from another
+    // thread and before the epoch_stats of its epoch. NULL = not recorded.
+    void (*epoch_stats)(const NNEpochStats *stats, void *data);
+    void (*validation_stats)(int epoch, double loss, double accuracy, double seconds, void *data);
+    void *stats_data;
+
+    // Optimizer state the run updates (NULL = plain SGD, no state)
+    NNOptimizer *optimizer;
+
+    // Distillation: soft_targets + i * output_size are a teacher's
+    // probabilities for example i at `temperature` (NULL = labels only).
+    // The error of every sample is soft_weight of the distillation term,
+    // T^2 * KL(teacher || student at temperature T), and 1 - soft_weight
+    // of the cross-entropy of the label. Examples are indexed as given to
+    // the training loop; the epoch loss (NNEpochStats) stays the label's.
+    const float *soft_targets;
+    double temperature;
+    double soft_weight;
+
+    // learning_rate is the peak rate: reached linearly over warmup_epochs,
+    // then decayed by the schedule. Epochs count from the first epoch the
+    // optimizer state ever trained, so a resumed run picks the schedule up
+    // where the previous one left it.
+    NNSchedule schedule;
+    int warmup_epochs;
+    int schedule_epochs;    // Cosine: epochs to decay over, 0 = to the end of this run
+    int step_epochs;
+    double step_gamma;
+} TrainConfig;
+
+void train_config_default(TrainConfig *config);
+const char* nn_schedule_name(NNSchedule schedule);
+
+// Learning rate of epoch `epoch` of a run that started after first_epoch
+// epochs of training
+double scheduled_learning_rate(const TrainConfig *config, int first_epoch, int epoch);
+
+// Reports the measurements of an epoch (stats->seconds so far, eval time
+// is added), counts the epoch in the optimizer state and returns 1 if
+// training should stop, for the training loops
+int training_epoch_end(Network *net, const TrainConfig *config, int epoch, NNEpochStats *stats);
+
+// Gives a training loop's workspace the distillation targets of the run
+void training_soft_targets(NNWorkspace *ws, const TrainConfig *config);
+
+// Zeroes the sums of the workspace, at the start of every epoch
+void training_stats_reset(NNWorkspace *ws);
+
+// Stats of epoch `epoch` (0-based) that began at `started` (nn_seconds()):
+// loss is the summed cross-entropy, the phase times are those of ws
+void training_epoch_stats(NNEpochStats *stats, const NNWorkspace *ws, int epoch, size_t samples, size_t correct,
+                          double loss, double learning_rate, double started);
+
+// Seeds the generator behind initialize_weights() and the epoch shuffles
+// (otherwise seeded from the clock on first use)
+void seed_network_rng(unsigned int seed);
+void shuffle_order(size_t *order, size_t count);
+
+// Mini-batch gradient descent on a float64 network (binarized training
+// included): the examples are reshuffled every epoch and each batch gets
+// one update with its mean gradient. Activations, deltas and gradients of
+// the whole batch are computed layer by layer, so every weight row is read
+// once and written once per batch instead of once per sample.
+void train_minibatch(Network *net, TrainingExample *examples, size_t num_examples, const TrainConfig *config);
+
+// Steps of train_minibatch, for trainers that split batches across threads.
+// Only the update steps write the network.
+
+// examples[order[0..count)] into ws (count <= ws->batch_size)
+void training_batch_load(Network *net, NNWorkspace *ws, const TrainingExample *examples,
+                         const size_t *order, size_t count);
+
+// Forward pass, output errors and hidden deltas of the loaded batch.
+// Returns how many samples were predicted right.
+size_t training_batch_pass(Network *net, NNWorkspace *ws, size_t count);
+
+// Applies the mean gradient of the batch in place (no gradient buffers),
+// through ws->optimizer if set. Input rows that were 0 in the whole batch
+// are skipped, their moments included (lazy updates of sparse rows).
+void training_batch_update(Network *net, NNWorkspace *ws, size_t count, double learning_rate);
+
+// Summed gradients of a batch, laid out like the weights. Input rows whose
+// input was 0 in the whole batch are not stored (input_active[j] == 0).
+typedef struct {
+    double *w_input_hidden;
+    double *w_hidden_output;
+    double *bias_hidden;
+    double *bias_output;
+    uint8_t *input_active;
+    double *alpha_delta;    // Scratch for apply_gradients (binarized training)
+} NNGradients;
+
+NNGradients* create_gradients(const Network *net);
+void free_gradients(NNGradients *g);
+
+// Overwrites g with the gradients of the batch in ws
+void training_batch_gradients(Network *net, NNWorkspace *ws, size_t count, NNGradients *g);
+
+// g += other, other's input rows are consumed
+void add_gradients(const Network *net, NNGradients *g, NNGradients *other);
+
+// Mean-gradient step for the input rows [first_input, end_input) and, if
+// output_layer, the second layer and both biases. Applied rows are consumed.
+// In binarized training alpha_hidden is not touched, its change is added
+// to alpha_delta (so several threads can update disjoint rows).
+// With an optimizer, the caller adds 1 to optimizer->step once every part
+// of the update was applied.
+void apply_gradients(Network *net, NNGradients *g, NNOptimizer *optimizer, double learning_rate,
+                     size_t count, size_t first_input, size_t end_input, int output_layer,
+                     double *alpha_delta);
+
 #endif
@@ -0,0 +1,288 @@
+#include "nn_augment.h"
+#include <glib.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void augment_config_default(NNAugmentConfig *config, size_t side) {
+    config->side = side;
+    config->shift = 1.5;
+    config->rotation = 8.0;
+    config->scale = 0.1;
+    config->morphology = 0.15;
+    config->noise = 0.01;
+    config->threads = 0;
+    config->seed = 0;
+    config->first_epoch = 0;
+}
+
+// splitmix64: a few draws per glyph from a key, no shared generator state
+static uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Uniform in [0, 1)
+static double random_unit(uint64_t *state) {
+    return (double)(next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Uniform in [-1, 1)
+static double random_signed(uint64_t *state) {
+    return 2.0 * random_unit(state) - 1.0;
+}
+
+// Glyphs are handled as one bit mask per row (bit x of rows[y] is pixel
+// (x, y)), so the morphology is a few shifts per row
+#define AUGMENT_MAX_SIDE 64
+
+// Rotation, scale and translation around the center: every destination
+// pixel samples the source bilinearly and keeps the ink above 1/2
+static void warp_rows(const uint64_t *src, uint64_t *dst, int side, double angle, double scale, double dx, double dy) {
+    // Source with an empty one-pixel border: the four taps never leave it
+    const int stride = side + 2;
+    float plane[(AUGMENT_MAX_SIDE + 2) * (AUGMENT_MAX_SIDE + 2)];
+    memset(plane, 0, (size_t)stride * stride * sizeof(float));
+    for (int y = 0; y < side; y++) {
+        for (uint64_t row = src[y]; row; row &= row - 1) plane[(y + 1) * stride + __builtin_ctzll(row) + 1] = 1.0f;
+    }
+
+    // Coordinates move by (c, -s) along a row. In-range ones are > -1, so
+    // truncation after adding the border is floor().
+    const double center = (side - 1) / 2.0;
+    const double c = cos(angle) / scale, s = sin(angle) / scale;
+    for (int y = 0; y < side; y++) {
+        double px = -center - dx, py = y - center - dy;
+        double sx = c * px + s * py + center;
+        double sy = -s * px + c * py + center;
+        uint64_t row = 0;
+        for (int x = 0; x < side; x++, sx += c, sy -= s) {
+            if (sx <= -1.0 || sy <= -1.0 || sx >= side || sy >= side) continue;
+
+            int x0 = (int)(sx + 1.0), y0 = (int)(sy + 1.0);
+            double fx = sx + 1.0 - x0, fy = sy + 1.0 - y0;
+            const float *tap = plane + y0 * stride + x0;
+            double top = tap[0] + fx * (tap[1] - tap[0]);
+            double bottom = tap[stride] + fx * (tap[stride + 1] - tap[stride]);
+            if (top + fy * (bottom - top) >= 0.5) row |= (uint64_t)1 << x;
+        }
+        dst[y] = row;
+    }
+}
+
+// One-pixel dilation (dilate) or erosion with a cross, outside is empty.
+// Returns the ink left.
+static int morph_rows(const uint64_t *src, uint64_t *dst, int side, int dilate) {
+    const uint64_t mask = side == 64 ? ~(uint64_t)0 : ((uint64_t)1 << side) - 1;
+    int ink = 0;
+    for (int y = 0; y < side; y++) {
+        uint64_t above = y > 0 ? src[y - 1] : 0, below = y + 1 < side ? src[y + 1] : 0;
+        uint64_t row = src[y];
+        row = dilate ? row | row << 1 | row >> 1 | above | below
+                     : row & row << 1 & row >> 1 & above & below;
+        dst[y] = row & mask;
+        ink += __builtin_popcountll(dst[y]);
+    }
+    return ink;
+}
+
+void augment_glyph(const NNAugmentConfig *config, const uint64_t *src, uint64_t *dst, uint64_t key) {
+    const int side = (int)config->side;
+    const size_t n = config->side * config->side;
+    uint64_t rows[AUGMENT_MAX_SIDE], scratch[AUGMENT_MAX_SIDE];
+    uint64_t state = key;
+
+    if (side > AUGMENT_MAX_SIDE) {
+        memcpy(dst, src, NN_PACKED_WORDS(n) * sizeof(uint64_t));
+        return;
+    }
+
+    int ink = 0;
+    memset(rows, 0, sizeof(rows));
+    for (size_t w = 0; w < NN_PACKED_WORDS(n); w++) {
+        for (uint64_t word = src[w]; word; word &= word - 1) {
+            size_t i = w * 64 + (size_t)__builtin_ctzll(word);
+            rows[i / side] |= (uint64_t)1 << (i % side);
+            ink++;
+        }
+    }
+
+    // The transform is drawn whatever the config, so one setting doesn't
+    // change the draws of another
+    double angle = config->rotation * M_PI / 180.0 * random_signed(&state);
+    double scale = 1.0 + config->scale * random_signed(&state);
+    double dx = config->shift * random_signed(&state);
+    double dy = config->shift * random_signed(&state);
+    double morph = random_unit(&state);
+
+    if (angle != 0.0 || scale != 1.0 || dx != 0.0 || dy != 0.0) {
+        warp_rows(rows, scratch, side, angle, scale, dx, dy);
+        memcpy(rows, scratch, side * sizeof(uint64_t));
+    }
+
+    // An erosion that would wipe out more than half the ink (thin strokes)
+    // is dropped
+    if (morph < 2.0 * config->morphology) {
+        int dilate = morph < config->morphology;
+        int left = morph_rows(rows, scratch, side, dilate);
+        if (dilate || 2 * left >= ink) memcpy(rows, scratch, side * sizeof(uint64_t));
+    }
+
+    // Salt noise: the gaps between flipped pixels are geometric, a draw per
+    // flip instead of one per pixel
+    if (config->noise >= 1.0) {
+        for (int y = 0; y < side; y++) rows[y] = ~rows[y] & (side == 64 ? ~(uint64_t)0 : ((uint64_t)1 << side) - 1);
+    } else if (config->noise > 0.0) {
+        const double log_keep = log(1.0 - config->noise);
+        for (double i = -1.0;;) {
+            i += floor(log(1.0 - random_unit(&state)) / log_keep) + 1.0;
+            if (i >= (double)n) break;
+            size_t pixel = (size_t)i;
+            rows[pixel / side] ^= (uint64_t)1 << (pixel % side);
+        }
+    }
+
+    memset(dst, 0, NN_PACKED_WORDS(n) * sizeof(uint64_t));
+    for (int y = 0; y < side; y++) {
+        for (uint64_t row = rows[y]; row; row &= row - 1) {
+            size_t i = (size_t)y * side + (size_t)__builtin_ctzll(row);
+            dst[i / 64] |= (uint64_t)1 << (i % 64);
+        }
+    }
+}
+
+// Glyphs per producer job
+#define AUGMENT_CHUNK 512
+
+typedef struct {
+    NNAugmenter *augmenter;
+    int buffer;
+    size_t first;
+    size_t end;
+} AugmentJob;
+
+struct NNAugmenter {
+    NNAugmentConfig config;
+    TrainingExample *examples;
+    size_t count;
+    size_t words;
+    const uint64_t **originals;     // Glyph of every example before augmentation
+    uint64_t *buffers[2];           // Glyph i at buffers[b] + i * words
+    int buffer_epoch[2];            // Epoch the buffer holds (or is being filled with), -1 if none
+    AugmentJob *jobs[2];
+    int jobs_per_buffer;
+    GThreadPool *producers;         // NULL on a single core: the trainer's thread augments
+    GMutex lock;
+    GCond done;
+    int pending[2];                 // Jobs left per buffer
+};
+
+static void augment_range(NNAugmenter *a, int buffer, size_t first, size_t end) {
+    // Counted like scheduled_learning_rate: from the first epoch ever trained
+    const uint64_t epoch = (uint64_t)a->config.first_epoch + (uint64_t)a->buffer_epoch[buffer];
+    for (size_t i = first; i < end; i++) {
+        uint64_t key = ((uint64_t)a->config.seed * 0x9E3779B97F4A7C15ull + epoch) * 0x9E3779B97F4A7C15ull + i;
+        augment_glyph(&a->config, a->originals[i], a->buffers[buffer] + i * a->words, key);
+    }
+}
+
+static void augment_job(gpointer data, gpointer user_data) {
+    (void)user_data;
+    AugmentJob *job = (AugmentJob*)data;
+    NNAugmenter *a = job->augmenter;
+    augment_range(a, job->buffer, job->first, job->end);
+
+    g_mutex_lock(&a->lock);
+    if (--a->pending[job->buffer] == 0) g_cond_broadcast(&a->done);
+    g_mutex_unlock(&a->lock);
+}
+
+// Fills `buffer` with the glyphs of `epoch`, in the background if there are producers
+static void produce_epoch(NNAugmenter *a, int buffer, int epoch) {
+    a->buffer_epoch[buffer] = epoch;
+    if (!a->producers) {
+        augment_range(a, buffer, 0, a->count);
+        return;
+    }
+
+    g_mutex_lock(&a->lock);
+    a->pending[buffer] = a->jobs_per_buffer;
+    g_mutex_unlock(&a->lock);
+    for (int j = 0; j < a->jobs_per_buffer; j++) g_thread_pool_push(a->producers, &a->jobs[buffer][j], NULL);
+}
+
+static void wait_buffer(NNAugmenter *a, int buffer) {
+    g_mutex_lock(&a->lock);
+    while (a->pending[buffer] > 0) g_cond_wait(&a->done, &a->lock);
+    g_mutex_unlock(&a->lock);
+}
+
+NNAugmenter *augmenter_start(const NNAugmentConfig *config, TrainingExample *examples, size_t count) {
+    NNAugmenter *a = calloc(1, sizeof(NNAugmenter));
+    a->config = *config;
+    a->examples = examples;
+    a->count = count;
+    a->words = NN_PACKED_WORDS(config->side * config->side);
+    a->originals = malloc((count ? count : 1) * sizeof(uint64_t*));
+    for (size_t i = 0; i < count; i++) a->originals[i] = examples[i].bits;
+    g_mutex_init(&a->lock);
+    g_cond_init(&a->done);
+
+    int threads = config->threads > 0 ? config->threads : (int)g_get_num_processors();
+    if (threads > 1) a->producers = g_thread_pool_new(augment_job, NULL, threads, FALSE, NULL);
+
+    a->jobs_per_buffer = (int)((count + AUGMENT_CHUNK - 1) / AUGMENT_CHUNK);
+    for (int b = 0; b < 2; b++) {
+        a->buffers[b] = malloc((count ? count : 1) * a->words * sizeof(uint64_t));
+        a->buffer_epoch[b] = -1;
+        a->jobs[b] = malloc((a->jobs_per_buffer ? a->jobs_per_buffer : 1) * sizeof(AugmentJob));
+        for (int j = 0; j < a->jobs_per_buffer; j++) {
+            size_t first = (size_t)j * AUGMENT_CHUNK;
+            a->jobs[b][j] = (AugmentJob){ a, b, first, first + AUGMENT_CHUNK < count ? first + AUGMENT_CHUNK : count };
+        }
+    }
+
+    printf("Augmentation: shift %.1f px, rotation %.1f deg, scale %.0f%%, morphology %.0f%%, noise %.1f%%, %d producer(s)\n",
+           config->shift, config->rotation, config->scale * 100.0, config->morphology * 100.0,
+           config->noise * 100.0, a->producers ? threads : 0);
+    if (a->producers) produce_epoch(a, 0, 0);
+    return a;
+}
+
+void augmenter_epoch_begin(int epoch, void *augmenter) {
+    NNAugmenter *a = (NNAugmenter*)augmenter;
+    const int buffer = epoch % 2;
+
+    // Not produced in advance (first epoch without producers, or epochs
+    // out of sequence): made now
+    wait_buffer(a, buffer);
+    if (a->buffer_epoch[buffer] != epoch) produce_epoch(a, buffer, epoch);
+    wait_buffer(a, buffer);
+
+    for (size_t i = 0; i < a->count; i++) a->examples[i].bits = a->buffers[buffer] + i * a->words;
+
+    // Nothing reads the other buffer any more (the previous epoch is over).
+    // Without producers the next epoch is made when it begins.
+    if (a->producers) {
+        wait_buffer(a, 1 - buffer);
+        produce_epoch(a, 1 - buffer, epoch + 1);
+    }
+}
+
+void augmenter_free(NNAugmenter *a) {
+    if (!a) return;
+    if (a->producers) g_thread_pool_free(a->producers, FALSE, TRUE);
+    for (size_t i = 0; i < a->count; i++) a->examples[i].bits = a->originals[i];
+
+    for (int b = 0; b < 2; b++) {
+        free(a->buffers[b]);
+        free(a->jobs[b]);
+    }
+    free(a->originals);
+    g_mutex_clear(&a->lock);
+    g_cond_clear(&a->done);
+    free(a);
+}
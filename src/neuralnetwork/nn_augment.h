@@ -0,0 +1,46 @@
+#ifndef NN_AUGMENT_H
+#define NN_AUGMENT_H
+
+#include "neural_network.h"
+
+// Random distortions of the side x side glyphs of a training set, drawn
+// again every epoch. All zero: the glyphs are copied unchanged.
+typedef struct {
+    size_t side;            // Glyph width and height (pixels)
+    double shift;           // Max translation, pixels (sub-pixel, bilinear sampling)
+    double rotation;        // Max rotation, degrees
+    double scale;           // Max scale change (0.1 = 90% to 110%)
+    double morphology;      // Probability of a one-pixel dilation, and the same of an erosion
+    double noise;           // Probability of flipping each pixel (salt noise)
+    int threads;            // Producer threads, 0 = one per core
+    unsigned int seed;
+    int first_epoch;        // Epochs trained before this run: a resumed run draws new distortions
+} NNAugmentConfig;
+
+// Moderate distortions for 30x30 glyphs
+void augment_config_default(NNAugmentConfig *config, size_t side);
+
+// Distorted copy of a bit-packed glyph (src and dst don't overlap). Same
+// config and key, same result: the key picks the random draws.
+void augment_glyph(const NNAugmentConfig *config, const uint64_t *src, uint64_t *dst, uint64_t key);
+
+// Producer threads feeding a training run with augmented glyphs. The set
+// is double-buffered: while the trainer goes through the glyphs of one
+// epoch, the producers write those of the next epoch into the other
+// buffer. Glyph i of epoch e only depends on the seed, first_epoch + e and
+// i (not on the thread count).
+typedef struct NNAugmenter NNAugmenter;
+
+// Augments examples[0..count), which keep pointing at the original glyphs
+// until the first epoch begins. Producers start on epoch 0 at once (none
+// on a single core: each epoch is then made when it begins).
+NNAugmenter* augmenter_start(const NNAugmentConfig *config, TrainingExample *examples, size_t count);
+
+// TrainConfig.epoch_begin: points the examples at the glyphs of `epoch`
+// (waiting for the producers if they are behind) and starts on epoch + 1
+void augmenter_epoch_begin(int epoch, void *augmenter);
+
+// Waits for the producers and points the examples back at the original glyphs
+void augmenter_free(NNAugmenter *augmenter);
+
+#endif
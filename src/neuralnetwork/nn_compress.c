@@ -0,0 +1,196 @@
+#include "nn_compress.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Timed passes over the examples, the fastest one counts
+#define MEASURE_REPEATS 3
+
+const char *nn_prune_criterion_name(NNPruneCriterion criterion) {
+    switch (criterion) {
+    case NN_PRUNE_ACTIVATION: return "activation";
+    default:                  return "magnitude";
+    }
+}
+
+// Mean and variance of every hidden activation on the examples
+static void hidden_statistics(Network *net, const TrainingExample *examples, size_t count,
+                              double *mean, double *variance) {
+    double *hidden = malloc(net->hidden_size * sizeof(double));
+    double *output = malloc(net->output_size * sizeof(double));
+    double *sum_sq = calloc(net->hidden_size, sizeof(double));
+    memset(mean, 0, net->hidden_size * sizeof(double));
+
+    for (size_t i = 0; i < count; i++) {
+        forward_packed(net, examples[i].bits, hidden, output);
+        for (size_t j = 0; j < net->hidden_size; j++) {
+            mean[j] += hidden[j];
+            sum_sq[j] += hidden[j] * hidden[j];
+        }
+    }
+    for (size_t j = 0; j < net->hidden_size; j++) {
+        mean[j] = count ? mean[j] / count : 0.0;
+        variance[j] = count ? sum_sq[j] / count - mean[j] * mean[j] : 0.0;
+        if (variance[j] < 0.0) variance[j] = 0.0;
+    }
+
+    free(hidden);
+    free(output);
+    free(sum_sq);
+}
+
+typedef struct {
+    double score;
+    size_t unit;
+} UnitScore;
+
+// Best score first, ties by unit so the choice is deterministic
+static int compare_scores(const void *a, const void *b) {
+    const UnitScore *x = a, *y = b;
+    if (x->score != y->score) return x->score < y->score ? 1 : -1;
+    return x->unit < y->unit ? -1 : (x->unit > y->unit);
+}
+
+static int compare_units(const void *a, const void *b) {
+    const UnitScore *x = a, *y = b;
+    return x->unit < y->unit ? -1 : (x->unit > y->unit);
+}
+
+Network *prune_hidden_units(Network *net, size_t keep, NNPruneCriterion criterion,
+                            const TrainingExample *examples, size_t count) {
+    if (net->dtype != NN_DTYPE_F64 || net->binarized) {
+        fprintf(stderr, "Error: Only float64 models can be pruned\n");
+        return NULL;
+    }
+    if (keep == 0 || keep >= net->hidden_size) {
+        fprintf(stderr, "Error: Cannot prune %zu hidden units down to %zu\n", net->hidden_size, keep);
+        return NULL;
+    }
+
+    const size_t n_in = net->input_size, n_hid = net->hidden_size, n_out = net->output_size;
+    double *mean = malloc(n_hid * sizeof(double));
+    double *variance = malloc(n_hid * sizeof(double));
+    hidden_statistics(net, examples, count, mean, variance);
+
+    UnitScore *scores = malloc(n_hid * sizeof(UnitScore));
+    for (size_t j = 0; j < n_hid; j++) {
+        double in = 0.0, out = 0.0;
+        for (size_t i = 0; i < n_in; i++) in += net->w_input_hidden[i * net->hidden_stride + j] * net->w_input_hidden[i * net->hidden_stride + j];
+        for (size_t k = 0; k < n_out; k++) out += net->w_hidden_output[j * net->output_stride + k] * net->w_hidden_output[j * net->output_stride + k];
+        scores[j].unit = j;
+        scores[j].score = (criterion == NN_PRUNE_ACTIVATION ? sqrt(variance[j]) : sqrt(in)) * sqrt(out);
+    }
+    qsort(scores, n_hid, sizeof(UnitScore), compare_scores);
+    qsort(scores, keep, sizeof(UnitScore), compare_units);
+
+    Network *pruned = create_network_dtype(n_in, keep, n_out, NN_DTYPE_F64);
+    for (size_t s = 0; s < keep; s++) {
+        size_t j = scores[s].unit;
+        for (size_t i = 0; i < n_in; i++) {
+            pruned->w_input_hidden[i * pruned->hidden_stride + s] = net->w_input_hidden[i * net->hidden_stride + j];
+        }
+        memcpy(pruned->w_hidden_output + s * pruned->output_stride, net->w_hidden_output + j * net->output_stride,
+               n_out * sizeof(double));
+        pruned->bias_hidden[s] = net->bias_hidden[j];
+    }
+
+    // A removed unit now always outputs its mean activation
+    memcpy(pruned->bias_output, net->bias_output, n_out * sizeof(double));
+    for (size_t s = keep; s < n_hid; s++) {
+        size_t j = scores[s].unit;
+        for (size_t k = 0; k < n_out; k++) pruned->bias_output[k] += mean[j] * net->w_hidden_output[j * net->output_stride + k];
+    }
+
+    free(scores);
+    free(mean);
+    free(variance);
+    return pruned;
+}
+
+float *teacher_soft_targets(Network *teacher, const TrainingExample *examples, size_t count, double temperature) {
+    const size_t n_out = teacher->output_size;
+    double *hidden = malloc(teacher->hidden_size * sizeof(double));
+    double *output = malloc(n_out * sizeof(double));
+    float *targets = malloc((count ? count : 1) * n_out * sizeof(float));
+
+    // softmax(z / T) is the softmax output raised to 1 / T, renormalized
+    for (size_t i = 0; i < count; i++) {
+        forward_packed(teacher, examples[i].bits, hidden, output);
+        double sum = 0.0;
+        for (size_t k = 0; k < n_out; k++) {
+            output[k] = exp(log(output[k] > 1e-300 ? output[k] : 1e-300) / temperature);
+            sum += output[k];
+        }
+        for (size_t k = 0; k < n_out; k++) targets[i * n_out + k] = (float)(output[k] / sum);
+    }
+
+    free(hidden);
+    free(output);
+    return targets;
+}
+
+void measure_model(Network *net, const TrainingExample *examples, size_t count, const char *name, NNModelPoint *point) {
+    double *hidden = malloc(net->hidden_size * sizeof(double));
+    double *output = malloc(net->output_size * sizeof(double));
+    size_t correct = 0;
+    double best = 0.0;
+
+    for (int r = 0; r < MEASURE_REPEATS; r++) {
+        double started = nn_seconds();
+        correct = 0;
+        for (size_t i = 0; i < count; i++) {
+            forward_packed(net, examples[i].bits, hidden, output);
+            int predicted = 0;
+            for (size_t k = 1; k < net->output_size; k++) {
+                if (output[k] > output[predicted]) predicted = (int)k;
+            }
+            if (predicted == examples[i].label) correct++;
+        }
+        double seconds = nn_seconds() - started;
+        if (r == 0 || seconds < best) best = seconds;
+    }
+
+    memset(point, 0, sizeof(*point));
+    snprintf(point->name, sizeof(point->name), "%s", name);
+    point->hidden_size = net->hidden_size;
+    point->accuracy = count ? (double)correct / count * 100.0 : 0.0;
+    point->ns_per_glyph = count ? best / count * 1e9 : 0.0;
+
+    free(hidden);
+    free(output);
+}
+
+static int compare_points(const void *a, const void *b) {
+    const NNModelPoint *x = a, *y = b;
+    if (x->ns_per_glyph != y->ns_per_glyph) return x->ns_per_glyph < y->ns_per_glyph ? -1 : 1;
+    return x->accuracy > y->accuracy ? -1 : (x->accuracy < y->accuracy);
+}
+
+void print_pareto_table(const NNModelPoint *points, int count, double target) {
+    NNModelPoint *sorted = malloc((count ? count : 1) * sizeof(NNModelPoint));
+    memcpy(sorted, points, count * sizeof(NNModelPoint));
+    qsort(sorted, count, sizeof(NNModelPoint), compare_points);
+
+    // Fastest first: a model is on the front when no faster one is as accurate
+    int picked = -1;
+    double best_accuracy = -1.0;
+    printf("\n%-32s %7s %9s %9s %10s\n", "Model", "Hidden", "Weights", "Accuracy", "ns/glyph");
+    for (int i = 0; i < count; i++) {
+        const NNModelPoint *p = &sorted[i];
+        int pareto = p->accuracy > best_accuracy;
+        if (pareto) best_accuracy = p->accuracy;
+        if (pareto && picked < 0 && target > 0.0 && p->accuracy >= target) picked = i;
+        printf("%-32s %7zu %6zu KB %8.2f%% %10.0f  %s%s\n", p->name, p->hidden_size, p->weight_bytes / 1024,
+               p->accuracy, p->ns_per_glyph, pareto ? "pareto" : "", picked == i ? " <- target" : "");
+    }
+
+    if (target > 0.0) {
+        if (picked >= 0) {
+            printf("\nFastest model with %.2f%% accuracy or more: %s (%.0f ns/glyph)\n",
+                   target, sorted[picked].name, sorted[picked].ns_per_glyph);
+        } else {
+            printf("\nNo model reaches %.2f%% accuracy\n", target);
+        }
+    }
+    free(sorted);
+}
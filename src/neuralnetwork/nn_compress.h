@@ -0,0 +1,49 @@
+#ifndef NN_COMPRESS_H
+#define NN_COMPRESS_H
+
+#include "neural_network.h"
+
+// Smaller models from a trained one, for the `prune`, `distill` and
+// `pareto` modes: the time of a glyph is mostly the first layer, one
+// hidden row per set pixel, so it shrinks with the hidden layer.
+
+// How hidden units are ranked, the lowest scores are removed first
+typedef enum {
+    NN_PRUNE_MAGNITUDE = 0,     // ||weights in|| * ||weights out||
+    NN_PRUNE_ACTIVATION = 1     // Std of the activation on the examples * ||weights out||
+} NNPruneCriterion;
+
+const char* nn_prune_criterion_name(NNPruneCriterion criterion);
+
+// Float64 copy of net keeping its `keep` best hidden units, in their order.
+// The mean activation of every removed unit on the examples (count may be
+// 0) is folded into the output biases, so what a nearly constant unit
+// contributed is kept. NULL if net isn't a float64 network (binarized
+// training included) or keep isn't below its hidden size.
+Network* prune_hidden_units(Network *net, size_t keep, NNPruneCriterion criterion,
+                            const TrainingExample *examples, size_t count);
+
+// Teacher's probabilities for every example at `temperature` (the outputs
+// raised to 1 / temperature, renormalized): count rows of output_size
+// floats, for TrainConfig.soft_targets. Free with free().
+float* teacher_soft_targets(Network *teacher, const TrainingExample *examples, size_t count, double temperature);
+
+// One model of a size/accuracy trade-off
+typedef struct {
+    char name[64];
+    size_t hidden_size;
+    size_t weight_bytes;
+    double accuracy;            // Percent of the examples
+    double ns_per_glyph;        // Single-thread forward_packed, best of a few passes
+} NNModelPoint;
+
+// Accuracy and inference time of net on the examples (weight_bytes is
+// left to the caller)
+void measure_model(Network *net, const TrainingExample *examples, size_t count, const char *name, NNModelPoint *point);
+
+// Accuracy against time per glyph, fastest first. Models no other one
+// beats on both are marked Pareto-optimal, and the fastest of them with at
+// least target accuracy is the one to pick (target <= 0: none).
+void print_pareto_table(const NNModelPoint *points, int count, double target);
+
+#endif
@@ -0,0 +1,622 @@
+#include "nn_kernels.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NN_X86 1
+#include <immintrin.h>
+#endif
+
+// ==========================================
+//            SCALAR REFERENCE
+// ==========================================
+
+static void axpy_scalar(size_t n, double a, const double *x, double *y) {
+    for (size_t i = 0; i < n; i++) {
+        y[i] += a * x[i];
+    }
+}
+
+static void add_scalar(size_t n, const double *x, double *y) {
+    for (size_t i = 0; i < n; i++) {
+        y[i] += x[i];
+    }
+}
+
+static void axpy_f32_scalar(size_t n, float a, const float *x, float *y) {
+    for (size_t i = 0; i < n; i++) {
+        y[i] += a * x[i];
+    }
+}
+
+static void axpy_i8_scalar(size_t n, int32_t a, const int8_t *x, int32_t *y) {
+    for (size_t i = 0; i < n; i++) {
+        y[i] += a * x[i];
+    }
+}
+
+static void and_popcount_scalar(const uint64_t *x, const uint64_t *rows, size_t words, size_t count, int32_t *counts) {
+    for (size_t i = 0; i < count; i++) {
+        const uint64_t *row = rows + i * words;
+        int32_t c = 0;
+        for (size_t w = 0; w < words; w++) c += __builtin_popcountll(x[w] & row[w]);
+        counts[i] = c;
+    }
+}
+
+static void sigmoid_scalar(double *v, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        v[i] = 1.0 / (1.0 + exp(-v[i]));
+    }
+}
+
+static void softmax_scalar(double *v, size_t n) {
+    double max_val = v[0];
+    for (size_t i = 1; i < n; i++) {
+        if (v[i] > max_val) max_val = v[i];
+    }
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        v[i] = exp(v[i] - max_val);
+        sum += v[i];
+    }
+    for (size_t i = 0; i < n; i++) {
+        v[i] /= sum;
+    }
+}
+
+static const NNKernels kernels_scalar = {
+    NN_SIMD_SCALAR, "scalar", axpy_scalar, add_scalar, axpy_f32_scalar, axpy_i8_scalar,
+    and_popcount_scalar, sigmoid_scalar, softmax_scalar
+};
+
+#ifdef NN_X86
+
+// ==========================================
+//           VECTOR EXP (shared idea)
+// ==========================================
+// exp(x) = 2^n * exp(r), n = round(x / ln2), |r| <= ln2 / 2
+// exp(r) is a degree 12 Taylor polynomial (error < 1e-15 on that range).
+// n is rounded with the 1.5 * 2^52 trick, which also leaves n in the low
+// mantissa bits, so 2^n is built with integer ops only (works on SSE2).
+
+#define EXP_CLAMP 708.0
+#define EXP_LOG2E 1.4426950408889634
+#define EXP_LN2_HI 6.93147180369123816490e-01
+#define EXP_LN2_LO 1.90821492927058770002e-10
+#define EXP_MAGIC 6755399441055744.0    // 1.5 * 2^52
+
+static const double exp_coeffs[13] = {
+    1.0 / 479001600.0, 1.0 / 39916800.0, 1.0 / 3628800.0, 1.0 / 362880.0,
+    1.0 / 40320.0, 1.0 / 5040.0, 1.0 / 720.0, 1.0 / 120.0,
+    1.0 / 24.0, 1.0 / 6.0, 1.0 / 2.0, 1.0, 1.0
+};
+
+// ------------------------------------------
+// SSE2 (2 lanes, baseline of every x86-64)
+// ------------------------------------------
+
+__attribute__((target("sse2")))
+static inline __m128d exp_sse2(__m128d x) {
+    x = _mm_min_pd(_mm_max_pd(x, _mm_set1_pd(-EXP_CLAMP)), _mm_set1_pd(EXP_CLAMP));
+
+    __m128d magic = _mm_set1_pd(EXP_MAGIC);
+    __m128d t = _mm_add_pd(_mm_mul_pd(x, _mm_set1_pd(EXP_LOG2E)), magic);
+    __m128d n = _mm_sub_pd(t, magic);
+
+    __m128d r = _mm_sub_pd(x, _mm_mul_pd(n, _mm_set1_pd(EXP_LN2_HI)));
+    r = _mm_sub_pd(r, _mm_mul_pd(n, _mm_set1_pd(EXP_LN2_LO)));
+
+    __m128d p = _mm_set1_pd(exp_coeffs[0]);
+    for (int k = 1; k < 13; k++) {
+        p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(exp_coeffs[k]));
+    }
+
+    __m128i bits = _mm_sub_epi64(_mm_castpd_si128(t), _mm_castpd_si128(magic));
+    bits = _mm_slli_epi64(_mm_add_epi64(bits, _mm_set1_epi64x(1023)), 52);
+    return _mm_mul_pd(p, _mm_castsi128_pd(bits));
+}
+
+__attribute__((target("sse2")))
+static void axpy_sse2(size_t n, double a, const double *x, double *y) {
+    __m128d va = _mm_set1_pd(a);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d vy = _mm_loadu_pd(y + i);
+        vy = _mm_add_pd(vy, _mm_mul_pd(va, _mm_loadu_pd(x + i)));
+        _mm_storeu_pd(y + i, vy);
+    }
+    for (; i < n; i++) y[i] += a * x[i];
+}
+
+__attribute__((target("sse2")))
+static void add_sse2(size_t n, const double *x, double *y) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(y + i, _mm_add_pd(_mm_loadu_pd(y + i), _mm_loadu_pd(x + i)));
+    }
+    for (; i < n; i++) y[i] += x[i];
+}
+
+__attribute__((target("sse2")))
+static void axpy_f32_sse2(size_t n, float a, const float *x, float *y) {
+    __m128 va = _mm_set1_ps(a);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(va, _mm_loadu_ps(x + i))));
+    }
+    for (; i < n; i++) y[i] += a * x[i];
+}
+
+// No 32-bit multiply before SSE4.1: the 16-bit low and high halves of the
+// products are interleaved back into 32-bit lanes
+__attribute__((target("sse2")))
+static void axpy_i8_sse2(size_t n, int32_t a, const int8_t *x, int32_t *y) {
+    __m128i va = _mm_set1_epi16((int16_t)a);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i bytes = _mm_loadl_epi64((const __m128i *)(x + i));
+        __m128i x16 = _mm_srai_epi16(_mm_unpacklo_epi8(bytes, bytes), 8);
+        __m128i lo = _mm_mullo_epi16(x16, va);
+        __m128i hi = _mm_mulhi_epi16(x16, va);
+        __m128i y0 = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(y + i)), _mm_unpacklo_epi16(lo, hi));
+        __m128i y1 = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(y + i + 4)), _mm_unpackhi_epi16(lo, hi));
+        _mm_storeu_si128((__m128i *)(y + i), y0);
+        _mm_storeu_si128((__m128i *)(y + i + 4), y1);
+    }
+    for (; i < n; i++) y[i] += a * x[i];
+}
+
+__attribute__((target("sse2")))
+static void sigmoid_sse2(double *v, size_t n) {
+    __m128d one = _mm_set1_pd(1.0);
+    __m128d zero = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d e = exp_sse2(_mm_sub_pd(zero, _mm_loadu_pd(v + i)));
+        _mm_storeu_pd(v + i, _mm_div_pd(one, _mm_add_pd(one, e)));
+    }
+    sigmoid_scalar(v + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void softmax_sse2(double *v, size_t n) {
+    size_t i = 0;
+    __m128d vmax = _mm_set1_pd(v[0]);
+    for (; i + 2 <= n; i += 2) vmax = _mm_max_pd(vmax, _mm_loadu_pd(v + i));
+    double lanes[2];
+    _mm_storeu_pd(lanes, vmax);
+    double max_val = lanes[0] > lanes[1] ? lanes[0] : lanes[1];
+    for (; i < n; i++) if (v[i] > max_val) max_val = v[i];
+
+    __m128d vm = _mm_set1_pd(max_val);
+    __m128d vsum = _mm_setzero_pd();
+    for (i = 0; i + 2 <= n; i += 2) {
+        __m128d e = exp_sse2(_mm_sub_pd(_mm_loadu_pd(v + i), vm));
+        _mm_storeu_pd(v + i, e);
+        vsum = _mm_add_pd(vsum, e);
+    }
+    _mm_storeu_pd(lanes, vsum);
+    double sum = lanes[0] + lanes[1];
+    for (; i < n; i++) { v[i] = exp(v[i] - max_val); sum += v[i]; }
+
+    __m128d inv = _mm_set1_pd(1.0 / sum);
+    for (i = 0; i + 2 <= n; i += 2) _mm_storeu_pd(v + i, _mm_mul_pd(_mm_loadu_pd(v + i), inv));
+    for (; i < n; i++) v[i] /= sum;
+}
+
+static const NNKernels kernels_sse2 = {
+    NN_SIMD_SSE2, "sse2", axpy_sse2, add_sse2, axpy_f32_sse2, axpy_i8_sse2,
+    and_popcount_scalar, sigmoid_sse2, softmax_sse2
+};
+
+// ------------------------------------------
+// AVX2 + FMA (4 lanes)
+// ------------------------------------------
+
+// Every AVX2 CPU has POPCNT; without it the builtin is a slow bit trick
+__attribute__((target("popcnt")))
+static void and_popcount_hw(const uint64_t *x, const uint64_t *rows, size_t words, size_t count, int32_t *counts) {
+    for (size_t i = 0; i < count; i++) {
+        const uint64_t *row = rows + i * words;
+        int32_t c = 0;
+        for (size_t w = 0; w < words; w++) c += __builtin_popcountll(x[w] & row[w]);
+        counts[i] = c;
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256d exp_avx2(__m256d x) {
+    x = _mm256_min_pd(_mm256_max_pd(x, _mm256_set1_pd(-EXP_CLAMP)), _mm256_set1_pd(EXP_CLAMP));
+
+    __m256d magic = _mm256_set1_pd(EXP_MAGIC);
+    __m256d t = _mm256_fmadd_pd(x, _mm256_set1_pd(EXP_LOG2E), magic);
+    __m256d n = _mm256_sub_pd(t, magic);
+
+    __m256d r = _mm256_fnmadd_pd(n, _mm256_set1_pd(EXP_LN2_HI), x);
+    r = _mm256_fnmadd_pd(n, _mm256_set1_pd(EXP_LN2_LO), r);
+
+    __m256d p = _mm256_set1_pd(exp_coeffs[0]);
+    for (int k = 1; k < 13; k++) {
+        p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(exp_coeffs[k]));
+    }
+
+    __m256i bits = _mm256_sub_epi64(_mm256_castpd_si256(t), _mm256_castpd_si256(magic));
+    bits = _mm256_slli_epi64(_mm256_add_epi64(bits, _mm256_set1_epi64x(1023)), 52);
+    return _mm256_mul_pd(p, _mm256_castsi256_pd(bits));
+}
+
+__attribute__((target("avx2,fma")))
+static void axpy_avx2(size_t n, double a, const double *x, double *y) {
+    __m256d va = _mm256_set1_pd(a);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256d y0 = _mm256_fmadd_pd(va, _mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i));
+        __m256d y1 = _mm256_fmadd_pd(va, _mm256_loadu_pd(x + i + 4), _mm256_loadu_pd(y + i + 4));
+        _mm256_storeu_pd(y + i, y0);
+        _mm256_storeu_pd(y + i + 4, y1);
+    }
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(y + i, _mm256_fmadd_pd(va, _mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+    }
+    for (; i < n; i++) y[i] += a * x[i];
+}
+
+__attribute__((target("avx2,fma")))
+static void add_avx2(size_t n, const double *x, double *y) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256d y0 = _mm256_add_pd(_mm256_loadu_pd(y + i), _mm256_loadu_pd(x + i));
+        __m256d y1 = _mm256_add_pd(_mm256_loadu_pd(y + i + 4), _mm256_loadu_pd(x + i + 4));
+        _mm256_storeu_pd(y + i, y0);
+        _mm256_storeu_pd(y + i + 4, y1);
+    }
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(y + i, _mm256_add_pd(_mm256_loadu_pd(y + i), _mm256_loadu_pd(x + i)));
+    }
+    for (; i < n; i++) y[i] += x[i];
+}
+
+__attribute__((target("avx2,fma")))
+static void axpy_f32_avx2(size_t n, float a, const float *x, float *y) {
+    __m256 va = _mm256_set1_ps(a);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+    }
+    for (; i < n; i++) y[i] += a * x[i];
+}
+
+__attribute__((target("avx2,fma")))
+static void axpy_i8_avx2(size_t n, int32_t a, const int8_t *x, int32_t *y) {
+    __m256i va = _mm256_set1_epi32(a);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x32 = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)(x + i)));
+        __m256i vy = _mm256_loadu_si256((const __m256i *)(y + i));
+        _mm256_storeu_si256((__m256i *)(y + i), _mm256_add_epi32(vy, _mm256_mullo_epi32(x32, va)));
+    }
+    for (; i < n; i++) y[i] += a * x[i];
+}
+
+__attribute__((target("avx2,fma")))
+static void sigmoid_avx2(double *v, size_t n) {
+    __m256d one = _mm256_set1_pd(1.0);
+    __m256d zero = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d e = exp_avx2(_mm256_sub_pd(zero, _mm256_loadu_pd(v + i)));
+        _mm256_storeu_pd(v + i, _mm256_div_pd(one, _mm256_add_pd(one, e)));
+    }
+    sigmoid_scalar(v + i, n - i);
+}
+
+__attribute__((target("avx2,fma")))
+static double hmax_avx2(__m256d v) {
+    __m128d m = _mm_max_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    m = _mm_max_sd(m, _mm_unpackhi_pd(m, m));
+    return _mm_cvtsd_f64(m);
+}
+
+__attribute__((target("avx2,fma")))
+static double hsum_avx2(__m256d v) {
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    s = _mm_add_sd(s, _mm_unpackhi_pd(s, s));
+    return _mm_cvtsd_f64(s);
+}
+
+__attribute__((target("avx2,fma")))
+static void softmax_avx2(double *v, size_t n) {
+    size_t i = 0;
+    __m256d vmax = _mm256_set1_pd(v[0]);
+    for (; i + 4 <= n; i += 4) vmax = _mm256_max_pd(vmax, _mm256_loadu_pd(v + i));
+    double max_val = hmax_avx2(vmax);
+    for (; i < n; i++) if (v[i] > max_val) max_val = v[i];
+
+    __m256d vm = _mm256_set1_pd(max_val);
+    __m256d vsum = _mm256_setzero_pd();
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m256d e = exp_avx2(_mm256_sub_pd(_mm256_loadu_pd(v + i), vm));
+        _mm256_storeu_pd(v + i, e);
+        vsum = _mm256_add_pd(vsum, e);
+    }
+    double sum = hsum_avx2(vsum);
+    for (; i < n; i++) { v[i] = exp(v[i] - max_val); sum += v[i]; }
+
+    __m256d inv = _mm256_set1_pd(1.0 / sum);
+    for (i = 0; i + 4 <= n; i += 4) _mm256_storeu_pd(v + i, _mm256_mul_pd(_mm256_loadu_pd(v + i), inv));
+    for (; i < n; i++) v[i] /= sum;
+}
+
+static const NNKernels kernels_avx2 = {
+    NN_SIMD_AVX2, "avx2+fma", axpy_avx2, add_avx2, axpy_f32_avx2, axpy_i8_avx2,
+    and_popcount_hw, sigmoid_avx2, softmax_avx2
+};
+
+// ------------------------------------------
+// AVX-512F (8 lanes, masked tails)
+// ------------------------------------------
+
+__attribute__((target("avx512f")))
+static inline __m512d exp_avx512(__m512d x) {
+    x = _mm512_min_pd(_mm512_max_pd(x, _mm512_set1_pd(-EXP_CLAMP)), _mm512_set1_pd(EXP_CLAMP));
+
+    __m512d n = _mm512_roundscale_pd(_mm512_mul_pd(x, _mm512_set1_pd(EXP_LOG2E)), _MM_FROUND_TO_NEAREST_INT);
+    __m512d r = _mm512_fnmadd_pd(n, _mm512_set1_pd(EXP_LN2_HI), x);
+    r = _mm512_fnmadd_pd(n, _mm512_set1_pd(EXP_LN2_LO), r);
+
+    __m512d p = _mm512_set1_pd(exp_coeffs[0]);
+    for (int k = 1; k < 13; k++) {
+        p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(exp_coeffs[k]));
+    }
+    return _mm512_scalef_pd(p, n);
+}
+
+static inline __mmask8 tail_mask(size_t remaining) {
+    return (__mmask8)((1u << remaining) - 1);
+}
+
+__attribute__((target("avx512f")))
+static void axpy_avx512(size_t n, double a, const double *x, double *y) {
+    __m512d va = _mm512_set1_pd(a);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm512_storeu_pd(y + i, _mm512_fmadd_pd(va, _mm512_loadu_pd(x + i), _mm512_loadu_pd(y + i)));
+    }
+    if (i < n) {
+        __mmask8 m = tail_mask(n - i);
+        __m512d vy = _mm512_maskz_loadu_pd(m, y + i);
+        _mm512_mask_storeu_pd(y + i, m, _mm512_fmadd_pd(va, _mm512_maskz_loadu_pd(m, x + i), vy));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void add_avx512(size_t n, const double *x, double *y) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm512_storeu_pd(y + i, _mm512_add_pd(_mm512_loadu_pd(y + i), _mm512_loadu_pd(x + i)));
+    }
+    if (i < n) {
+        __mmask8 m = tail_mask(n - i);
+        __m512d vy = _mm512_maskz_loadu_pd(m, y + i);
+        _mm512_mask_storeu_pd(y + i, m, _mm512_add_pd(vy, _mm512_maskz_loadu_pd(m, x + i)));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void axpy_f32_avx512(size_t n, float a, const float *x, float *y) {
+    __m512 va = _mm512_set1_ps(a);
+    for (size_t i = 0; i < n; i += 16) {
+        __mmask16 m = (n - i >= 16) ? 0xFFFF : (__mmask16)((1u << (n - i)) - 1);
+        __m512 vy = _mm512_maskz_loadu_ps(m, y + i);
+        _mm512_mask_storeu_ps(y + i, m, _mm512_fmadd_ps(va, _mm512_maskz_loadu_ps(m, x + i), vy));
+    }
+}
+
+// Byte-masked loads need AVX-512BW, so the int8 tail stays scalar
+__attribute__((target("avx512f")))
+static void axpy_i8_avx512(size_t n, int32_t a, const int8_t *x, int32_t *y) {
+    __m512i va = _mm512_set1_epi32(a);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i x32 = _mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i *)(x + i)));
+        __m512i vy = _mm512_loadu_si512(y + i);
+        _mm512_storeu_si512(y + i, _mm512_add_epi32(vy, _mm512_mullo_epi32(x32, va)));
+    }
+    for (; i < n; i++) y[i] += a * x[i];
+}
+
+__attribute__((target("avx512f")))
+static void sigmoid_avx512(double *v, size_t n) {
+    __m512d one = _mm512_set1_pd(1.0);
+    for (size_t i = 0; i < n; i += 8) {
+        __mmask8 m = (n - i >= 8) ? 0xFF : tail_mask(n - i);
+        __m512d e = exp_avx512(_mm512_sub_pd(_mm512_setzero_pd(), _mm512_maskz_loadu_pd(m, v + i)));
+        _mm512_mask_storeu_pd(v + i, m, _mm512_div_pd(one, _mm512_add_pd(one, e)));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void softmax_avx512(double *v, size_t n) {
+    __m512d vmax = _mm512_set1_pd(v[0]);
+    for (size_t i = 0; i < n; i += 8) {
+        __mmask8 m = (n - i >= 8) ? 0xFF : tail_mask(n - i);
+        vmax = _mm512_mask_max_pd(vmax, m, vmax, _mm512_maskz_loadu_pd(m, v + i));
+    }
+    __m512d vm = _mm512_set1_pd(_mm512_reduce_max_pd(vmax));
+
+    __m512d vsum = _mm512_setzero_pd();
+    for (size_t i = 0; i < n; i += 8) {
+        __mmask8 m = (n - i >= 8) ? 0xFF : tail_mask(n - i);
+        __m512d e = exp_avx512(_mm512_sub_pd(_mm512_maskz_loadu_pd(m, v + i), vm));
+        _mm512_mask_storeu_pd(v + i, m, e);
+        vsum = _mm512_mask_add_pd(vsum, m, vsum, e);
+    }
+
+    __m512d inv = _mm512_set1_pd(1.0 / _mm512_reduce_add_pd(vsum));
+    for (size_t i = 0; i < n; i += 8) {
+        __mmask8 m = (n - i >= 8) ? 0xFF : tail_mask(n - i);
+        _mm512_mask_storeu_pd(v + i, m, _mm512_mul_pd(_mm512_maskz_loadu_pd(m, v + i), inv));
+    }
+}
+
+static const NNKernels kernels_avx512 = {
+    NN_SIMD_AVX512, "avx512f", axpy_avx512, add_avx512, axpy_f32_avx512, axpy_i8_avx512,
+    and_popcount_hw, sigmoid_avx512, softmax_avx512
+};
+
+#endif // NN_X86
+
+// ==========================================
+//             RUNTIME DISPATCH
+// ==========================================
+
+const NNKernels *nn_kernels = &kernels_scalar;
+
+const NNKernels* nn_kernels_for(NNSimdLevel level) {
+    switch (level) {
+    case NN_SIMD_SCALAR:
+        return &kernels_scalar;
+#ifdef NN_X86
+    case NN_SIMD_SSE2:
+        return __builtin_cpu_supports("sse2") ? &kernels_sse2 : NULL;
+    case NN_SIMD_AVX2:
+        return (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+                __builtin_cpu_supports("popcnt")) ? &kernels_avx2 : NULL;
+    case NN_SIMD_AVX512:
+        return (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("popcnt")) ? &kernels_avx512 : NULL;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+// Runs before main(): one binary picks the best path of the machine it runs on
+__attribute__((constructor))
+static void select_kernels(void) {
+#ifdef NN_X86
+    __builtin_cpu_init();
+#endif
+    const char *forced = getenv("OCR_SIMD");
+
+    for (int level = NN_SIMD_COUNT - 1; level >= NN_SIMD_SCALAR; level--) {
+        const NNKernels *k = nn_kernels_for((NNSimdLevel)level);
+        if (!k) continue;
+        if (forced && strcmp(forced, k->name) != 0 && strncmp(forced, k->name, strlen(forced)) != 0) continue;
+        nn_kernels = k;
+        return;
+    }
+}
+
+// ==========================================
+//          CHECK AGAINST SCALAR
+// ==========================================
+
+#define CHECK_MAX_LEN 67
+
+// Relative error in units of epsilon (absolute below 1)
+static double error_in_eps(double got, double expected, double epsilon) {
+    double diff = fabs(got - expected);
+    double scale = fabs(expected) > 1.0 ? fabs(expected) : 1.0;
+    return diff / scale / epsilon;
+}
+
+static double random_unit(unsigned int *seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    return ((double)(*seed >> 8) / (1u << 24)) * 2.0 - 1.0;
+}
+
+int nn_kernels_check(const NNKernels *kernels, double tolerance, double *max_error) {
+    double worst = 0.0;
+    int exact = 1;
+    unsigned int seed = 12345;
+
+    double x[CHECK_MAX_LEN], saved[CHECK_MAX_LEN], ref[CHECK_MAX_LEN], got[CHECK_MAX_LEN];
+    float xf[CHECK_MAX_LEN], ref_f[CHECK_MAX_LEN], got_f[CHECK_MAX_LEN];
+    int8_t xq[CHECK_MAX_LEN];
+    int32_t ref_q[CHECK_MAX_LEN], got_q[CHECK_MAX_LEN];
+
+    // Every length from 1 to 67 exercises the vector bodies and the tails
+    for (size_t n = 1; n <= CHECK_MAX_LEN; n++) {
+        for (int trial = 0; trial < 8; trial++) {
+            for (size_t i = 0; i < n; i++) {
+                x[i] = random_unit(&seed);
+                // Spread the inputs over the useful range of sigmoid / softmax
+                saved[i] = random_unit(&seed) * 40.0;
+                xf[i] = (float)x[i];
+                xq[i] = (int8_t)lrint(x[i] * 127.0);
+                ref_q[i] = got_q[i] = (int32_t)lrint(saved[i] * 1000.0);
+            }
+            double a = x[0] * 3.0;
+
+            // Dense layer row
+            memcpy(ref, saved, n * sizeof(double));
+            memcpy(got, saved, n * sizeof(double));
+            axpy_scalar(n, a, x, ref);
+            kernels->axpy(n, a, x, got);
+            for (size_t i = 0; i < n; i++) {
+                double e = error_in_eps(got[i], ref[i], DBL_EPSILON);
+                if (e > worst) worst = e;
+            }
+
+            // Active binary input row
+            memcpy(ref, saved, n * sizeof(double));
+            memcpy(got, saved, n * sizeof(double));
+            add_scalar(n, x, ref);
+            kernels->add(n, x, got);
+            if (memcmp(ref, got, n * sizeof(double)) != 0) exact = 0;
+
+            // float32 and int8 rows
+            for (size_t i = 0; i < n; i++) ref_f[i] = got_f[i] = (float)saved[i];
+            axpy_f32_scalar(n, (float)a, xf, ref_f);
+            kernels->axpy_f32(n, (float)a, xf, got_f);
+            for (size_t i = 0; i < n; i++) {
+                double e = error_in_eps(got_f[i], ref_f[i], FLT_EPSILON);
+                if (e > worst) worst = e;
+            }
+
+            int32_t qa = (int32_t)lrint(fabs(x[0]) * 127.0);
+            axpy_i8_scalar(n, qa, xq, ref_q);
+            kernels->axpy_i8(n, qa, xq, got_q);
+            if (memcmp(ref_q, got_q, n * sizeof(int32_t)) != 0) exact = 0;
+
+            // Binary rows (x and 3 rows of n words)
+            uint64_t xb[CHECK_MAX_LEN], rows_b[3 * CHECK_MAX_LEN];
+            int32_t ref_c[3], got_c[3];
+            for (size_t i = 0; i < 3 * n; i++) {
+                seed = seed * 1103515245u + 12345u;
+                rows_b[i] = ((uint64_t)seed << 32) ^ (uint64_t)(seed * 2654435761u);
+                if (i < n) xb[i] = rows_b[i] * 0x9E3779B97F4A7C15ull;
+            }
+            and_popcount_scalar(xb, rows_b, n, 3, ref_c);
+            kernels->and_popcount(xb, rows_b, n, 3, got_c);
+            if (memcmp(ref_c, got_c, sizeof(ref_c)) != 0) exact = 0;
+
+            // Sigmoid
+            memcpy(ref, saved, n * sizeof(double));
+            memcpy(got, saved, n * sizeof(double));
+            sigmoid_scalar(ref, n);
+            kernels->sigmoid(got, n);
+            for (size_t i = 0; i < n; i++) {
+                double e = error_in_eps(got[i], ref[i], DBL_EPSILON);
+                if (e > worst) worst = e;
+            }
+
+            // Softmax
+            memcpy(ref, saved, n * sizeof(double));
+            memcpy(got, saved, n * sizeof(double));
+            softmax_scalar(ref, n);
+            kernels->softmax(got, n);
+            for (size_t i = 0; i < n; i++) {
+                double e = error_in_eps(got[i], ref[i], DBL_EPSILON);
+                if (e > worst) worst = e;
+            }
+        }
+    }
+
+    if (max_error) *max_error = worst;
+    return exact && worst <= tolerance;
+}
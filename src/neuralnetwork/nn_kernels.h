@@ -0,0 +1,53 @@
+#ifndef NN_KERNELS_H
+#define NN_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Instruction sets the inference kernels are compiled for
+typedef enum {
+    NN_SIMD_SCALAR,
+    NN_SIMD_SSE2,
+    NN_SIMD_AVX2,       // AVX2 + FMA
+    NN_SIMD_AVX512,     // AVX-512F
+    NN_SIMD_COUNT
+} NNSimdLevel;
+
+typedef struct {
+    NNSimdLevel level;
+    const char *name;
+
+    // y[0..n) += a * x[0..n)   (one weight row of a dense layer)
+    void (*axpy)(size_t n, double a, const double *x, double *y);
+
+    // y[0..n) += x[0..n)   (weight row of an active binary input)
+    void (*add)(size_t n, const double *x, double *y);
+
+    // Same for float32 and int8 weights (int8: |a| must fit in 16 bits)
+    void (*axpy_f32)(size_t n, float a, const float *x, float *y);
+    void (*axpy_i8)(size_t n, int32_t a, const int8_t *x, int32_t *y);
+
+    // counts[i] = popcount(x & rows[i]) over `words` 64-bit words, for `count` rows
+    void (*and_popcount)(const uint64_t *x, const uint64_t *rows, size_t words, size_t count, int32_t *counts);
+
+    // v[i] = sigmoid(v[i])
+    void (*sigmoid)(double *v, size_t n);
+
+    // In-place softmax
+    void (*softmax)(double *v, size_t n);
+} NNKernels;
+
+// Best kernels for this CPU, selected once at program startup
+// (the OCR_SIMD environment variable can force scalar/sse2/avx2/avx512)
+extern const NNKernels *nn_kernels;
+
+// Kernels of a given level, NULL if this CPU (or build) can't run them
+const NNKernels* nn_kernels_for(NNSimdLevel level);
+
+// Compares a kernel set with the scalar reference on random data.
+// Errors are relative, in units of the machine epsilon of each type
+// (add, int8 and popcount results must match exactly).
+// Returns 1 if every result is within tolerance, *max_error gets the worst error
+int nn_kernels_check(const NNKernels *kernels, double tolerance, double *max_error);
+
+#endif
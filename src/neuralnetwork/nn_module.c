@@ -2,6 +2,7 @@
 #include "neural_network.h"
 #include "image_loader.h"
 #include "network_io.h"
+#include "nn_pool.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -26,39 +27,31 @@
 }*/
 
 
-// Function to rebuild the grid with the neural network
-static int core_predict_grid(Network *net, const char *grid_folder, const char *output_file) {
-    GridLetter *letters;
-    int num_letters = load_grid_images(grid_folder, &letters);
-    
-    if (num_letters == 0) { 
-        return 0; 
-    }
+// Specialized forward linked in by the Makefile's ocr_solver_<model> target
+// (ocr_trainer codegen), absent from the regular build
+extern const NNGeneratedModel nn_generated_model __attribute__((weak));
 
-    printf("  > Processing grid (%d letters)...\n", num_letters);
+// Index of the most probable letter
+static int predicted_class(const double *output, size_t count) {
+    int predicted = 0;
+    double max_prob = output[0];
     
-    // Allocate predictions buffer
-    double *hidden = malloc(net->hidden_size * sizeof(double));
-    double *output = malloc(net->output_size * sizeof(double));
+    for (size_t j = 1; j < count; j++) {
+        if (output[j] > max_prob) { 
+            max_prob = output[j]; 
+            predicted = (int)j; 
+        }
+    }
+    return predicted;
+}
 
+// Function to rebuild the grid from the predicted letters
+static void core_write_grid(GridLetter *letters, int num_letters, const char *output_file) {
     int min_x = letters[0].x, max_x = letters[0].x;
     int min_y = letters[0].y, max_y = letters[0].y;
 
-    // Prediction loop
-    for (int i = 0; i < num_letters; i++) {
-        forward(net, letters[i].pixels, hidden, output);
-        int predicted = 0;
-        double max_prob = output[0];
-        
-        for (size_t j = 1; j < net->output_size; j++) {
-            if (output[j] > max_prob) { 
-                max_prob = output[j]; 
-                predicted = (int)j; 
-            }
-        }
-        letters[i].predicted_letter = 'A' + predicted;
-
-        // Update grid size
+    // Update grid size
+    for (int i = 1; i < num_letters; i++) {
         if (letters[i].x < min_x) min_x = letters[i].x;
         if (letters[i].x > max_x) max_x = letters[i].x;
         if (letters[i].y < min_y) min_y = letters[i].y;
@@ -102,8 +95,6 @@ static int core_predict_grid(Network *net, const char *grid_folder, const char *
             printf("|\n");
 
             fprintf(f, "%s\n", grid[i]);
-            
-            free(grid[i]); 
         }
         fclose(f);
         
@@ -117,73 +108,225 @@ static int core_predict_grid(Network *net, const char *grid_folder, const char *
     }
     
     // Free allocated memory
+    for(int i=0; i<height; i++) free(grid[i]);
     free(grid); 
-    free(hidden); free(output);
-    free_grid_letters(letters, num_letters);
-    return 1;
 }
 
-// Function to rebuild the words to find
-
-static int core_predict_words(Network *net, const char *words_folder, const char *output_file) {
-    Word *words_list;
-
-    int num_words = load_and_predict_words(words_folder, net, &words_list);
-    
-    if (num_words == 0) {
-        return 0;
-    }
+// Function to save the words to find
 
+static void core_write_words(char **words_list, int num_words, const char *output_file) {
     FILE *f = fopen(output_file, "w");
     if (f) {
         printf("  > Decrypted %d words:\n", num_words);
         for (int i = 0; i < num_words; i++) {
-            printf("    - %s\n", words_list[i].word);
-            fprintf(f, "%s\n", words_list[i].word);
+            printf("    - %s\n", words_list[i]);
+            fprintf(f, "%s\n", words_list[i]);
         }
         fclose(f);
         printf("  ✓ Words list saved to %s\n", output_file);
     } else {
         perror("Error saving words file");
     }
+}
+
+// Glyphs of one puzzle folder and their place in the shared input matrix
+typedef struct {
+    const char *root_folder;
+    GridLetter *letters;
+    int num_letters;
+    WordImages *words;
+    int num_words;
+    size_t first;   // Index of the puzzle's first glyph in the batch
+    size_t total;   // Grid letters + word letters
+} PuzzleGlyphs;
 
-    // Free allocated memory as always
-    free_words(words_list, num_words);
-    return 1;
+static void load_puzzle_glyphs(const char *root_folder, PuzzleGlyphs *puzzle) {
+    char grid_path[1024];
+    char words_path[1024];
+    snprintf(grid_path, sizeof(grid_path), "%s/grid", root_folder);
+    snprintf(words_path, sizeof(words_path), "%s/words", root_folder);
+
+    puzzle->root_folder = root_folder;
+    puzzle->letters = NULL;
+    puzzle->num_letters = load_grid_images(grid_path, &puzzle->letters);
+    puzzle->words = NULL;
+    puzzle->num_words = load_word_images(words_path, &puzzle->words);
+
+    puzzle->total = puzzle->num_letters;
+    for (int w = 0; w < puzzle->num_words; w++) {
+        for (int l = 0; l < puzzle->words[w].letter_count; l++) {
+            if (puzzle->words[w].letters[l]) puzzle->total++;
+        }
+    }
 }
 
-int nn_run_recognition(const char *root_folder, const char *model_file) {
+// Copies the puzzle's glyphs into its rows of the input matrix
+static void fill_puzzle_inputs(const PuzzleGlyphs *puzzle, double *inputs, size_t input_size) {
+    size_t next = puzzle->first;
+    for (int i = 0; i < puzzle->num_letters; i++) {
+        memcpy(inputs + next++ * input_size, puzzle->letters[i].pixels, input_size * sizeof(double));
+    }
+    for (int w = 0; w < puzzle->num_words; w++) {
+        for (int l = 0; l < puzzle->words[w].letter_count; l++) {
+            if (!puzzle->words[w].letters[l]) continue;
+            memcpy(inputs + next++ * input_size, puzzle->words[w].letters[l], input_size * sizeof(double));
+        }
+    }
+}
+
+// Writes grid.txt / words.txt of one puzzle from its rows of the output matrix
+// and releases its glyphs
+static void write_puzzle_results(PuzzleGlyphs *puzzle, const double *outputs, size_t output_size) {
+    char grid_out[1024];
+    char words_out[1024];
+    snprintf(grid_out, sizeof(grid_out), "%s/grid.txt", puzzle->root_folder);
+    snprintf(words_out, sizeof(words_out), "%s/words.txt", puzzle->root_folder);
+
+    size_t next = puzzle->first;
+
+    printf("\n[1/2] Grid Recognition:\n");
+    if (puzzle->num_letters > 0) {
+        printf("  > Processing grid (%d letters)...\n", puzzle->num_letters);
+        for (int i = 0; i < puzzle->num_letters; i++) {
+            puzzle->letters[i].predicted_letter = 'A' + predicted_class(outputs + next++ * output_size, output_size);
+        }
+        core_write_grid(puzzle->letters, puzzle->num_letters, grid_out);
+        free_grid_letters(puzzle->letters, puzzle->num_letters);
+    }
+
+    printf("\n[2/2] Words Recognition:\n");
+    if (puzzle->num_words > 0) {
+        WordImages *words = puzzle->words;
+        char **words_list = malloc(puzzle->num_words * sizeof(char*));
+        for (int w = 0; w < puzzle->num_words; w++) {
+            if (words[w].letter_count <= 0) {
+                words_list[w] = strdup("ERROR");
+                continue;
+            }
+            words_list[w] = malloc(words[w].letter_count + 1);
+            for (int l = 0; l < words[w].letter_count; l++) {
+                // Fill voids with question marks to debug
+                words_list[w][l] = words[w].letters[l]
+                    ? 'A' + predicted_class(outputs + next++ * output_size, output_size)
+                    : '?';
+            }
+            words_list[w][words[w].letter_count] = '\0';
+            printf("  Processing word folder '%s'... '%s'\n", words[w].name, words_list[w]);
+        }
+        core_write_words(words_list, puzzle->num_words, words_out);
+
+        for (int w = 0; w < puzzle->num_words; w++) free(words_list[w]);
+        free(words_list);
+        free_word_images(words, puzzle->num_words);
+    }
+}
+
+// Second stage of a cascade, NULL if it can't stand in for net
+static Network *load_cascade_model(const Network *net, const NNCascadeConfig *cascade) {
+    Network *large = load_network(cascade->model_file);
+    if (!large) {
+        fprintf(stderr, "Warning: Failed to load cascade model %s, using one model\n", cascade->model_file);
+        return NULL;
+    }
+    if (large->input_size != net->input_size || large->output_size != net->output_size) {
+        fprintf(stderr, "Warning: Cascade model %s has %zu -> %zu neurons, not %zu -> %zu: using one model\n",
+                cascade->model_file, large->input_size, large->output_size, net->input_size, net->output_size);
+        free_network(large);
+        return NULL;
+    }
+
+    // Generated code may be that of either model
+    if (&nn_generated_model != NULL && nn_attach_generated(large, &nn_generated_model)) {
+        printf("Cascade model uses generated forward_%s()\n", nn_generated_model.name);
+    }
+    return large;
+}
+
+static void print_cascade_metrics(const NNCascadeMetrics *m, double threshold) {
+    double glyphs = m->glyphs ? (double)m->glyphs : 1.0;
+    printf("  > Cascade (threshold %.2f): %zu/%zu glyphs (%.1f%%) settled by the first model in %.2f ms,\n",
+           threshold, m->glyphs - m->escalated, m->glyphs, (m->glyphs - m->escalated) / glyphs * 100.0,
+           m->seconds[0] * 1e3);
+    printf("    %zu (%.1f%%) escalated in %.2f ms, %zu of them changed\n",
+           m->escalated, m->escalated / glyphs * 100.0, m->seconds[1] * 1e3, m->changed);
+}
+
+int nn_run_recognition_batch(const char *const *root_folders, int count, const char *model_file) {
+    return nn_run_recognition_cascade(root_folders, count, model_file, NULL, NULL);
+}
+
+int nn_run_recognition_cascade(const char *const *root_folders, int count, const char *model_file,
+                               const NNCascadeConfig *cascade, NNCascadeMetrics *metrics) {
     
     printf("\n=== NEURAL NETWORK MODULE (NN) ===\n");
-    printf("Processing images in: %s\n", root_folder);
-    printf("Using model: %s\n", model_file);
+    printf("Processing %d puzzle folder(s)\n", count);
+    printf("Using model: %s\n", model_file ? model_file : "(embedded)");
 
-    // Load neural network model
-    Network *net = load_network(model_file);
+    // Load neural network model (once for every puzzle of the page)
+    Network *net = model_file ? load_network(model_file) : load_embedded_network();
     if (!net) {
-        fprintf(stderr, "CRITICAL: Failed to load model %s.\n", model_file);
+        fprintf(stderr, "CRITICAL: Failed to load model %s.\n", model_file ? model_file : "(embedded)");
         return 1;
     }
 
-    // Build input/output path
-    char grid_path[1024];
-    char words_path[1024];
-    char grid_out[1024];
-    char words_out[1024];
+    if (&nn_generated_model != NULL) {
+        if (nn_attach_generated(net, &nn_generated_model)) {
+            printf("Using generated forward_%s()\n", nn_generated_model.name);
+        } else {
+            printf("Generated code '%s' does not match this model, using the generic path\n", nn_generated_model.name);
+        }
+    }
 
-    snprintf(grid_path, sizeof(grid_path), "%s/grid", root_folder);
-    snprintf(words_path, sizeof(words_path), "%s/words", root_folder);
-    snprintf(grid_out, sizeof(grid_out), "%s/grid.txt", root_folder);
-    snprintf(words_out, sizeof(words_out), "%s/words.txt", root_folder);
+    Network *large = NULL;
+    if (cascade && cascade->model_file) {
+        large = load_cascade_model(net, cascade);
+        if (large) printf("Cascade: glyphs below %.2f confidence go to %s\n", cascade->threshold, cascade->model_file);
+    }
 
-    printf("\n[1/2] Grid Recognition:\n");
-    core_predict_grid(net, grid_path, grid_out);
+    // Every glyph of every puzzle (grid + word list) goes through the network
+    // in a single batch, split across the inference pool
+    PuzzleGlyphs *puzzles = malloc((count > 0 ? count : 1) * sizeof(PuzzleGlyphs));
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        load_puzzle_glyphs(root_folders[i], &puzzles[i]);
+        puzzles[i].first = total;
+        total += puzzles[i].total;
+    }
 
-    printf("\n[2/2] Words Recognition:\n");
-    core_predict_words(net, words_path, words_out);
+    double *inputs = malloc((total ? total : 1) * net->input_size * sizeof(double));
+    double *outputs = malloc((total ? total : 1) * net->output_size * sizeof(double));
+    for (int i = 0; i < count; i++) {
+        fill_puzzle_inputs(&puzzles[i], inputs, net->input_size);
+    }
+
+    printf("  > Classifying %zu glyphs in one batch...\n", total);
+    NNCascadeMetrics run = { 0 };
+    InferencePool *pool = inference_pool_new(net, 0);
+    InferencePool *large_pool = large ? inference_pool_new(large, 0) : NULL;
+    inference_cascade_run(pool, large_pool, large ? cascade->threshold : 0.0, inputs, outputs, total, &run);
+    inference_pool_free(large_pool);
+    inference_pool_free(pool);
+    if (large) print_cascade_metrics(&run, cascade->threshold);
+    if (metrics) *metrics = run;
+
+    for (int i = 0; i < count; i++) {
+        printf("\n--- Puzzle %d/%d: %s ---\n", i + 1, count, root_folders[i]);
+        write_puzzle_results(&puzzles[i], outputs, net->output_size);
+    }
     
     // Free allocated memory
+    free(inputs);
+    free(outputs);
+    free(puzzles);
+    if (large) free_network(large);
     free_network(net);
     return 0;
 }
 
+int nn_has_embedded_model(void) {
+    return has_embedded_network();
+}
+
+int nn_run_recognition(const char *root_folder, const char *model_file) {
+    return nn_run_recognition_batch(&root_folder, 1, model_file);
+}
@@ -1,6 +1,29 @@
 #ifndef NN_MODULE_H
 #define NN_MODULE_H
 
+#include "nn_pool.h"
+
+// Larger model for the glyphs the recognition model is unsure of (see
+// inference_cascade_run)
+typedef struct {
+    const char *model_file;     // NULL: no cascade
+    double threshold;           // Top probability below which a glyph is escalated
+} NNCascadeConfig;
+
+#define NN_CASCADE_DEFAULT_THRESHOLD 0.9
+
+// model_file NULL: the model embedded in the executable (make EMBED_MODEL=1)
 int nn_run_recognition(const char *root_folder, const char *model_file);
 
+// Same as nn_run_recognition for several puzzle folders, loading the model once
+int nn_run_recognition_batch(const char *const *root_folders, int count, const char *model_file);
+
+// nn_run_recognition_batch through a cascade (cascade NULL or without a
+// model: the one model). metrics (may be NULL) gets the glyphs of each stage.
+int nn_run_recognition_cascade(const char *const *root_folders, int count, const char *model_file,
+                               const NNCascadeConfig *cascade, NNCascadeMetrics *metrics);
+
+// 1 if the executable carries an embedded model
+int nn_has_embedded_model(void);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,191 @@
+#include "nn_pool.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct InferencePool {
+    Network *net;
+    GThreadPool *workers;   // threads - 1 workers, the caller runs a chunk too
+    int threads;
+    size_t min_chunk;       // Glyphs per chunk, multiple of NN_BATCH_TILE
+};
+
+// Completion state of one inference_pool_run call
+typedef struct {
+    GMutex lock;
+    GCond done;
+    int pending;
+} PoolRun;
+
+typedef struct {
+    PoolRun *run;
+    Network *net;
+    const double *inputs;
+    double *outputs;
+    size_t count;
+} InferenceChunk;
+
+// Each chunk writes its own slice of the outputs, forward_batch allocates
+// its own scratch: workers share nothing but the read-only network
+static void run_chunk(gpointer data, gpointer user_data) {
+    (void)user_data;
+    InferenceChunk *chunk = (InferenceChunk*)data;
+    forward_batch(chunk->net, chunk->inputs, chunk->outputs, chunk->count);
+
+    g_mutex_lock(&chunk->run->lock);
+    if (--chunk->run->pending == 0) g_cond_signal(&chunk->run->done);
+    g_mutex_unlock(&chunk->run->lock);
+}
+
+// Times representative glyphs (one pixel in five set) until the measure is
+// long enough to trust, then sizes chunks to NN_POOL_MIN_CHUNK_US of work
+static size_t calibrate_min_chunk(Network *net) {
+    const size_t n = NN_BATCH_TILE;
+    double *inputs = malloc(n * net->input_size * sizeof(double));
+    double *outputs = malloc(n * net->output_size * sizeof(double));
+    for (size_t i = 0; i < n * net->input_size; i++) {
+        inputs[i] = ((i * 7) % 5 == 0) ? 1.0 : 0.0;
+    }
+
+    // Warm-up (first touch of the weights)
+    forward_batch(net, inputs, outputs, n);
+
+    size_t glyphs = 0;
+    gint64 start = g_get_monotonic_time();
+    gint64 elapsed = 0;
+    while (elapsed < 2000 && glyphs < 64 * n) {
+        forward_batch(net, inputs, outputs, n);
+        glyphs += n;
+        elapsed = g_get_monotonic_time() - start;
+    }
+    free(inputs);
+    free(outputs);
+
+    double per_glyph_us = (double)elapsed / (double)glyphs;
+    size_t min_chunk = per_glyph_us > 0.0 ? (size_t)(NN_POOL_MIN_CHUNK_US / per_glyph_us) + 1 : 64 * n;
+    return (min_chunk + n - 1) / n * n;
+}
+
+InferencePool *inference_pool_new(Network *net, int threads) {
+    InferencePool *pool = (InferencePool*)calloc(1, sizeof(InferencePool));
+    pool->net = net;
+    pool->threads = threads > 0 ? threads : (int)g_get_num_processors();
+    pool->min_chunk = calibrate_min_chunk(net);
+
+    // Exclusive pool: the threads are started once and stay parked between runs
+    if (pool->threads > 1) {
+        pool->workers = g_thread_pool_new(run_chunk, NULL, pool->threads - 1, TRUE, NULL);
+        if (!pool->workers) pool->threads = 1;
+    }
+
+    printf("Inference pool: %d thread(s), chunks of >= %zu glyphs\n", pool->threads, pool->min_chunk);
+    return pool;
+}
+
+void inference_pool_run(InferencePool *pool, const double *inputs, double *outputs, size_t count) {
+    // Enough work for how many threads?
+    size_t chunks = count / pool->min_chunk;
+    if (chunks > (size_t)pool->threads) chunks = (size_t)pool->threads;
+
+    if (chunks <= 1 || !pool->workers) {
+        forward_batch(pool->net, inputs, outputs, count);
+        return;
+    }
+
+    // Even split, rounded to whole tiles
+    size_t per_chunk = (count + chunks - 1) / chunks;
+    per_chunk = (per_chunk + NN_BATCH_TILE - 1) / NN_BATCH_TILE * NN_BATCH_TILE;
+    chunks = (count + per_chunk - 1) / per_chunk;
+
+    const size_t n_in = pool->net->input_size;
+    const size_t n_out = pool->net->output_size;
+    InferenceChunk *jobs = (InferenceChunk*)malloc(chunks * sizeof(InferenceChunk));
+
+    PoolRun run;
+    g_mutex_init(&run.lock);
+    g_cond_init(&run.done);
+    run.pending = (int)chunks - 1;
+
+    for (size_t c = 0; c < chunks; c++) {
+        size_t first = c * per_chunk;
+        jobs[c].run = &run;
+        jobs[c].net = pool->net;
+        jobs[c].inputs = inputs + first * n_in;
+        jobs[c].outputs = outputs + first * n_out;
+        jobs[c].count = (count - first < per_chunk) ? count - first : per_chunk;
+        if (c > 0) g_thread_pool_push(pool->workers, &jobs[c], NULL);
+    }
+
+    // The caller takes the first chunk instead of sleeping
+    forward_batch(pool->net, jobs[0].inputs, jobs[0].outputs, jobs[0].count);
+
+    g_mutex_lock(&run.lock);
+    while (run.pending > 0) g_cond_wait(&run.done, &run.lock);
+    g_mutex_unlock(&run.lock);
+
+    g_mutex_clear(&run.lock);
+    g_cond_clear(&run.done);
+    free(jobs);
+}
+
+static size_t top_class(const double *output, size_t count) {
+    size_t best = 0;
+    for (size_t j = 1; j < count; j++) {
+        if (output[j] > output[best]) best = j;
+    }
+    return best;
+}
+
+void inference_cascade_run(InferencePool *first, InferencePool *second, double threshold,
+                           const double *inputs, double *outputs, size_t count, NNCascadeMetrics *metrics) {
+    const size_t n_in = first->net->input_size;
+    const size_t n_out = first->net->output_size;
+
+    double started = nn_seconds();
+    inference_pool_run(first, inputs, outputs, count);
+    double first_seconds = nn_seconds() - started;
+
+    // Unsure glyphs are gathered into one batch for the second model
+    size_t escalated = 0, changed = 0;
+    double second_seconds = 0.0;
+    if (second && count > 0) {
+        started = nn_seconds();
+        size_t *unsure = malloc(count * sizeof(size_t));
+        for (size_t i = 0; i < count; i++) {
+            if (outputs[i * n_out + top_class(outputs + i * n_out, n_out)] < threshold) unsure[escalated++] = i;
+        }
+
+        if (escalated > 0) {
+            double *again_in = malloc(escalated * n_in * sizeof(double));
+            double *again_out = malloc(escalated * n_out * sizeof(double));
+            for (size_t k = 0; k < escalated; k++) {
+                memcpy(again_in + k * n_in, inputs + unsure[k] * n_in, n_in * sizeof(double));
+            }
+            inference_pool_run(second, again_in, again_out, escalated);
+            for (size_t k = 0; k < escalated; k++) {
+                double *out = outputs + unsure[k] * n_out;
+                if (top_class(out, n_out) != top_class(again_out + k * n_out, n_out)) changed++;
+                memcpy(out, again_out + k * n_out, n_out * sizeof(double));
+            }
+            free(again_in);
+            free(again_out);
+        }
+        free(unsure);
+        second_seconds = nn_seconds() - started;
+    }
+
+    if (metrics) {
+        metrics->glyphs += count;
+        metrics->escalated += escalated;
+        metrics->changed += changed;
+        metrics->seconds[0] += first_seconds;
+        metrics->seconds[1] += second_seconds;
+    }
+}
+
+void inference_pool_free(InferencePool *pool) {
+    if (!pool) return;
+    if (pool->workers) g_thread_pool_free(pool->workers, FALSE, TRUE);
+    free(pool);
+}
@@ -0,0 +1,38 @@
+#ifndef NN_POOL_H
+#define NN_POOL_H
+
+#include "neural_network.h"
+
+// A chunk must hold at least this much work (microseconds) to be worth
+// waking a worker for
+#define NN_POOL_MIN_CHUNK_US 100
+
+typedef struct InferencePool InferencePool;
+
+// Fixed pool of `threads` workers (0 = one per core) sharing `net` read-only.
+// The minimum chunk size is measured once here for this model and machine.
+InferencePool* inference_pool_new(Network *net, int threads);
+
+// forward_batch over `count` glyphs, split across the workers.
+// Outputs come back in input order. Small batches run on the calling thread.
+void inference_pool_run(InferencePool *pool, const double *inputs, double *outputs, size_t count);
+
+void inference_pool_free(InferencePool *pool);
+
+// Per-stage counts of a cascade run (see inference_cascade_run)
+typedef struct {
+    size_t glyphs;
+    size_t escalated;           // Also run through the second model
+    size_t changed;             // Escalated glyphs the second model classified differently
+    double seconds[2];          // Wall time of each stage
+} NNCascadeMetrics;
+
+// Confidence-gated cascade: every glyph goes through `first` (a small
+// model), and the glyphs whose top probability is below `threshold` go
+// through `second` (a larger one, same input and output sizes) too, whose
+// outputs replace the first ones. second NULL: first alone. Counts are
+// added to metrics (may be NULL).
+void inference_cascade_run(InferencePool *first, InferencePool *second, double threshold,
+                           const double *inputs, double *outputs, size_t count, NNCascadeMetrics *metrics);
+
+#endif
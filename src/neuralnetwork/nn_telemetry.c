@@ -0,0 +1,218 @@
+#include "nn_telemetry.h"
+#include <glib.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    NNEpochStats stats;
+    int has_stats;
+    int has_validation;
+    double val_loss;
+    double val_accuracy;
+    double val_seconds;
+} TelemetryRow;
+
+typedef struct {
+    gchar *key;
+    gchar *text;            // NULL: a number
+    double number;
+} TelemetryInfo;
+
+// Rows are indexed by epoch: a validation can be reported before the
+// stats of its epoch (see TrainConfig.validation_stats)
+struct NNTelemetry {
+    GMutex lock;
+    TelemetryRow *rows;
+    int count;              // Rows in use, the last epoch reported
+    int capacity;
+    TelemetryInfo *info;
+    int info_count;
+};
+
+NNTelemetry *telemetry_new(void) {
+    NNTelemetry *t = calloc(1, sizeof(NNTelemetry));
+    g_mutex_init(&t->lock);
+    return t;
+}
+
+void telemetry_free(NNTelemetry *telemetry) {
+    if (!telemetry) return;
+    for (int i = 0; i < telemetry->info_count; i++) {
+        g_free(telemetry->info[i].key);
+        g_free(telemetry->info[i].text);
+    }
+    free(telemetry->info);
+    free(telemetry->rows);
+    g_mutex_clear(&telemetry->lock);
+    free(telemetry);
+}
+
+static void add_info(NNTelemetry *t, const char *key, const char *text, double number) {
+    t->info = realloc(t->info, (size_t)(t->info_count + 1) * sizeof(TelemetryInfo));
+    TelemetryInfo *info = &t->info[t->info_count++];
+    info->key = g_strdup(key);
+    info->text = g_strdup(text);
+    info->number = number;
+}
+
+void telemetry_set_string(NNTelemetry *telemetry, const char *key, const char *value) {
+    add_info(telemetry, key, value ? value : "", 0.0);
+}
+
+void telemetry_set_number(NNTelemetry *telemetry, const char *key, double value) {
+    add_info(telemetry, key, NULL, value);
+}
+
+// Row of epoch `epoch` (1-based), zeroed when new (lock held)
+static TelemetryRow *epoch_row(NNTelemetry *t, int epoch) {
+    if (epoch > t->capacity) {
+        int grown = t->capacity ? t->capacity * 2 : 64;
+        if (grown < epoch) grown = epoch;
+        t->rows = realloc(t->rows, (size_t)grown * sizeof(TelemetryRow));
+        memset(t->rows + t->capacity, 0, (size_t)(grown - t->capacity) * sizeof(TelemetryRow));
+        t->capacity = grown;
+    }
+    if (epoch > t->count) t->count = epoch;
+    return &t->rows[epoch - 1];
+}
+
+void telemetry_epoch(const NNEpochStats *stats, void *telemetry) {
+    NNTelemetry *t = telemetry;
+    if (stats->epoch < 1) return;
+    g_mutex_lock(&t->lock);
+    TelemetryRow *row = epoch_row(t, stats->epoch);
+    row->stats = *stats;
+    row->has_stats = 1;
+    g_mutex_unlock(&t->lock);
+}
+
+void telemetry_validation(int epoch, double loss, double accuracy, double seconds, void *telemetry) {
+    NNTelemetry *t = telemetry;
+    if (epoch < 1) return;
+    g_mutex_lock(&t->lock);
+    TelemetryRow *row = epoch_row(t, epoch);
+    row->has_validation = 1;
+    row->val_loss = loss;
+    row->val_accuracy = accuracy;
+    row->val_seconds = seconds;
+    g_mutex_unlock(&t->lock);
+}
+
+static double row_accuracy(const TelemetryRow *row) {
+    return row->stats.samples ? (double)row->stats.correct / row->stats.samples * 100.0 : 0.0;
+}
+
+static double row_throughput(const TelemetryRow *row) {
+    return row->stats.seconds > 0.0 ? row->stats.samples / row->stats.seconds : 0.0;
+}
+
+// A diverged run has NaN or infinite losses: those are written as
+// `missing` (an empty CSV field, JSON null) so the log still parses
+static void write_number(FILE *out, const char *format, double value, const char *missing) {
+    if (isfinite(value)) fprintf(out, format, value);
+    else fputs(missing, out);
+}
+
+static void write_csv(NNTelemetry *t, FILE *out) {
+    fprintf(out, "epoch,samples,seconds,samples_per_sec,learning_rate,loss,accuracy,val_loss,val_accuracy,val_seconds");
+    for (int p = 0; p < NN_PHASE_COUNT; p++) fprintf(out, ",%s_seconds", nn_phase_name((NNPhase)p));
+    fprintf(out, "\n");
+
+    // Validation columns stay empty on the epochs that weren't evaluated
+    for (int e = 0; e < t->count; e++) {
+        const TelemetryRow *row = &t->rows[e];
+        if (!row->has_stats) continue;
+        fprintf(out, "%d,%zu,%.6f,%.1f,%.6g,", e + 1, row->stats.samples, row->stats.seconds,
+                row_throughput(row), row->stats.learning_rate);
+        write_number(out, "%.6f", row->stats.loss, "");
+        fprintf(out, ",%.4f", row_accuracy(row));
+        if (row->has_validation) {
+            fprintf(out, ",");
+            write_number(out, "%.6f", row->val_loss, "");
+            fprintf(out, ",%.4f,%.6f", row->val_accuracy, row->val_seconds);
+        } else {
+            fprintf(out, ",,,");
+        }
+        for (int p = 0; p < NN_PHASE_COUNT; p++) fprintf(out, ",%.6f", row->stats.phase_seconds[p]);
+        fprintf(out, "\n");
+    }
+}
+
+static void write_json_string(FILE *out, const char *text) {
+    fputc('"', out);
+    for (const unsigned char *c = (const unsigned char*)text; *c; c++) {
+        if (*c == '"' || *c == '\\') fprintf(out, "\\%c", *c);
+        else if (*c < 0x20) fprintf(out, "\\u%04x", *c);
+        else fputc(*c, out);
+    }
+    fputc('"', out);
+}
+
+static void write_json(NNTelemetry *t, FILE *out) {
+    fprintf(out, "{\n  \"run\": {");
+    for (int i = 0; i < t->info_count; i++) {
+        fprintf(out, "%s\n    ", i ? "," : "");
+        write_json_string(out, t->info[i].key);
+        fprintf(out, ": ");
+        if (t->info[i].text) write_json_string(out, t->info[i].text);
+        else write_number(out, "%.10g", t->info[i].number, "null");
+    }
+    fprintf(out, "%s},\n  \"epochs\": [", t->info_count ? "\n  " : "");
+
+    // Totals over the epochs, for a one-line comparison of two runs
+    int first = 1;
+    size_t samples = 0;
+    double seconds = 0.0, phases[NN_PHASE_COUNT] = { 0 };
+    for (int e = 0; e < t->count; e++) {
+        const TelemetryRow *row = &t->rows[e];
+        if (!row->has_stats) continue;
+        fprintf(out, "%s\n    {\"epoch\": %d, \"samples\": %zu, \"seconds\": %.6f, \"samples_per_sec\": %.1f, "
+                "\"learning_rate\": %.6g, \"loss\": ",
+                first ? "" : ",", e + 1, row->stats.samples, row->stats.seconds, row_throughput(row),
+                row->stats.learning_rate);
+        write_number(out, "%.6f", row->stats.loss, "null");
+        fprintf(out, ", \"accuracy\": %.4f", row_accuracy(row));
+        if (row->has_validation) {
+            fprintf(out, ", \"val_loss\": ");
+            write_number(out, "%.6f", row->val_loss, "null");
+            fprintf(out, ", \"val_accuracy\": %.4f, \"val_seconds\": %.6f", row->val_accuracy, row->val_seconds);
+        }
+        fprintf(out, ", \"phases\": {");
+        for (int p = 0; p < NN_PHASE_COUNT; p++) {
+            fprintf(out, "%s\"%s\": %.6f", p ? ", " : "", nn_phase_name((NNPhase)p), row->stats.phase_seconds[p]);
+            phases[p] += row->stats.phase_seconds[p];
+        }
+        fprintf(out, "}}");
+        samples += row->stats.samples;
+        seconds += row->stats.seconds;
+        first = 0;
+    }
+
+    fprintf(out, "%s],\n  \"total\": {\"samples\": %zu, \"seconds\": %.6f, \"samples_per_sec\": %.1f, \"phases\": {",
+            first ? "" : "\n  ", samples, seconds, seconds > 0.0 ? samples / seconds : 0.0);
+    for (int p = 0; p < NN_PHASE_COUNT; p++) {
+        fprintf(out, "%s\"%s\": %.6f", p ? ", " : "", nn_phase_name((NNPhase)p), phases[p]);
+    }
+    fprintf(out, "}}\n}\n");
+}
+
+int telemetry_write(NNTelemetry *telemetry, const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "Error: Cannot write the training log '%s'\n", path);
+        return 0;
+    }
+
+    g_mutex_lock(&telemetry->lock);
+    if (g_str_has_suffix(path, ".json")) write_json(telemetry, out);
+    else write_csv(telemetry, out);
+    g_mutex_unlock(&telemetry->lock);
+
+    int ok = !ferror(out);
+    ok = (fclose(out) == 0) && ok;
+    if (ok) printf("Training log written to '%s'\n", path);
+    else fprintf(stderr, "Error: Cannot write the training log '%s'\n", path);
+    return ok;
+}
@@ -0,0 +1,27 @@
+#ifndef NN_TELEMETRY_H
+#define NN_TELEMETRY_H
+
+#include "neural_network.h"
+
+// Training log: one row per epoch with its wall time, throughput, loss and
+// accuracy, the validation of that epoch (if evaluated) and the time split
+// by phase (see NNPhase). Written once training ended, as CSV (one line per
+// epoch, fixed columns) or JSON (the run description and the epochs), so
+// runs can be diffed across trainer changes and machines.
+typedef struct NNTelemetry NNTelemetry;
+
+NNTelemetry* telemetry_new(void);
+void telemetry_free(NNTelemetry *telemetry);
+
+// Describes the run (JSON log only), in the order set
+void telemetry_set_string(NNTelemetry *telemetry, const char *key, const char *value);
+void telemetry_set_number(NNTelemetry *telemetry, const char *key, double value);
+
+// TrainConfig.epoch_stats and validation_stats, the telemetry as their data
+void telemetry_epoch(const NNEpochStats *stats, void *telemetry);
+void telemetry_validation(int epoch, double loss, double accuracy, double seconds, void *telemetry);
+
+// JSON if path ends in ".json", CSV otherwise. Returns 1 on success.
+int telemetry_write(NNTelemetry *telemetry, const char *path);
+
+#endif
@@ -0,0 +1,426 @@
+#include "nn_train.h"
+#include <glib.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Every thread of a run waits here until all of them arrived
+typedef struct {
+    GMutex lock;
+    GCond cond;
+    int parties;
+    int waiting;
+    unsigned int generation;
+} TrainBarrier;
+
+static void barrier_wait(TrainBarrier *barrier) {
+    g_mutex_lock(&barrier->lock);
+    unsigned int generation = barrier->generation;
+    if (++barrier->waiting == barrier->parties) {
+        barrier->waiting = 0;
+        barrier->generation++;
+        g_cond_broadcast(&barrier->cond);
+    } else {
+        while (generation == barrier->generation) g_cond_wait(&barrier->cond, &barrier->lock);
+    }
+    g_mutex_unlock(&barrier->lock);
+}
+
+// State shared by the threads of one training run
+typedef struct {
+    Network *net;
+    TrainingExample *examples;
+    size_t num_examples;
+    const TrainConfig *config;
+    int threads;
+    size_t *order;
+    TrainBarrier barrier;
+    NNWorkspace **workspaces;
+    NNGradients **gradients;
+    size_t *correct;        // Per thread, current epoch
+    int first_epoch;        // Epochs the optimizer state trained before this run
+    double learning_rate;   // Set by thread 0 between epochs
+    double epoch_started;   // nn_seconds() at the start of the epoch, thread 0
+    int stop;               // Set by thread 0 between epochs
+} TrainRun;
+
+typedef struct {
+    TrainRun *run;
+    int id;
+} TrainThread;
+
+// [first, end) of thread `id` when n items are split across `threads`
+static size_t split_begin(size_t n, int threads, int id) {
+    return n * (size_t)id / (size_t)threads;
+}
+
+static void sync_batch(TrainRun *run, int id, size_t start, size_t count) {
+    Network *net = run->net;
+    const int threads = run->threads;
+    size_t first = split_begin(count, threads, id), end = split_begin(count, threads, id + 1);
+
+    // Private gradients of this thread's slice (the weights are only read)
+    training_batch_load(net, run->workspaces[id], run->examples, run->order + start + first, end - first);
+    run->correct[id] += training_batch_pass(net, run->workspaces[id], end - first);
+    training_batch_gradients(net, run->workspaces[id], end - first, run->gradients[id]);
+    double reduced = nn_seconds();
+    barrier_wait(&run->barrier);
+
+    // Tree reduction into thread 0's buffers, fixed pairing so the sums
+    // always happen in the same order
+    for (int step = 1; step < threads; step *= 2) {
+        if (id % (2 * step) == 0 && id + step < threads) {
+            add_gradients(net, run->gradients[id], run->gradients[id + step]);
+        }
+        barrier_wait(&run->barrier);
+    }
+
+    // One update, every thread takes a band of input rows (and the
+    // matching rows of the optimizer moments)
+    NNOptimizer *optimizer = run->config->optimizer;
+    double *alpha_delta = run->gradients[id]->alpha_delta;
+    memset(alpha_delta, 0, net->hidden_size * sizeof(double));
+    apply_gradients(net, run->gradients[0], optimizer, run->learning_rate, count,
+                    split_begin(net->input_size, threads, id),
+                    split_begin(net->input_size, threads, id + 1), id == threads - 1, alpha_delta);
+    barrier_wait(&run->barrier);
+
+    // Every band was applied with the same step count, the next batch
+    // reads the new one after its own barriers
+    if (optimizer && id == 0) optimizer->step++;
+
+    // alpha is shared by every row of the band: the changes of the threads
+    // are added in thread order
+    if (net->binarized) {
+        if (id == 0) {
+            for (int t = 0; t < threads; t++) {
+                for (size_t i = 0; i < net->hidden_size; i++) net->alpha_hidden[i] += run->gradients[t]->alpha_delta[i];
+            }
+        }
+        barrier_wait(&run->barrier);
+    }
+
+    // Reduction, update and the waits for the other threads
+    run->workspaces[id]->phase_seconds[NN_PHASE_UPDATE] += nn_seconds() - reduced;
+}
+
+static gpointer train_thread(gpointer data) {
+    TrainThread *self = (TrainThread*)data;
+    TrainRun *run = self->run;
+    Network *net = run->net;
+    const TrainConfig *config = run->config;
+    const size_t batch = config->batch_size;
+    const int id = self->id;
+
+    for (int epoch = 0; epoch < config->epochs; epoch++) {
+        training_stats_reset(run->workspaces[id]);
+        if (id == 0) {
+            run->epoch_started = nn_seconds();
+            if (config->epoch_begin) config->epoch_begin(epoch, config->epoch_begin_data);
+            shuffle_order(run->order, run->num_examples);
+            run->learning_rate = scheduled_learning_rate(config, run->first_epoch, epoch);
+            run->workspaces[0]->phase_seconds[NN_PHASE_DATA] += nn_seconds() - run->epoch_started;
+        }
+        run->correct[id] = 0;
+        barrier_wait(&run->barrier);
+
+        if (config->hogwild) {
+            // This thread's share of the epoch, in its own mini-batches
+            size_t first = split_begin(run->num_examples, run->threads, id);
+            size_t end = split_begin(run->num_examples, run->threads, id + 1);
+            for (size_t start = first; start < end; start += batch) {
+                size_t count = end - start < batch ? end - start : batch;
+                training_batch_load(net, run->workspaces[id], run->examples, run->order + start, count);
+                run->correct[id] += training_batch_pass(net, run->workspaces[id], count);
+                training_batch_update(net, run->workspaces[id], count, run->learning_rate);
+            }
+        } else {
+            for (size_t start = 0; start < run->num_examples; start += batch) {
+                size_t count = run->num_examples - start < batch ? run->num_examples - start : batch;
+                sync_batch(run, id, start, count);
+            }
+        }
+        barrier_wait(&run->barrier);
+
+        // Phase times as thread 0 saw them: the others move in step with it
+        if (id == 0) {
+            size_t correct = 0;
+            double loss = 0.0;
+            for (int t = 0; t < run->threads; t++) {
+                correct += run->correct[t];
+                loss += run->workspaces[t]->loss;
+            }
+            NNEpochStats stats;
+            training_epoch_stats(&stats, run->workspaces[0], epoch, run->num_examples, correct, loss,
+                                 run->learning_rate, run->epoch_started);
+            run->stop = training_epoch_end(net, config, epoch, &stats);
+        }
+        barrier_wait(&run->barrier);
+        if (run->stop) break;
+    }
+    return NULL;
+}
+
+static void train_threads(Network *net, TrainingExample *examples, size_t num_examples,
+                          const TrainConfig *config, int threads) {
+    // Generated code has the old weights baked in
+    net->specialized = NULL;
+
+    printf("Training started (%d threads, %s, mini-batches of %zu)...\n",
+           threads, config->hogwild ? "hogwild" : "synchronous", config->batch_size);
+
+    TrainRun run = { 0 };
+    run.net = net;
+    run.examples = examples;
+    run.num_examples = num_examples;
+    run.config = config;
+    run.threads = threads;
+    run.first_epoch = config->optimizer ? config->optimizer->epoch : 0;
+    run.order = malloc((num_examples ? num_examples : 1) * sizeof(size_t));
+    for (size_t i = 0; i < num_examples; i++) run.order[i] = i;
+    g_mutex_init(&run.barrier.lock);
+    g_cond_init(&run.barrier.cond);
+    run.barrier.parties = threads;
+
+    // Synchronous slices hold at most ceil(batch / threads) samples
+    size_t slice = config->hogwild ? config->batch_size : (config->batch_size + threads - 1) / threads;
+    run.workspaces = malloc(threads * sizeof(NNWorkspace*));
+    run.gradients = calloc(threads, sizeof(NNGradients*));
+    run.correct = calloc(threads, sizeof(size_t));
+    for (int t = 0; t < threads; t++) {
+        run.workspaces[t] = create_workspace(net, slice);
+        run.workspaces[t]->optimizer = config->optimizer;
+        training_soft_targets(run.workspaces[t], config);
+        if (!config->hogwild) run.gradients[t] = create_gradients(net);
+    }
+
+    TrainThread *contexts = malloc(threads * sizeof(TrainThread));
+    GThread **workers = malloc(threads * sizeof(GThread*));
+    for (int t = 0; t < threads; t++) {
+        contexts[t].run = &run;
+        contexts[t].id = t;
+        if (t > 0) workers[t] = g_thread_new("trainer", train_thread, &contexts[t]);
+    }
+
+    // The caller is thread 0
+    train_thread(&contexts[0]);
+    for (int t = 1; t < threads; t++) g_thread_join(workers[t]);
+
+    for (int t = 0; t < threads; t++) {
+        free_workspace(run.workspaces[t]);
+        free_gradients(run.gradients[t]);
+    }
+    free(run.workspaces);
+    free(run.gradients);
+    free(run.correct);
+    free(run.order);
+    free(contexts);
+    free(workers);
+    g_mutex_clear(&run.barrier.lock);
+    g_cond_clear(&run.barrier.cond);
+}
+
+// Validation of a training run, on a background thread: at the end of every
+// eval_every-th epoch the weights are copied into a snapshot and training
+// goes on while the snapshot is evaluated. The weights with the lowest
+// validation loss are kept aside and put back at the end, with the
+// optimizer state they were trained with.
+typedef struct {
+    const TrainConfig *config;
+    Network *snapshot;      // Weights being (or about to be) evaluated
+    Network *best;          // Weights with the lowest validation loss so far
+    NNOptimizer *snapshot_state;    // config->optimizer at the snapshot, NULL without one
+    NNOptimizer *best_state;        // ... and at the best weights
+    int snapshot_epoch;     // Epoch count of the snapshot, 0 if none yet
+    int last_epoch;         // Epochs trained so far
+    int best_epoch;
+    double best_loss;
+    double best_accuracy;
+    int since_best;         // Evaluations without improvement
+    int pending;            // Snapshot waiting for (or under) evaluation
+    int quit;
+    GMutex lock;
+    GCond cond;
+    GThread *thread;
+} Validation;
+
+// Mean cross-entropy of the network on the validation examples
+static double validation_loss(Network *net, const TrainingExample *examples, size_t count, double *accuracy) {
+    double *hidden = malloc(net->hidden_size * sizeof(double));
+    double *output = malloc(net->output_size * sizeof(double));
+    double loss = 0.0;
+    size_t correct = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        forward_packed(net, examples[i].bits, hidden, output);
+        int predicted = 0;
+        for (size_t j = 1; j < net->output_size; j++) {
+            if (output[j] > output[predicted]) predicted = (int)j;
+        }
+        if (predicted == examples[i].label) correct++;
+        loss -= log(output[examples[i].label] > 1e-12 ? output[examples[i].label] : 1e-12);
+    }
+
+    free(hidden);
+    free(output);
+    *accuracy = count ? (double)correct / count * 100.0 : 0.0;
+    return count ? loss / count : 0.0;
+}
+
+static gpointer validation_thread(gpointer data) {
+    Validation *v = (Validation*)data;
+
+    g_mutex_lock(&v->lock);
+    for (;;) {
+        while (!v->pending && !v->quit) g_cond_wait(&v->cond, &v->lock);
+        if (!v->pending) break;
+        int epoch = v->snapshot_epoch;
+        g_mutex_unlock(&v->lock);
+
+        // The trainer doesn't touch the snapshot (nor best) while pending is set
+        double accuracy;
+        double started = nn_seconds();
+        double loss = validation_loss(v->snapshot, v->config->validation, v->config->validation_count, &accuracy);
+        double seconds = nn_seconds() - started;
+        int improved = loss < v->best_loss;
+        if (improved) {
+            copy_network_weights(v->best, v->snapshot);
+            if (v->best_state) copy_optimizer(v->best_state, v->snapshot_state, v->best);
+        }
+        printf("  Validation after epoch %d: loss %.4f, accuracy %.2f%%%s\n",
+               epoch, loss, accuracy, improved ? " (best)" : "");
+        fflush(stdout);
+        if (v->config->validation_stats) {
+            v->config->validation_stats(epoch, loss, accuracy, seconds, v->config->stats_data);
+        }
+
+        g_mutex_lock(&v->lock);
+        if (improved) {
+            v->best_loss = loss;
+            v->best_accuracy = accuracy;
+            v->best_epoch = epoch;
+            v->since_best = 0;
+        } else {
+            v->since_best++;
+        }
+        v->pending = 0;
+        g_cond_broadcast(&v->cond);
+    }
+    g_mutex_unlock(&v->lock);
+    return NULL;
+}
+
+// Hands the current weights to the validation thread (v->lock held)
+static void submit_snapshot(Validation *v, Network *net, int epoch) {
+    while (v->pending) g_cond_wait(&v->cond, &v->lock);
+    copy_network_weights(v->snapshot, net);
+    if (v->snapshot_state) copy_optimizer(v->snapshot_state, v->config->optimizer, net);
+    v->snapshot_epoch = epoch;
+    v->pending = 1;
+    g_cond_broadcast(&v->cond);
+}
+
+// TrainConfig.epoch_end of a run with a validation set
+static int validation_epoch_end(Network *net, int epoch, void *data) {
+    Validation *v = (Validation*)data;
+    const int every = v->config->eval_every > 0 ? v->config->eval_every : 1;
+    const int patience = v->config->patience;
+
+    g_mutex_lock(&v->lock);
+    v->last_epoch = epoch + 1;
+
+    // Decided on the evaluations finished so far: the previous snapshot is
+    // waited for only when the next one is due
+    if ((epoch + 1) % every == 0) {
+        while (v->pending) g_cond_wait(&v->cond, &v->lock);
+    }
+    int stop = patience > 0 && v->since_best >= patience;
+    if (!stop && (epoch + 1) % every == 0) submit_snapshot(v, net, epoch + 1);
+    g_mutex_unlock(&v->lock);
+
+    if (stop) {
+        printf("Validation loss hasn't improved for %d evaluations, stopping early\n", patience);
+    }
+    return stop;
+}
+
+static Validation *validation_start(Network *net, const TrainConfig *config) {
+    Validation *v = (Validation*)calloc(1, sizeof(Validation));
+    v->config = config;
+    v->snapshot = create_network_dtype(net->input_size, net->hidden_size, net->output_size, NN_DTYPE_F64);
+    v->best = create_network_dtype(net->input_size, net->hidden_size, net->output_size, NN_DTYPE_F64);
+    if (config->optimizer) {
+        v->snapshot_state = create_optimizer(net, config->optimizer->kind);
+        v->best_state = create_optimizer(net, config->optimizer->kind);
+    }
+    v->best_loss = HUGE_VAL;
+    g_mutex_init(&v->lock);
+    g_cond_init(&v->cond);
+    v->thread = g_thread_new("validation", validation_thread, v);
+
+    printf("Validation: %zu held-out images, every %d epoch(s)", config->validation_count,
+           config->eval_every > 0 ? config->eval_every : 1);
+    if (config->patience > 0) printf(", patience %d", config->patience);
+    printf("\n");
+    return v;
+}
+
+// Evaluates the final weights if they weren't, stops the thread and puts
+// the best weights back into net, and their optimizer state (epoch count
+// included) back into config->optimizer, so a resumed run goes on from them
+static void validation_finish(Validation *v, Network *net) {
+    g_mutex_lock(&v->lock);
+    while (v->pending) g_cond_wait(&v->cond, &v->lock);
+    if (v->last_epoch > v->snapshot_epoch) {
+        submit_snapshot(v, net, v->last_epoch);
+        while (v->pending) g_cond_wait(&v->cond, &v->lock);
+    }
+    v->quit = 1;
+    g_cond_broadcast(&v->cond);
+    g_mutex_unlock(&v->lock);
+    g_thread_join(v->thread);
+
+    if (v->best_epoch > 0) {
+        copy_network_weights(net, v->best);
+        if (v->best_state) copy_optimizer(v->config->optimizer, v->best_state, net);
+        printf("Keeping the weights of epoch %d (validation loss %.4f, accuracy %.2f%%)\n",
+               v->best_epoch, v->best_loss, v->best_accuracy);
+    }
+
+    free_network(v->snapshot);
+    free_network(v->best);
+    free_optimizer(v->snapshot_state);
+    free_optimizer(v->best_state);
+    g_mutex_clear(&v->lock);
+    g_cond_clear(&v->cond);
+    free(v);
+}
+
+void train_data_parallel(Network *net, TrainingExample *examples, size_t num_examples, const TrainConfig *config) {
+    int threads = config->threads > 0 ? config->threads : (int)g_get_num_processors();
+    TrainConfig local = *config;
+    if (!nn_trainable(net)) return;
+
+    if (local.hogwild && net->binarized) {
+        printf("Hogwild is not available for binarized training, using synchronous updates\n");
+        local.hogwild = 0;
+    }
+
+    Validation *validation = NULL;
+    if (local.validation_count > 0) {
+        validation = validation_start(net, &local);
+        local.epoch_end = validation_epoch_end;
+        local.epoch_data = validation;
+    }
+
+    // Synchronous threads split each batch, a batch needs a sample per thread
+    if (!local.hogwild && (size_t)threads > local.batch_size) threads = (int)local.batch_size;
+    if (threads <= 1 || local.batch_size <= 1) {
+        train_minibatch(net, examples, num_examples, &local);
+    } else {
+        train_threads(net, examples, num_examples, &local, threads);
+    }
+
+    if (validation) validation_finish(validation, net);
+}
@@ -0,0 +1,32 @@
+#ifndef NN_TRAIN_H
+#define NN_TRAIN_H
+
+#include "neural_network.h"
+
+// Multi-threaded train_minibatch, config->threads threads (0 = one per core).
+//
+// Synchronous mode: every mini-batch is split evenly across the threads,
+// each computes the summed gradients of its slice into private buffers,
+// the buffers are added pairwise in a tree (log2(threads) steps) and one
+// mean-gradient update is applied, split by weight rows. Results only
+// depend on the seed and the thread count.
+//
+// Hogwild mode (config->hogwild): each thread trains on its own share of
+// every epoch and updates the shared weights without any locking. Sparse
+// glyphs rarely touch the same rows at once, but results are not
+// reproducible. Not available for binarized training.
+//
+// The threads share config->optimizer: synchronous updates move the
+// moments of each band of rows once per batch, hogwild threads update them
+// without locking, like the weights.
+//
+// One thread runs train_minibatch().
+//
+// With config->validation set, a background thread evaluates a copy of the
+// weights every config->eval_every epochs while training goes on, training
+// stops early after config->patience evaluations without a lower
+// validation loss, and the net ends up with the best evaluated weights,
+// config->optimizer with the state (moments, updates, epochs) they had.
+void train_data_parallel(Network *net, TrainingExample *examples, size_t num_examples, const TrainConfig *config);
+
+#endif
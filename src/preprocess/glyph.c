@@ -0,0 +1,66 @@
+#include "glyph.h"
+
+GdkPixbuf *normalize_glyph(GdkPixbuf *source, int x, int y, int w, int h, int padding) {
+    int img_w = gdk_pixbuf_get_width(source);
+    int img_h = gdk_pixbuf_get_height(source);
+
+    // Bounds check
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (x + w > img_w) w = img_w - x;
+    if (y + h > img_h) h = img_h - y;
+    if (w <= 0 || h <= 0) return NULL;
+
+    // Extract
+    GdkPixbuf *extracted = gdk_pixbuf_new_subpixbuf(source, x, y, w, h);
+
+    // Create canvas (30x30 white background)
+    GdkPixbuf *canvas = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, IMAGE_SIZE, IMAGE_SIZE);
+    gdk_pixbuf_fill(canvas, 0xFFFFFFFF);
+
+    // Calculate scale to fit with padding
+    int target_size = IMAGE_SIZE - (padding * 2);
+    if (target_size < 1) target_size = 1;
+
+    double scale_w = (double)target_size / w;
+    double scale_h = (double)target_size / h;
+    double scale = (scale_w < scale_h) ? scale_w : scale_h;
+
+    int new_w = (int)(w * scale);
+    int new_h = (int)(h * scale);
+    if (new_w < 1) new_w = 1;
+    if (new_h < 1) new_h = 1;
+
+    int offset_x = (IMAGE_SIZE - new_w) / 2;
+    int offset_y = (IMAGE_SIZE - new_h) / 2;
+
+    // Paste resized image onto canvas
+    gdk_pixbuf_scale(extracted, canvas, offset_x, offset_y, new_w, new_h, offset_x, offset_y, scale, scale, GDK_INTERP_BILINEAR);
+
+    g_object_unref(extracted);
+    return canvas;
+}
+
+void pixbuf_to_pixels(GdkPixbuf *image, double *pixels) {
+    // Get image data
+    int n_channels = gdk_pixbuf_get_n_channels(image);
+    int rowstride = gdk_pixbuf_get_rowstride(image);
+    guchar *pixels_data = gdk_pixbuf_get_pixels(image);
+
+    for (int y = 0; y < IMAGE_SIZE; y++) {
+        for (int x = 0; x < IMAGE_SIZE; x++) {
+            guchar *pixel = pixels_data + y * rowstride + x * n_channels;
+            
+            // Compute luminosity
+            int luminance;
+            if (n_channels >= 3) {
+                luminance = (pixel[0] + pixel[1] + pixel[2]) / 3;
+            } else {
+                luminance = pixel[0];
+            }
+            
+            // 128 threshold: darker pixels = 1, lighter pixels = 0
+            pixels[y * IMAGE_SIZE + x] = luminance < 128 ? 1.0 : 0.0;
+        }
+    }
+}
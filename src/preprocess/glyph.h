@@ -0,0 +1,22 @@
+#ifndef GLYPH_H
+#define GLYPH_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+// A letter as the network sees it, shared by the letter exports of detect/
+// and the recognizer (its dataset and synthetic glyphs)
+#define IMAGE_SIZE 30
+
+#define PIXEL_COUNT (IMAGE_SIZE * IMAGE_SIZE)
+
+// The crop of a letter: (x, y, w, h) of source fitted into
+// IMAGE_SIZE - 2 * padding pixels, aspect kept, centred on a white
+// IMAGE_SIZE x IMAGE_SIZE canvas. NULL if the box is outside the image.
+#define GLYPH_PADDING 7
+GdkPixbuf *normalize_glyph(GdkPixbuf *source, int x, int y, int w, int h, int padding);
+
+// Thresholds an IMAGE_SIZE x IMAGE_SIZE image to PIXEL_COUNT inputs
+// (dark = 1)
+void pixbuf_to_pixels(GdkPixbuf *image, double *pixels);
+
+#endif
@@ -17,7 +17,8 @@ struct PreProcessData
     
     double rotation_angle;
 
-    struct PageLayout *layout;
+    struct PageLayout **layouts; // one per puzzle found on the page
+    int layout_count;
     struct FoundLine *lines;
     int line_count;
 };
@@ -228,6 +228,7 @@ int solve_puzzle(const char *grid_file, const char *words_file, FoundLine **foun
             (*found_lines)[*lines_count].start_row = pos[0].y;
             (*found_lines)[*lines_count].end_col   = pos[1].x;
             (*found_lines)[*lines_count].end_row   = pos[1].y;
+            (*found_lines)[*lines_count].region    = 0;
             (*lines_count)++;
             free(pos);
         } else {
@@ -14,9 +14,10 @@ typedef struct {
 } Position;
 
 // line struct
-typedef struct {
+typedef struct FoundLine {
     int start_col, start_row;
     int end_col, end_row;
+    int region; // index of the puzzle on the page (multi-puzzle pages)
 } FoundLine;
 //prototypes functions
 Position* solver(char** grid, int rows, int cols, const char word[]);